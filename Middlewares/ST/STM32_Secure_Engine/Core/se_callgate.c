@@ -647,6 +647,59 @@ SE_ErrorStatus SE_CallGateService(SE_FunctionIDTypeDef eID, SE_StatusTypeDef *pe
       break;
     }
 
+    case SE_CRYPTO_LL_AUTHENTICATE_FW_APPEND_FLASH_ID:
+    {
+#ifndef KMS_ENABLED
+      const uint8_t *input_buffer;
+      int32_t      input_size;
+
+      /* Check that the Secure Engine services are not locked */
+      __IS_SE_LOCKED_SERVICES();
+
+      /* retrieve argument(s) */
+      input_buffer = va_arg(arguments, const uint8_t *);
+      input_size = va_arg(arguments, int32_t);
+
+      /* CRC configuration may have been changed by application */
+      if (SE_LL_CRC_Config() == SE_ERROR)
+      {
+        e_ret_status = SE_ERROR;
+        break;
+      }
+
+      /* Check the pointers allocation: the input is read in place, it must be a FW image area of the Flash */
+      if (input_size <= 0)
+      {
+        e_ret_status = SE_ERROR;
+        break;
+      }
+      if (SE_LL_Buffer_in_FW_slots(input_buffer, (uint32_t)input_size) != SE_SUCCESS)
+      {
+        e_ret_status = SE_ERROR;
+        break;
+      }
+
+      /* Double Check to avoid basic fault injection : Check that the Secure Engine services are not locked */
+      __IS_SE_LOCKED_SERVICES();
+
+      /* Double Check to avoid basic fault injection : Check the pointers allocation */
+      if (input_size <= 0)
+      {
+        e_ret_status = SE_ERROR;
+        break;
+      }
+      if (SE_LL_Buffer_in_FW_slots(input_buffer, (uint32_t)input_size) != SE_SUCCESS)
+      {
+        e_ret_status = SE_ERROR;
+        break;
+      }
+
+      /* Call SE CRYPTO function*/
+      e_ret_status = SE_CRYPTO_AuthenticateFW_AppendFlash(input_buffer, input_size);
+#endif /* !KMS_ENABLED */
+      break;
+    }
+
     case SE_CRYPTO_LL_AUTHENTICATE_FW_FINISH_ID:
     {
 #ifndef KMS_ENABLED
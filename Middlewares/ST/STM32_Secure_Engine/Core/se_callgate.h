@@ -60,6 +60,7 @@ extern "C" {
 #define SE_CRYPTO_LL_AUTHENTICATE_FW_INIT_ID      (0x07UL)    /*!< CRYPTO Low level Authenticate_FW_Init */
 #define SE_CRYPTO_LL_AUTHENTICATE_FW_APPEND_ID    (0x08UL)    /*!< CRYPTO Low level Authenticate_FW_Append */
 #define SE_CRYPTO_LL_AUTHENTICATE_FW_FINISH_ID    (0x09UL)    /*!< CRYPTO Low level Authenticate_FW_Finish */
+#define SE_CRYPTO_LL_AUTHENTICATE_FW_APPEND_FLASH_ID (0x0AUL) /*!< CRYPTO Low level Authenticate_FW_Append in Flash */
 
 /* CRYPTO High level functions for bootloader only */
 #define SE_CRYPTO_HL_AUTHENTICATE_METADATA        (0x10UL)    /*!< CRYPTO High level Authenticate Metadata */
@@ -134,6 +134,11 @@ SE_ErrorStatus SE_CRYPTO_AuthenticateFW_Append(const uint8_t *pInputBuffer, int3
   /* use the common cypto code from se_crypto_common.c when possible */
 }
 
+SE_ErrorStatus SE_CRYPTO_AuthenticateFW_AppendFlash(const uint8_t *pInputBuffer, int32_t InputSize)
+{
+  /* use the common cypto code from se_crypto_common.c when possible */
+}
+
 SE_ErrorStatus SE_CRYPTO_AuthenticateFW_Finish(uint8_t *pOutputBuffer, int32_t *pOutputSize)
 {
   /* use the common cypto code from se_crypto_common.c when possible */
@@ -625,6 +625,55 @@ SE_ErrorStatus SE_AuthenticateFW_Append(SE_StatusTypeDef *peSE_Status, const uin
   return e_ret_status;
 }
 
+/**
+  * @brief Secure Engine Firmware Authentication Append function for a FW image area of the Flash.
+  *        It is a wrapper of AuthenticateFW_AppendFlash function included in the Firewall.
+  * @note  The area is processed in place by the Secure Engine: no copy, no output buffer.
+  *        Only available when the FW tag is a SHA256 digest.
+  * @param peSE_Status Secure Engine Status.
+  *        This parameter can be a value of @ref SE_Status_Structure_definition.
+  * @param pInputBuffer pointer to the Flash area: slot #0 (header excluded), slot #1 or swap area.
+  * @param InputSize Input Size (bytes).
+  * @retval SE_ErrorStatus SE_SUCCESS if successful, SE_ERROR otherwise.
+  */
+SE_ErrorStatus SE_AuthenticateFW_AppendFlash(SE_StatusTypeDef *peSE_Status, const uint8_t *pInputBuffer,
+                                             int32_t InputSize)
+{
+
+  SE_ErrorStatus e_ret_status;
+
+  /* Check if the call is coming from SFU code*/
+  __IS_SFU_RESERVED();
+
+#ifdef SFU_ISOLATE_SE_WITH_MPU
+  if (0 != SE_IsUnprivileged())
+  {
+    uint32_t params[2] = {(uint32_t)pInputBuffer, (uint32_t)InputSize};
+    SE_SysCall(&e_ret_status, SE_CRYPTO_LL_AUTHENTICATE_FW_APPEND_FLASH_ID, peSE_Status, &params);
+  }
+  else
+  {
+#endif /* SFU_ISOLATE_SE_WITH_MPU */
+
+    /* Set the CallGate function pointer */
+    SET_CALLGATE();
+
+    /*Enter Secure Mode*/
+    SE_EnterSecureMode();
+
+    /*Secure Engine Call*/
+    e_ret_status = (*SE_CallGatePtr)(SE_CRYPTO_LL_AUTHENTICATE_FW_APPEND_FLASH_ID, peSE_Status, pInputBuffer,
+                                     InputSize);
+
+    /*Exit Secure Mode*/
+    SE_ExitSecureMode();
+#ifdef SFU_ISOLATE_SE_WITH_MPU
+  }
+#endif /* SFU_ISOLATE_SE_WITH_MPU */
+
+  return e_ret_status;
+}
+
 /**
   * @brief Secure Engine Firmware Authentication Finish function.
   *        It is a wrapper of AuthenticateFW_Finish function included in the Firewall.
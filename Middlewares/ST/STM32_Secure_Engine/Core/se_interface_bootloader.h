@@ -72,6 +72,8 @@ SE_ErrorStatus SE_AuthenticateFW_Init(SE_StatusTypeDef *peSE_Status, SE_FwRawHea
                                       int32_t SE_FwType);
 SE_ErrorStatus SE_AuthenticateFW_Append(SE_StatusTypeDef *peSE_Status, const uint8_t *pInputBuffer, int32_t InputSize,
                                         uint8_t *pOutputBuffer, int32_t *pOutputSize);
+SE_ErrorStatus SE_AuthenticateFW_AppendFlash(SE_StatusTypeDef *peSE_Status, const uint8_t *pInputBuffer,
+                                             int32_t InputSize);
 SE_ErrorStatus SE_AuthenticateFW_Finish(SE_StatusTypeDef *peSE_Status, uint8_t *pOutputBuffer, int32_t *pOutputSize);
 
 /**
@@ -179,6 +179,7 @@ void SE_SVC_Handler(uint32_t *args)
     case SE_CRYPTO_LL_AUTHENTICATE_FW_INIT_ID:
     case SE_CRYPTO_LL_DECRYPT_FINISH_ID:
     case SE_CRYPTO_LL_AUTHENTICATE_FW_FINISH_ID:
+    case SE_CRYPTO_LL_AUTHENTICATE_FW_APPEND_FLASH_ID:
     case SE_IMG_ERASE:
       ret = (*SE_CallGatePtr)((SE_FunctionIDTypeDef)args[1],
                               (SE_StatusTypeDef *)args[2],
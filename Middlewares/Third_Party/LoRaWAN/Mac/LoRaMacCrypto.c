@@ -56,6 +56,13 @@
  */
 #define FCNT_DOWN_INITAL_VALUE          0xFFFFFFFF
 
+/*
+ * The frame counters are only flagged for storage when they enter a new
+ * block of this many frames, instead of on every frame. The gap is added
+ * back when the context is restored, so that no counter is used twice.
+ */
+#define CRYPTO_NVM_FCNT_GAP             32
+
 /*
  * Frame direction definition for uplink communications
  */
@@ -866,6 +873,41 @@ static bool CheckFCntDown( FCntIdentifier_t fCntID, uint32_t currentDown )
     }
 }
 
+/*
+ * Checks if a frame counter enters a new block of CRYPTO_NVM_FCNT_GAP frames
+ *
+ * \param[IN]     lastFCnt     - Frame counter value stored in the context
+ * \param[IN]     fCnt         - New frame counter value
+ *
+ * \retval                     - True if the context has to be stored
+ */
+static bool IsFCntGapCrossed( uint32_t lastFCnt, uint32_t fCnt )
+{
+    return ( lastFCnt / CRYPTO_NVM_FCNT_GAP ) != ( fCnt / CRYPTO_NVM_FCNT_GAP );
+}
+
+/*
+ * Adds the storage gap to a restored frame counter, as it may have been
+ * used up to the end of its block before the reset
+ *
+ * \param[IN]     fCnt         - Restored frame counter value
+ *
+ * \retval                     - Frame counter value to resume from
+ */
+static uint32_t AddFCntGap( uint32_t fCnt )
+{
+    if( fCnt == FCNT_DOWN_INITAL_VALUE )
+    {
+        // No downlink received yet
+        return fCnt;
+    }
+    if( fCnt >= ( FCNT_DOWN_INITAL_VALUE - CRYPTO_NVM_FCNT_GAP ) )
+    {
+        return FCNT_DOWN_INITAL_VALUE - 1;
+    }
+    return fCnt + CRYPTO_NVM_FCNT_GAP;
+}
+
 /*!
  * Updates the reference downlink counter
  *
@@ -876,33 +918,39 @@ static bool CheckFCntDown( FCntIdentifier_t fCntID, uint32_t currentDown )
  */
 static void UpdateFCntDown( FCntIdentifier_t fCntID, uint32_t currentDown )
 {
+    uint32_t* fCnt;
+
     switch( fCntID )
     {
         case N_FCNT_DOWN:
-            CryptoCtx.NvmCtx->FCntList.NFCntDown = currentDown;
+            fCnt = &CryptoCtx.NvmCtx->FCntList.NFCntDown;
             break;
         case A_FCNT_DOWN:
-            CryptoCtx.NvmCtx->FCntList.AFCntDown = currentDown;
+            fCnt = &CryptoCtx.NvmCtx->FCntList.AFCntDown;
             break;
         case FCNT_DOWN:
-            CryptoCtx.NvmCtx->FCntList.FCntDown = currentDown;
+            fCnt = &CryptoCtx.NvmCtx->FCntList.FCntDown;
             break;
         case MC_FCNT_DOWN_0:
-            CryptoCtx.NvmCtx->FCntList.McFCntDown0 = currentDown;
+            fCnt = &CryptoCtx.NvmCtx->FCntList.McFCntDown0;
             break;
         case MC_FCNT_DOWN_1:
-            CryptoCtx.NvmCtx->FCntList.McFCntDown1 = currentDown;
+            fCnt = &CryptoCtx.NvmCtx->FCntList.McFCntDown1;
             break;
         case MC_FCNT_DOWN_2:
-            CryptoCtx.NvmCtx->FCntList.McFCntDown2 = currentDown;
+            fCnt = &CryptoCtx.NvmCtx->FCntList.McFCntDown2;
             break;
         case MC_FCNT_DOWN_3:
-            CryptoCtx.NvmCtx->FCntList.McFCntDown3 = currentDown;
+            fCnt = &CryptoCtx.NvmCtx->FCntList.McFCntDown3;
             break;
         default:
-            break;
+            return;
     }
-    CryptoCtx.EventCryptoNvmCtxChanged( );
+    if( IsFCntGapCrossed( *fCnt, currentDown ) == true )
+    {
+        CryptoCtx.EventCryptoNvmCtxChanged( );
+    }
+    *fCnt = currentDown;
 }
 
 /*!
@@ -979,6 +1027,18 @@ LoRaMacCryptoStatus_t LoRaMacCryptoRestoreNvmCtx( void* cryptoNvmCtx )
     if( cryptoNvmCtx != 0 )
     {
         memcpy1( ( uint8_t* ) &NvmCryptoCtx, ( uint8_t* ) cryptoNvmCtx, CRYPTO_NVM_CTX_SIZE );
+
+        // The counters are stored once per block, resume past the block
+        NvmCryptoCtx.FCntList.FCntUp = AddFCntGap( NvmCryptoCtx.FCntList.FCntUp );
+        NvmCryptoCtx.FCntList.NFCntDown = AddFCntGap( NvmCryptoCtx.FCntList.NFCntDown );
+        NvmCryptoCtx.FCntList.AFCntDown = AddFCntGap( NvmCryptoCtx.FCntList.AFCntDown );
+        NvmCryptoCtx.FCntList.FCntDown = AddFCntGap( NvmCryptoCtx.FCntList.FCntDown );
+        NvmCryptoCtx.FCntList.McFCntDown0 = AddFCntGap( NvmCryptoCtx.FCntList.McFCntDown0 );
+        NvmCryptoCtx.FCntList.McFCntDown1 = AddFCntGap( NvmCryptoCtx.FCntList.McFCntDown1 );
+        NvmCryptoCtx.FCntList.McFCntDown2 = AddFCntGap( NvmCryptoCtx.FCntList.McFCntDown2 );
+        NvmCryptoCtx.FCntList.McFCntDown3 = AddFCntGap( NvmCryptoCtx.FCntList.McFCntDown3 );
+        // The resumed counters must be stored before they reach the next block
+        CryptoCtx.EventCryptoNvmCtxChanged( );
         return LORAMAC_CRYPTO_SUCCESS;
     }
     else
@@ -1475,8 +1535,11 @@ LoRaMacCryptoStatus_t LoRaMacCryptoSecureMessage( uint32_t fCntUp, uint8_t txDr,
         }
 #endif
     }
+    if( IsFCntGapCrossed( CryptoCtx.NvmCtx->FCntList.FCntUp, fCntUp ) == true )
+    {
+        CryptoCtx.EventCryptoNvmCtxChanged( );
+    }
     CryptoCtx.NvmCtx->FCntList.FCntUp = fCntUp;
-    CryptoCtx.EventCryptoNvmCtxChanged( );
 
     // Serialize message
     if( LoRaMacSerializerData( macMsg ) != LORAMAC_SERIALIZER_SUCCESS )
@@ -22,6 +22,7 @@
  */
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 #include "utilities.h"
 #include "FragDecoder.h"
 #include "storage.h"
@@ -50,26 +51,197 @@
  *=============================================================================
  */
 
-typedef struct
-{
-#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-    FragDecoderCallbacks_t *Callbacks;
+/*!
+ * Number of 32 bits words needed to store a bit array of `bits` elements
+ */
+#define FRAG_BIT_ARRAY_WORDS( bits )                ( ( ( bits ) + 31 ) >> 5 )
+
+/*!
+ * Rounds a size up to a multiple of 4 bytes, every array of the arena is
+ * 32 bits aligned
+ */
+#define FRAG_ALIGN( size )                          ( ( ( size ) + 3 ) & ~3UL )
+
+/*!
+ * Arena bytes of a parity row entry of a file of `fragNb` fragments. The
+ * row draws fragNb / 2 columns
+ */
+#define FRAG_PARITY_ROW_SIZE( fragNb )              FRAG_ALIGN( sizeof( FragParityRow_t ) + ( ( ( fragNb ) >> 1 ) * sizeof( uint16_t ) ) )
+
+/*!
+ * Parity row entry of the coded fragment n of the current session
+ */
+#define FRAG_PARITY_ROW( n )                        ( ( FragParityRow_t* )( FragDecoder->ParityRows + \
+                                                      ( ( ( n ) % FRAG_PARITY_ROW_CACHE_NB ) * FRAG_PARITY_ROW_SIZE( FragDecoder->FragNb ) ) ) )
+
+/*!
+ * Row i of the MatrixM2B of the current session
+ */
+#define FRAG_M2B_ROW( i )                           ( FragDecoder->MatrixM2B + ( ( i ) * FragDecoder->M2BWords ) )
+
+/*!
+ * Number of uint16_t arrays of M2BSize entries in the arena
+ */
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+#define FRAG_LOST_INDEX_ARRAYS                      3   // FragMissingIndex, LogN and LogOfM2BRow
 #else
-    uint8_t *File;
-    uint32_t FileSize;
+#define FRAG_LOST_INDEX_ARRAYS                      1   // FragMissingIndex
 #endif
+
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 ) && ( FRAG_DECODER_FILE_HANDLING_NEW_API == 0 )
+#error "FRAG_DECODER_DEFERRED_SOLVE requires FRAG_DECODER_FILE_HANDLING_NEW_API"
+#endif
+
+/*!
+ * Parity matrix row of a coded fragment, stored as the list of its set columns
+ */
+typedef struct
+{
+    /*!
+     * Coded fragment number the row belongs to. 0 when the entry is empty
+     */
+    uint16_t N;
+    /*!
+     * Number of valid entries in Coeff
+     */
+    uint16_t NbCoeff;
+    /*!
+     * Indexes of the set columns, without duplicates
+     */
+    uint16_t Coeff[];
+}FragParityRow_t;
+
+/*!
+ * Decoder state. The fields up to Arena are the header of the session state,
+ * the arrays follow it in the arena of the session:
+ *
+ * | header | FragMissing | MatrixM2B | S | Vector | FragMissingIndex | LogN | LogOfM2BRow | .. | FragMissingRank | ParityRows | ParityRowMask |
+ *
+ * FragDecoderGetNvmCtx saves the arena up to LogOfM2BRow, the arrays at the
+ * end of the arena are rebuilt on demand. The arrays sized on the lost
+ * fragments are laid out at the first coded fragment, once they are known
+ */
+typedef struct
+{
     uint16_t FragNb;
     uint8_t FragSize;
+    /*!
+     * Start of the storage region of the session, added to the addresses
+     * given to the callbacks
+     */
+    uint32_t StorageOffset;
+    /*!
+     * Lost fragments the arena and the storage can decode the session with
+     */
+    uint16_t MaxLost;
+    /*!
+     * Lost fragments the arrays of the system were laid out for, 0 until the
+     * first coded fragment
+     */
+    uint16_t M2BSize;
 
     uint32_t M2BLine;
-    uint8_t MatrixM2B[( ( FRAG_MAX_REDUNDANCY >> 3 ) + 1 ) * FRAG_MAX_REDUNDANCY];
-    uint16_t FragNbMissingIndex[FRAG_MAX_NB];
 
-    uint8_t S[( FRAG_MAX_REDUNDANCY >> 3 ) + 1];
+    /*!
+     * Last received coded fragment number
+     */
+    uint16_t LastCodedN;
+
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    /*!
+     * Number of log entries, dropped ones included
+     */
+    uint16_t LogNb;
+    /*!
+     * Set once the system can be solved, until FragDecoderSolve rebuilt the
+     * missing rows
+     */
+    bool IsSolvePending;
+#endif
+
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+    /*!
+     * Set once the FragDecoderWrite callback failed, the session is then
+     * finished with a matrix error
+     */
+    bool IsWriteFailed;
+#endif
 
     FragDecoderStatus_t Status;
+
+    /*!
+     * Arena of the session, NULL until the session is set up
+     */
+    uint8_t *Arena;
+    /*!
+     * Size of the saved part of the arena
+     */
+    uint32_t NvmCtxSize;
+    /*!
+     * Number of words of a MatrixM2B row and of the S and Vector bit arrays
+     */
+    uint16_t M2BWords;
+    /*!
+     * Bit i is set when the uncoded fragment i has not been received while a
+     * later one has. A late fragment clears its bit
+     */
+    uint32_t *FragMissing;
+    /*!
+     * Upper triangular matrix of the lost fragments system. Row i holds the
+     * reduced equation whose first one is at column i, packed in 32 bits words
+     */
+    uint32_t *MatrixM2B;
+    /*!
+     * Bit i is set when MatrixM2B row i holds a valid equation
+     */
+    uint32_t *S;
+    /*!
+     * Scratch bit array a coded fragment equation is reduced in
+     */
+    uint32_t *Vector;
+    /*!
+     * Fragment index of the x th lost fragment
+     */
+    uint16_t *FragMissingIndex;
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    /*!
+     * Fragment N of the x th coded fragment stored in the log. Only the
+     * fragments which brought a new equation are logged. 0 when the entry
+     * was dropped as a late uncoded fragment made its equation redundant
+     */
+    uint16_t *LogN;
+    /*!
+     * Log entry which produced the MatrixM2B row i
+     */
+    uint16_t *LogOfM2BRow;
+#endif
+    /*!
+     * Number of lost fragments before the first one of each FragMissing word
+     */
+    uint16_t *FragMissingRank;
+    /*!
+     * Parity rows of the last and next expected coded fragments
+     */
+    uint8_t *ParityRows;
+    /*!
+     * Scratch bit array used to drop duplicated columns while a row is generated.
+     * Always all zeros outside of FragGetParityMatrixRow
+     */
+    uint32_t *ParityRowMask;
+
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+    FragDecoderCallbacks_t *Callbacks;
+#else
+    uint8_t *File;
+    uint32_t FileSize;
+#endif
 }FragDecoder_t;
 
+/*!
+ * Size of the header of the session state, at the start of the arena
+ */
+#define FRAG_DECODER_NVM_HEADER_SIZE                FRAG_ALIGN( offsetof( FragDecoder_t, Arena ) )
+
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
 /*!
  * \brief Sets a row from source into file destination
@@ -112,6 +284,29 @@ static void GetRow( uint8_t *src, uint16_t row, uint16_t size );
 static void GetRow( uint8_t *dst, uint8_t *src, uint16_t row, uint16_t size );
 #endif
 
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+/*!
+ * \brief Reconstructs the missing rows from the coded fragments log.
+ *
+ *        The log is replayed in arrival order so that every entry is reduced
+ *        against the same MatrixM2B rows as when it was received. The reduced
+ *        rows are stored after the log, then the back substitution writes
+ *        every missing row once.
+ *
+ * \param [IN] acc  Scratch buffer of FragDecoder->FragSize bytes
+ * \param [IN] tmp  Scratch buffer of FragDecoder->FragSize bytes
+ */
+static void FragSolveFromLog( uint8_t *acc, uint8_t *tmp );
+
+/*!
+ * \brief Builds MatrixM2B again from the coded fragments log, once the set
+ *        of missing fragments changed. The entries are reduced in log order,
+ *        as on reception, and the ones which don't bring a new equation any
+ *        more are dropped. Their storage row is not reused
+ */
+static void FragRebuildFromLog( void );
+#endif
+
 /*!
  * \brief Gets the parity value from a given row of the parity matrix
  *
@@ -120,16 +315,25 @@ static void GetRow( uint8_t *dst, uint8_t *src, uint16_t row, uint16_t size );
  *
  * \retval parity         Parity value at the given index
  */
-static uint8_t GetParity( uint16_t index, uint8_t *matrixRow  );
+static uint8_t GetParity( uint16_t index, uint32_t *matrixRow );
 
 /*!
- * \brief Sets the parity value on the given row of the parity matrix
+ * \brief Sets the parity value to 1 on the given row of the parity matrix
  *
  * \param [IN]     index     The index of the row to be computed
  * \param [IN/OUT] matrixRow Pointer to the parity matrix.
- * \param [IN]     parity    The parity value to be set in the parity matrix
  */
-static void SetParity( uint16_t index, uint8_t *matrixRow, uint8_t parity );
+static void SetParity( uint16_t index, uint32_t *matrixRow );
+
+/*!
+ * \brief Counts the trailing zeros of a word, which is the index of its
+ *        lowest bit set to one
+ *
+ * \param [IN] x  Word to be tested. Must not be 0
+ *
+ * \retval index  Index of the first 1 in the word
+ */
+static uint32_t BitCtz( uint32_t x );
 
 /*!
  * \brief Check if the provided value is a power of 2
@@ -156,11 +360,11 @@ static void XorDataLine( uint8_t *line1, uint8_t *line2, int32_t size );
  *
  * \param [IN]  line1  1st Parity line to be XORed
  * \param [IN]  line2  2nd Parity line to be XORed
- * \param [IN]  size   Number of elements in line1
+ * \param [IN]  words  Number of 32 bits words in line1
  *
  * \param [OUT] result XOR( line1, line2 ) result stored in line1
  */
-static void XorParityLine( uint8_t* line1, uint8_t* line2, int32_t size );
+static void XorParityLine( uint32_t* line1, uint32_t* line2, int32_t words );
 
 /*!
  * \brief Generates a pseudo random number : PRBS23
@@ -176,36 +380,124 @@ static int32_t FragPrbs23( int32_t value );
  *
  * \param [IN]  n         Fragment N
  * \param [IN]  m         Fragment number
- * \param [OUT] matrixRow Parity matrix
+ * \param [OUT] matrixRow Parity matrix row as a list of set columns
  */
-static void FragGetParityMatrixRow( int32_t n, int32_t m, uint8_t *matrixRow );
+static void FragGetParityMatrixRow( int32_t n, int32_t m, FragParityRow_t *matrixRow );
+
+/*!
+ * \brief Gets the parity matrix row of a coded fragment, generating it if it
+ *        isn't already available in FragDecoder->ParityRows
+ *
+ * \param [IN] n  Fragment N
+ *
+ * \retval row    Parity matrix row
+ */
+static FragParityRow_t* FragGetParityRow( uint16_t n );
 
 /*!
  * \brief Finds the index of the first one in a bit array
  *
  * \param [IN] bitArray Pointer to the bit array
- * \param [IN] size     Bit array size
+ * \param [IN] words    Bit array size in 32 bits words
  * \retval index        The index of the first 1 in the bit array
  */
-static uint16_t BitArrayFindFirstOne( uint8_t *bitArray, uint16_t size );
+static uint16_t BitArrayFindFirstOne( uint32_t *bitArray, uint16_t words );
 
 /*!
  * \brief Checks if the provided bit array only contains zeros
  *
  * \param [IN] bitArray Pointer to the bit array
- * \param [IN] size     Bit array size
+ * \param [IN] words    Bit array size in 32 bits words
  * \retval isAllZeros   [0: Contains ones, 1: Contains all zeros]
  */
-static uint8_t BitArrayIsAllZeros( uint8_t *bitArray, uint16_t  size );
+static uint8_t BitArrayIsAllZeros( uint32_t *bitArray, uint16_t words );
+
+/*!
+ * \brief Counts the bits set to one in a word
+ *
+ * \param [IN] x  Word to be tested
+ *
+ * \retval count  Number of 1 in the word
+ */
+static uint32_t BitPopCount( uint32_t x );
 
 /*!
  * \brief Finds & marks missing fragments
  *
  * \param [IN]  counter Current fragment counter
- * \param [OUT] FragDecoder.FragNbMissingIndex[] array is updated in place
+ * \param [OUT] FragDecoder->FragMissing[] map is updated in place
  */
 static void FragFindMissingFrags( uint16_t counter );
 
+/*!
+ * \brief Gets the arena bytes of the arrays of a session sized on its
+ *        number of fragments
+ *
+ * \param [IN] fragNb Number of fragments
+ *
+ * \retval size       Size in bytes, header included
+ */
+static uint32_t FragGetFixedSize( uint16_t fragNb );
+
+/*!
+ * \brief Gets the arena bytes of the arrays of a session sized on its
+ *        number of lost fragments
+ *
+ * \param [IN] lostNb Number of lost fragments
+ *
+ * \retval size       Size in bytes
+ */
+static uint32_t FragGetLostSize( uint16_t lostNb );
+
+/*!
+ * \brief Gets the size of the saved part of the arena of a session
+ *
+ * \param [IN] fragNb  Number of fragments
+ * \param [IN] m2bSize Number of lost fragments the system is laid out for
+ *
+ * \retval size        Size in bytes
+ */
+static uint32_t FragGetNvmCtxSize( uint16_t fragNb, uint16_t m2bSize );
+
+/*!
+ * \brief Sets the arrays of the session in its arena from FragNb and M2BSize
+ */
+static void FragLayout( void );
+
+/*!
+ * \brief Lays out the arrays of the lost fragments system, once the number
+ *        of lost fragments is known
+ */
+static void FragLayoutLost( void );
+
+/*!
+ * \brief Computes FragMissingRank and FragMissingIndex again from the
+ *        FragMissing map
+ */
+static void FragUpdateMissingRanks( void );
+
+/*!
+ * \brief Processes a fragment of the selected session
+ *
+ * \param [IN] fragCounter Fragment counter
+ * \param [IN] rawData     Fragment data
+ *
+ * \retval status          Process status, as FragDecoderProcess
+ */
+static int32_t FragProcessFrag( uint16_t fragCounter, uint8_t *rawData );
+
+/*!
+ * \brief Processes an uncoded fragment received after a later one. A
+ *        duplicate is dropped, a fragment counted as lost is stored and its
+ *        column removed from the lost fragments system
+ *
+ * \param [IN] index   Fragment index
+ * \param [IN] rawData Fragment data
+ *
+ * \retval status      Process status, as FragDecoderProcess
+ */
+static int32_t FragProcessLateFrag( uint16_t index, uint8_t *rawData );
+
 /*!
  * \brief Finds the index (frag counter) of the x th missing frag
  *
@@ -216,22 +508,43 @@ static void FragFindMissingFrags( uint16_t counter );
 static uint16_t FragFindMissingIndex( uint16_t x );
 
 /*!
- * \brief Extacts a row from the binary matrix and expands it to a bitArray
+ * \brief Gets the rank of a missing fragment amongst the missing fragments
  *
- * \param [IN] bitArray  Pointer to the bit array
- * \param [IN] rowIndex  Matrix row index
- * \param [IN] bitsInRow Number of bits in one row
+ * \param [IN] index Missing fragment index
+ *
+ * \retval x         The fragment is the x th missing frag
  */
-static void FragExtractLineFromBinaryMatrix( uint8_t* bitArray, uint16_t rowIndex, uint16_t bitsInRow );
+static uint16_t FragGetMissingRank( uint16_t index );
 
 /*!
- * \brief Collapses and Pushs a row of a bit array to the matrix
+ * \brief Pushes a row of a bit array to the matrix
  *
  * \param [IN] bitArray  Pointer to the bit array
  * \param [IN] rowIndex  Matrix row index
- * \param [IN] bitsInRow Number of bits in one row
  */
-static void FragPushLineToBinaryMatrix( uint8_t *bitArray, uint16_t rowIndex, uint16_t bitsInRow );
+static void FragPushLineToBinaryMatrix( uint32_t *bitArray, uint16_t rowIndex );
+
+/*!
+ * \brief Empties the parity row cache
+ */
+static void FragResetCaches( void );
+
+/*!
+ * \brief Selects the session the decoder functions work on
+ *
+ * \param [IN] decoderId Decoder session index
+ *
+ * \retval status        Returns false if the index is out of range
+ */
+static bool FragSelectSession( uint8_t decoderId );
+
+/*!
+ * \brief Generates the parity row of the next expected coded fragment of
+ *        the selected session, if it isn't available yet
+ *
+ * \retval status Returns true if a row was generated
+ */
+static bool FragPrefetchSession( void );
 
 /*
  *=============================================================================
@@ -239,258 +552,726 @@ static void FragPushLineToBinaryMatrix( uint8_t *bitArray, uint16_t rowIndex, ui
  *=============================================================================
  */
 
-static FragDecoder_t FragDecoder;
+static FragDecoder_t FragDecoders[FRAG_DECODER_MAX_SESSIONS];
 
-#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-void FragDecoderInit( uint16_t fragNb, uint8_t fragSize, FragDecoderCallbacks_t *callbacks )
+#if( FRAG_DECODER_MAX_SESSIONS > 1 )
+/*!
+ * Session the decoder functions work on, selected by the public functions
+ */
+static FragDecoder_t *FragDecoder = &FragDecoders[0];
 #else
-void FragDecoderInit( uint16_t fragNb, uint8_t fragSize, uint8_t *file, uint32_t fileSize )
+#define FragDecoder                                 ( &FragDecoders[0] )
 #endif
+
+/*!
+ * Arena set by FragDecoderSetArena, 32 bits aligned, shared evenly between
+ * the sessions
+ */
+static uint8_t *FragArena = NULL;
+static uint32_t FragArenaSessionSize = 0;
+
+void FragDecoderSetArena( void *arena, uint32_t size )
 {
+    uintptr_t start = FRAG_ALIGN( ( uintptr_t )arena );
+
+    if( ( arena == NULL ) || ( ( start - ( uintptr_t )arena ) >= size ) )
+    {
+        FragArena = NULL;
+        FragArenaSessionSize = 0;
+        return;
+    }
+    FragArena = ( uint8_t* )start;
+    FragArenaSessionSize = ( ( size - ( start - ( uintptr_t )arena ) ) / FRAG_DECODER_MAX_SESSIONS ) & ~3UL;
+}
+
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-    FragDecoder.Callbacks = callbacks;
+int32_t FragDecoderGetMaxLost( uint8_t decoderId, uint16_t fragNb, uint8_t fragSize, const FragDecoderRegion_t *region )
 #else
-    FragDecoder.File = file;
-    FragDecoder.FileSize = fileSize;
+int32_t FragDecoderGetMaxLost( uint8_t decoderId, uint16_t fragNb, uint8_t fragSize )
 #endif
-    FragDecoder.FragNb = fragNb;                                // FragNb = FRAG_MAX_SIZE
-    FragDecoder.FragSize = fragSize;                            // number of byte on a row
-    FragDecoder.Status.FragNbLastRx = 0;
-    FragDecoder.Status.FragNbLost = 0;
-    FragDecoder.M2BLine = 0;
+{
+    uint32_t budget;
+    int32_t maxLost = 0;
 
-    // Initialize missing fragments index array
-    for( uint16_t i = 0; i < FRAG_MAX_NB; i++ )
+    if( ( decoderId >= FRAG_DECODER_MAX_SESSIONS ) || ( FragArena == NULL ) ||
+        ( fragNb == 0 ) || ( fragSize == 0 ) || ( fragSize > FRAG_MAX_SIZE ) ||
+        ( FragGetFixedSize( fragNb ) > FragArenaSessionSize ) )
     {
-        FragDecoder.FragNbMissingIndex[i] = 1;
+        return -1;
     }
 
-    // Initialize parity matrix
-    for( uint32_t i = 0; i < ( ( FRAG_MAX_REDUNDANCY >> 3 ) + 1 ); i++ )
+    // The system can't have more unknowns than the file has fragments
+    budget = FragArenaSessionSize - FragGetFixedSize( fragNb );
+    while( ( maxLost < fragNb ) && ( FragGetLostSize( maxLost + 1 ) <= budget ) )
+    {
+        maxLost++;
+    }
+
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+#if( ACTILITY_LIBRARY == 1 ) && ( INTEROP_TEST_MODE == 0 )
+    if( decoderId == 0 )
+    {
+        // The datafile storage backs the first session
+        int32_t storageMaxLost = storage_datafile_max_lost( fragNb, fragSize );
+
+        if( storageMaxLost < maxLost )
+        {
+            maxLost = storageMaxLost;
+        }
+    }
+    else
+#endif
+    if( ( region != NULL ) && ( region->Size != 0 ) )
+    {
+        uint32_t rows = region->Size / fragSize;
+
+        if( rows < fragNb )
+        {
+            return -1;
+        }
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+        // The coded fragments log and the reduced rows follow the file rows
+        if( ( ( rows - fragNb ) / 2 ) < ( uint32_t )maxLost )
+        {
+            maxLost = ( rows - fragNb ) / 2;
+        }
+#endif
+    }
+#endif
+    return maxLost;
+}
+
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+void FragDecoderInit( uint8_t decoderId, uint16_t fragNb, uint8_t fragSize, FragDecoderCallbacks_t *callbacks,
+                      const FragDecoderRegion_t *region )
+#else
+void FragDecoderInit( uint8_t decoderId, uint16_t fragNb, uint8_t fragSize, uint8_t *file, uint32_t fileSize )
+#endif
+{
+    int32_t maxLost;
+
+    if( FragSelectSession( decoderId ) == false )
+    {
+        return;
+    }
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+    maxLost = FragDecoderGetMaxLost( decoderId, fragNb, fragSize, region );
+    FragDecoder->Callbacks = callbacks;
+    FragDecoder->StorageOffset = ( region != NULL ) ? region->Offset : 0;
+#else
+    maxLost = FragDecoderGetMaxLost( decoderId, fragNb, fragSize );
+    FragDecoder->File = file;
+    FragDecoder->FileSize = fileSize;
+#endif
+    if( maxLost < 0 )
     {
-        FragDecoder.S[i] = 0;
+        // Not enough memory, the fragments are not processed
+        FragDecoder->FragNb = 0;
+        FragDecoder->Arena = NULL;
+        return;
     }
+    FragDecoder->Arena = FragArena + ( decoderId * FragArenaSessionSize );
+    FragDecoder->MaxLost = maxLost;
+    FragDecoder->M2BSize = 0;
+    FragDecoder->FragNb = fragNb;                                // FragNb = FRAG_MAX_SIZE
+    FragDecoder->FragSize = fragSize;                            // number of byte on a row
+    FragDecoder->Status.FragNbRx = 0;
+    FragDecoder->Status.FragNbLastRx = 0;
+    FragDecoder->Status.FragNbLost = 0;
+    FragDecoder->Status.MatrixError = 0;
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+    FragDecoder->IsWriteFailed = false;
+#endif
+    FragDecoder->M2BLine = 0;
+    FragDecoder->LastCodedN = 0;
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    FragDecoder->LogNb = 0;
+    FragDecoder->IsSolvePending = false;
+#endif
 
-    for( uint32_t i = 0; i < ( ( ( FRAG_MAX_REDUNDANCY >> 3 ) + 1 ) * FRAG_MAX_REDUNDANCY ); i++ )
+    FragLayout( );
+    FragResetCaches( );
+
+    // Initialize missing fragments map
+    for( uint16_t i = 0; i < FRAG_BIT_ARRAY_WORDS( fragNb ); i++ )
     {
-       FragDecoder.MatrixM2B[i] = 0xFF;
+        FragDecoder->FragMissing[i] = 0;
     }
     
 #if( INTEROP_TEST_MODE == 1)
-    // Initialize final uncoded data buffer ( FRAG_MAX_NB * FRAG_MAX_SIZE )
+    // Initialize final uncoded data buffer ( FragNb * FragSize )
     for( uint32_t i = 0; i < ( fragNb * fragSize ); i++ )
     {
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-        if( ( FragDecoder.Callbacks != NULL ) && ( FragDecoder.Callbacks->FragDecoderWrite != NULL ) )
+        if( ( FragDecoder->Callbacks != NULL ) && ( FragDecoder->Callbacks->FragDecoderWrite != NULL ) )
         {
             /* TODO: This call should work with RAM and flash so len % 8 should be 0 */
-        	FragDecoder.Callbacks->FragDecoderWrite( i, ( uint8_t[] ){ 0xFF }, 1 );
+        	FragDecoder->Callbacks->FragDecoderWrite( i, ( uint8_t[] ){ 0xFF }, 1 );
         }
 #else
-        FragDecoder.File[i] = 0xFF;
+        FragDecoder->File[i] = 0xFF;
+#endif
+    }
+#else
+#if( ACTILITY_LIBRARY == 1)
+    // The datafile storage only backs the first session
+    if( decoderId == 0 )
+    {
+        storage_datafile_init( fragNb, fragSize );
+    }
+#endif /* ACTILITY_LIRARY */
+#endif
+
+    FragDecoder->Status.FragNbLost = 0;
+    FragDecoder->Status.FragNbLastRx = 0;
+}
+
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+void* FragDecoderGetNvmCtx( uint8_t decoderId, size_t* fragDecoderNvmCtxSize )
+{
+    if( FragSelectSession( decoderId ) == false )
+    {
+        *fragDecoderNvmCtxSize = 0;
+        return NULL;
+    }
+    if( FragDecoder->Arena == NULL )
+    {
+        // No session, the header alone tells it with a null FragNb
+        FragDecoder->FragNb = 0;
+        *fragDecoderNvmCtxSize = FRAG_DECODER_NVM_HEADER_SIZE;
+        return FragDecoder;
+    }
+    memcpy1( FragDecoder->Arena, ( uint8_t* )FragDecoder, offsetof( FragDecoder_t, Arena ) );
+    *fragDecoderNvmCtxSize = FragDecoder->NvmCtxSize;
+    return FragDecoder->Arena;
+}
+
+bool FragDecoderCheckNvmCtx( uint8_t decoderId, void* fragDecoderNvmCtx, size_t* fragDecoderNvmCtxSize )
+{
+    FragDecoder_t *ctx = ( FragDecoder_t* )fragDecoderNvmCtx;
+    uint32_t size;
+
+    if( ( decoderId >= FRAG_DECODER_MAX_SESSIONS ) || ( fragDecoderNvmCtx == NULL ) ||
+        ( *fragDecoderNvmCtxSize < FRAG_DECODER_NVM_HEADER_SIZE ) )
+    {
+        return false;
+    }
+    if( ctx->FragNb == 0 )
+    {
+        // The session was not set up
+        *fragDecoderNvmCtxSize = FRAG_DECODER_NVM_HEADER_SIZE;
+        return true;
+    }
+    if( ( FragArena == NULL ) || ( ctx->FragSize == 0 ) || ( ctx->FragSize > FRAG_MAX_SIZE ) ||
+        ( ctx->M2BSize > ctx->MaxLost ) || ( ctx->M2BLine > ctx->M2BSize ) ||
+        ( ctx->Status.FragNbLost > ctx->FragNb ) ||
+        ( ( FragGetFixedSize( ctx->FragNb ) + FragGetLostSize( ctx->MaxLost ) ) > FragArenaSessionSize ) )
+    {
+        return false;
+    }
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    if( ctx->LogNb > ctx->M2BSize )
+    {
+        return false;
+    }
+#endif
+    size = FragGetNvmCtxSize( ctx->FragNb, ctx->M2BSize );
+    if( *fragDecoderNvmCtxSize < size )
+    {
+        return false;
+    }
+    *fragDecoderNvmCtxSize = size;
+    return true;
+}
+
+bool FragDecoderRestoreNvmCtx( uint8_t decoderId, void* fragDecoderNvmCtx, size_t* fragDecoderNvmCtxSize,
+                               FragDecoderCallbacks_t *callbacks )
+{
+    uint8_t *arena;
+    uint32_t size;
+
+    if( ( FragDecoderCheckNvmCtx( decoderId, fragDecoderNvmCtx, fragDecoderNvmCtxSize ) == false ) ||
+        ( FragSelectSession( decoderId ) == false ) )
+    {
+        return false;
+    }
+    if( ( ( FragDecoder_t* )fragDecoderNvmCtx )->FragNb == 0 )
+    {
+        // The session was not set up
+        FragDecoder->FragNb = 0;
+        FragDecoder->Arena = NULL;
+        return true;
+    }
+    size = *fragDecoderNvmCtxSize;
+    // The storage is not initialized again, it still holds the received rows
+    arena = FragArena + ( decoderId * FragArenaSessionSize );
+    for( uint32_t i = 0; i < size; i++ )
+    {
+        arena[i] = ( ( uint8_t* )fragDecoderNvmCtx )[i];
+    }
+    memcpy1( ( uint8_t* )FragDecoder, arena, offsetof( FragDecoder_t, Arena ) );
+    FragDecoder->Arena = arena;
+    FragDecoder->Callbacks = callbacks;
+    FragLayout( );
+    FragUpdateMissingRanks( );
+    FragResetCaches( );
+    return true;
+}
+
+uint32_t FragDecoderGetStorageSize( uint16_t fragNb, uint8_t fragSize, uint16_t maxLost )
+{
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    // The coded fragments log and the reduced rows follow the file rows
+    return ( ( uint32_t )fragNb + ( 2 * ( uint32_t )maxLost ) ) * fragSize;
+#else
+    ( void )maxLost;
+    return ( uint32_t )fragNb * fragSize;
 #endif
+}
+#endif
+
+int32_t FragDecoderProcess( uint8_t decoderId, uint16_t fragCounter, uint8_t *rawData )
+{
+    int32_t status;
+
+    if( ( FragSelectSession( decoderId ) == false ) || ( FragDecoder->Arena == NULL ) )
+    {
+        return FRAG_SESSION_NOT_STARTED;
+    }
+    if( fragCounter == 0 )
+    {
+        // Counters start at 1, a frame with counter 0 holds no row of the file
+        return FRAG_SESSION_ONGOING;
+    }
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    if( FragDecoder->IsSolvePending == true )
+    {
+        // The system is complete, the fragments left are not needed
+        return FRAG_SESSION_ONGOING;
     }
-#else
-#if( ACTILITY_LIBRARY == 1)
-    storage_datafile_init();
-#endif /* ACTILITY_LIRARY */
 #endif
-
-    FragDecoder.Status.FragNbLost = 0;
-    FragDecoder.Status.FragNbLastRx = 0;
-}
-
+    status = FragProcessFrag( fragCounter, rawData );
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-uint32_t FragDecoderGetMaxFileSize( void )
-{
-    return FRAG_MAX_NB * FRAG_MAX_SIZE;
-}
+    if( FragDecoder->IsWriteFailed == true )
+    {
+        // A row missing from the storage can't be rebuilt
+        return FRAG_SESSION_FINISHED;
+    }
 #endif
+    return status;
+}
 
-int32_t FragDecoderProcess( uint16_t fragCounter, uint8_t *rawData )
+static int32_t FragProcessFrag( uint16_t fragCounter, uint8_t *rawData )
 {
     uint16_t firstOneInRow = 0;
     int32_t first = 0;
     int32_t noInfo = 0;
+    uint16_t lostWords;
+    uint16_t n;
 
-    uint8_t matrixRow[(FRAG_MAX_NB >> 3 ) + 1];
+    FragParityRow_t *matrixRow;
     uint8_t matrixDataTemp[FRAG_MAX_SIZE];
-    uint8_t dataTempVector[( FRAG_MAX_REDUNDANCY >> 3 ) + 1];
-    uint8_t dataTempVector2[( FRAG_MAX_REDUNDANCY >> 3 ) + 1];
+    uint32_t *dataTempVector;
 
-    memset1( matrixRow, 0, ( FRAG_MAX_NB >> 3 ) + 1 );
     memset1( matrixDataTemp, 0, FRAG_MAX_SIZE );
-    memset1( dataTempVector, 0, ( FRAG_MAX_REDUNDANCY >> 3 ) + 1 );
-    memset1( dataTempVector2, 0, ( FRAG_MAX_REDUNDANCY >> 3 ) + 1 );
 
-    FragDecoder.Status.FragNbRx = fragCounter;
+    if( fragCounter > FragDecoder->Status.FragNbRx )
+    {
+        FragDecoder->Status.FragNbRx = fragCounter;
+    }
 
-    if( fragCounter < FragDecoder.Status.FragNbLastRx )
+    if( ( fragCounter <= FragDecoder->FragNb ) && ( fragCounter <= FragDecoder->Status.FragNbLastRx ) )
     {
-        return FRAG_SESSION_ONGOING;  // Drop frame out of order
+        // Out of order or duplicated uncoded fragment
+        return FragProcessLateFrag( fragCounter - 1, rawData );
     }
 
     // The M (FragNb) first packets aren't encoded or in other words they are
     // encoded with the unitary matrix
-    if( fragCounter <= FragDecoder.FragNb )
+    if( fragCounter <= FragDecoder->FragNb )
     {
         // The M first frame are not encoded store them
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-        SetRow( rawData, fragCounter - 1, FragDecoder.FragSize );
+        SetRow( rawData, fragCounter - 1, FragDecoder->FragSize );
 #else
-        SetRow( FragDecoder.File, rawData, fragCounter - 1, FragDecoder.FragSize );
+        SetRow( FragDecoder->File, rawData, fragCounter - 1, FragDecoder->FragSize );
 #endif
 
-        FragDecoder.FragNbMissingIndex[fragCounter - 1] = 0;
-
-        // Update the FragDecoder.FragNbMissingIndex with the loosing frame
+        // Update the FragDecoder->FragMissing with the loosing frame
         FragFindMissingFrags( fragCounter );
-        if( fragCounter == FragDecoder.FragNb && FragDecoder.Status.FragNbLost == 0 )
+        if( fragCounter == FragDecoder->FragNb && FragDecoder->Status.FragNbLost == 0 )
         {
             // the case : all the M(FragNb) first rows have been transmitted with no error
-            return FragDecoder.Status.FragNbLost;
+            return FragDecoder->Status.FragNbLost;
         }
     }
     else
     {
-        if( FragDecoder.Status.FragNbLost > FRAG_MAX_REDUNDANCY )
+        if( FragDecoder->Status.FragNbLastRx <= FragDecoder->FragNb )
+        {
+            // In case of the end of true data is missing
+            FragFindMissingFrags( fragCounter );
+            // At this point we receive encoded frames and the number of
+            // loosing frames is well known, the system is sized on it
+            if( FragDecoder->Status.FragNbLost <= FragDecoder->MaxLost )
+            {
+                FragLayoutLost( );
+            }
+        }
+        if( FragDecoder->Status.FragNbLost > FragDecoder->MaxLost )
         {
-           FragDecoder.Status.MatrixError = 1;
+           FragDecoder->Status.MatrixError = 1;
            return FRAG_SESSION_FINISHED;
         }
-        // At this point we receive encoded frames and the number of loosing frames
-        // is well known: FragDecoder.FragNbLost - 1;
-
-        // In case of the end of true data is missing
-        FragFindMissingFrags( fragCounter );
+        lostWords = FRAG_BIT_ARRAY_WORDS( FragDecoder->Status.FragNbLost );
+        dataTempVector = FragDecoder->Vector;
+        for( uint16_t i = 0; i < FragDecoder->M2BWords; i++ )
+        {
+            dataTempVector[i] = 0;
+        }
 
-        // fragCounter - FragDecoder.FragNb
-        FragGetParityMatrixRow( fragCounter - FragDecoder.FragNb, FragDecoder.FragNb, matrixRow );
+        // fragCounter - FragDecoder->FragNb
+        n = fragCounter - FragDecoder->FragNb;
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+        for( uint16_t k = 0; k < FragDecoder->LogNb; k++ )
+        {
+            if( FragDecoder->LogN[k] == n )
+            {
+                return FRAG_SESSION_ONGOING;  // Duplicate of a logged fragment
+            }
+        }
+#endif
+        // Coded fragments may come out of order, the next ones expected
+        // follow the last one
+        if( n > FragDecoder->LastCodedN )
+        {
+            FragDecoder->LastCodedN = n;
+        }
+        matrixRow = FragGetParityRow( n );
 
-        for( int32_t i = 0; i < FragDecoder.FragNb; i++ )
+        for( int32_t k = 0; k < matrixRow->NbCoeff; k++ )
         {
-            if( GetParity( i , matrixRow ) == 1 )
+            int32_t i = matrixRow->Coeff[k];
+
+            if( GetParity( i, FragDecoder->FragMissing ) == 0 )
             {
-                if( FragDecoder.FragNbMissingIndex[i] == 0 )
-                {
-                    // XOR with already receive frag
-                    SetParity( i, matrixRow, 0 );
+#if( FRAG_DECODER_DEFERRED_SOLVE == 0 )
+                // XOR with already receive frag
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                    GetRow( matrixDataTemp, i, FragDecoder.FragSize );
+                GetRow( matrixDataTemp, i, FragDecoder->FragSize );
 #else
-                    GetRow( matrixDataTemp, FragDecoder.File, i, FragDecoder.FragSize );
+                GetRow( matrixDataTemp, FragDecoder->File, i, FragDecoder->FragSize );
 #endif
-                    XorDataLine( rawData, matrixDataTemp, FragDecoder.FragSize );
-                }
-                else
+                XorDataLine( rawData, matrixDataTemp, FragDecoder->FragSize );
+#endif
+            }
+            else
+            {
+                // Fill the "little" boolean matrix m2b
+                SetParity( FragGetMissingRank( i ), dataTempVector );
+                if( first == 0 )
                 {
-                    // Fill the "little" boolean matrix m2b
-                    SetParity( FragDecoder.FragNbMissingIndex[i] - 1, dataTempVector, 1 );
-                    if( first == 0 )
-                    {
-                        first = 1;
-                    }
+                    first = 1;
                 }
             }
         }
 
-        firstOneInRow = BitArrayFindFirstOne( dataTempVector, FragDecoder.Status.FragNbLost );
+        firstOneInRow = BitArrayFindFirstOne( dataTempVector, lostWords );
 
         if( first > 0 )
         {
+#if( FRAG_DECODER_DEFERRED_SOLVE == 0 )
             int32_t li;
             int32_t lj;
+#endif
 
             // Manage a new line in MatrixM2B
-            while( GetParity( firstOneInRow, FragDecoder.S ) == 1 )
-            { 
-                // Row already diagonalized exist & ( FragDecoder.MatrixM2B[firstOneInRow][0] )
-                FragExtractLineFromBinaryMatrix( dataTempVector2, firstOneInRow, FragDecoder.Status.FragNbLost );
-                XorParityLine( dataTempVector, dataTempVector2, FragDecoder.Status.FragNbLost );
+            while( GetParity( firstOneInRow, FragDecoder->S ) == 1 )
+            {
+                // Row already diagonalized exist & ( FragDecoder->MatrixM2B[firstOneInRow][0] )
+                XorParityLine( dataTempVector, FRAG_M2B_ROW( firstOneInRow ), lostWords );
+#if( FRAG_DECODER_DEFERRED_SOLVE == 0 )
                 // Have to store it in the mi th position of the missing frag
                 li = FragFindMissingIndex( firstOneInRow );
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                GetRow( matrixDataTemp, li, FragDecoder.FragSize );
+                GetRow( matrixDataTemp, li, FragDecoder->FragSize );
 #else
-                GetRow( matrixDataTemp, FragDecoder.File, li, FragDecoder.FragSize );
+                GetRow( matrixDataTemp, FragDecoder->File, li, FragDecoder->FragSize );
 #endif
-                XorDataLine( rawData, matrixDataTemp, FragDecoder.FragSize );
-                if( BitArrayIsAllZeros( dataTempVector, FragDecoder.Status.FragNbLost ) )
+                XorDataLine( rawData, matrixDataTemp, FragDecoder->FragSize );
+#endif
+                if( BitArrayIsAllZeros( dataTempVector, lostWords ) )
                 {
                     noInfo = 1;
                     break;
                 }
-                firstOneInRow = BitArrayFindFirstOne( dataTempVector, FragDecoder.Status.FragNbLost );
+                firstOneInRow = BitArrayFindFirstOne( dataTempVector, lostWords );
+            }
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+            if( FragDecoder->LogNb == FragDecoder->M2BSize )
+            {
+                // No room left in the log, which only happens once late
+                // uncoded fragments made some entries redundant
+                noInfo = 1;
             }
+#endif
 
             if( noInfo == 0 )
             {
-                FragPushLineToBinaryMatrix( dataTempVector, firstOneInRow, FragDecoder.Status.FragNbLost );
+                FragPushLineToBinaryMatrix( dataTempVector, firstOneInRow );
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+                // Append the fragment as received, right after the file rows
+                FragDecoder->LogN[FragDecoder->LogNb] = n;
+                FragDecoder->LogOfM2BRow[firstOneInRow] = FragDecoder->LogNb;
+                SetRow( rawData, FragDecoder->FragNb + FragDecoder->LogNb, FragDecoder->FragSize );
+                FragDecoder->LogNb++;
+#elif( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
                 li = FragFindMissingIndex( firstOneInRow );
-#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                SetRow( rawData, li, FragDecoder.FragSize );
+                SetRow( rawData, li, FragDecoder->FragSize );
 #else
-                SetRow( FragDecoder.File, rawData, li, FragDecoder.FragSize );
+                li = FragFindMissingIndex( firstOneInRow );
+                SetRow( FragDecoder->File, rawData, li, FragDecoder->FragSize );
 #endif
-                SetParity( firstOneInRow, FragDecoder.S, 1 );
-                FragDecoder.M2BLine++;
+                SetParity( firstOneInRow, FragDecoder->S );
+                FragDecoder->M2BLine++;
             }
 
-            if( FragDecoder.M2BLine == FragDecoder.Status.FragNbLost )
-            { 
+            if( FragDecoder->M2BLine == FragDecoder->Status.FragNbLost )
+            {
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+                // Left to FragDecoderSolve, out of the radio event context
+                FragDecoder->IsSolvePending = true;
+                return FRAG_SESSION_ONGOING;
+#else
                 // Then last step diagonalized
-                if( FragDecoder.Status.FragNbLost > 1 )
+                if( FragDecoder->Status.FragNbLost > 1 )
                 {
-                    int32_t i, j;
+                    int32_t i;
 
-                    for( i = ( FragDecoder.Status.FragNbLost - 2 ); i >= 0 ; i-- )
+                    for( i = ( FragDecoder->Status.FragNbLost - 2 ); i >= 0 ; i-- )
                     {
                         li = FragFindMissingIndex( i );
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                        GetRow( matrixDataTemp, li, FragDecoder.FragSize );
+                        GetRow( matrixDataTemp, li, FragDecoder->FragSize );
 #else
-                        GetRow( matrixDataTemp, FragDecoder.File, li, FragDecoder.FragSize );
+                        GetRow( matrixDataTemp, FragDecoder->File, li, FragDecoder->FragSize );
 #endif
-                        for( j = ( FragDecoder.Status.FragNbLost - 1 ); j > i; j--)
+                        // Rows above i are already solved: XOR every one of
+                        // them which is set in the row i of the matrix
+                        for( int32_t w = ( i + 1 ) >> 5; w < lostWords; w++ )
                         {
-                            FragExtractLineFromBinaryMatrix( dataTempVector2, i, FragDecoder.Status.FragNbLost );
-                            FragExtractLineFromBinaryMatrix( dataTempVector, j, FragDecoder.Status.FragNbLost );
-                            if( GetParity( j, dataTempVector2 ) == 1 )
-                            {
-                                XorParityLine( dataTempVector2, dataTempVector, FragDecoder.Status.FragNbLost );
-
-                                lj = FragFindMissingIndex( j );
+                            uint32_t bits = FRAG_M2B_ROW( i )[w];
 
+                            if( w == ( ( i + 1 ) >> 5 ) )
+                            {
+                                bits &= ~( ( 1UL << ( ( i + 1 ) & 0x1F ) ) - 1 );
+                            }
+                            while( bits != 0 )
+                            {
+                                lj = FragFindMissingIndex( ( w << 5 ) + BitCtz( bits ) );
+                                bits &= bits - 1;
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                                GetRow( rawData, lj, FragDecoder.FragSize );
+                                GetRow( rawData, lj, FragDecoder->FragSize );
 #else
-                                GetRow( rawData, FragDecoder.File, lj, FragDecoder.FragSize );
+                                GetRow( rawData, FragDecoder->File, lj, FragDecoder->FragSize );
 #endif
-                                XorDataLine( matrixDataTemp , rawData , FragDecoder.FragSize );
+                                XorDataLine( matrixDataTemp , rawData , FragDecoder->FragSize );
                             }
                         }
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                        SetRow( matrixDataTemp, li, FragDecoder.FragSize );
+                        SetRow( matrixDataTemp, li, FragDecoder->FragSize );
 #else
-                        SetRow( FragDecoder.File, matrixDataTemp, li, FragDecoder.FragSize );
+                        SetRow( FragDecoder->File, matrixDataTemp, li, FragDecoder->FragSize );
 #endif
                     }
-                    return FragDecoder.Status.FragNbLost;
-                }
-                else
-                { 
-                    //If not ( FragDecoder.FragNbLost > 1 )
-                    return FragDecoder.Status.FragNbLost;
                 }
+                return FragDecoder->Status.FragNbLost;
+#endif
+            }
+        }
+    }
+    return FRAG_SESSION_ONGOING;
+}
+
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+static void FragSolveFromLog( uint8_t *acc, uint8_t *tmp )
+{
+    uint16_t lostWords = FRAG_BIT_ARRAY_WORDS( FragDecoder->Status.FragNbLost );
+    // Reduced rows are stored after the log, indexed by log entry
+    uint16_t reducedRows = FragDecoder->FragNb + FragDecoder->LogNb;
+    uint32_t *vector = FragDecoder->Vector;
+    FragParityRow_t *matrixRow;
+    uint16_t firstOneInRow;
+
+    for( uint16_t k = 0; k < FragDecoder->LogNb; k++ )
+    {
+        if( FragDecoder->LogN[k] == 0 )
+        {
+            continue;
+        }
+        memset1( ( uint8_t* )vector, 0, FragDecoder->M2BWords * sizeof( uint32_t ) );
+        GetRow( acc, FragDecoder->FragNb + k, FragDecoder->FragSize );
+
+        matrixRow = FragGetParityRow( FragDecoder->LogN[k] );
+        for( int32_t j = 0; j < matrixRow->NbCoeff; j++ )
+        {
+            int32_t i = matrixRow->Coeff[j];
+
+            if( GetParity( i, FragDecoder->FragMissing ) == 0 )
+            {
+                GetRow( tmp, i, FragDecoder->FragSize );
+                XorDataLine( acc, tmp, FragDecoder->FragSize );
+            }
+            else
+            {
+                SetParity( FragGetMissingRank( i ), vector );
+            }
+        }
+
+        // Same reduction as on reception: only the rows pushed by the
+        // previous log entries were available at that time
+        firstOneInRow = BitArrayFindFirstOne( vector, lostWords );
+        while( FragDecoder->LogOfM2BRow[firstOneInRow] != k )
+        {
+            XorParityLine( vector, FRAG_M2B_ROW( firstOneInRow ), lostWords );
+            GetRow( tmp, reducedRows + FragDecoder->LogOfM2BRow[firstOneInRow], FragDecoder->FragSize );
+            XorDataLine( acc, tmp, FragDecoder->FragSize );
+            firstOneInRow = BitArrayFindFirstOne( vector, lostWords );
+        }
+        SetRow( acc, reducedRows + k, FragDecoder->FragSize );
+    }
+
+    // Back substitution, the missing rows are written in their final place
+    for( int32_t i = ( FragDecoder->Status.FragNbLost - 1 ); i >= 0 ; i-- )
+    {
+        GetRow( acc, reducedRows + FragDecoder->LogOfM2BRow[i], FragDecoder->FragSize );
+        for( int32_t w = ( i + 1 ) >> 5; w < lostWords; w++ )
+        {
+            uint32_t bits = FRAG_M2B_ROW( i )[w];
+
+            if( w == ( ( i + 1 ) >> 5 ) )
+            {
+                bits &= ~( ( 1UL << ( ( i + 1 ) & 0x1F ) ) - 1 );
+            }
+            while( bits != 0 )
+            {
+                GetRow( tmp, FragFindMissingIndex( ( w << 5 ) + BitCtz( bits ) ), FragDecoder->FragSize );
+                bits &= bits - 1;
+                XorDataLine( acc, tmp, FragDecoder->FragSize );
+            }
+        }
+        SetRow( acc, FragFindMissingIndex( i ), FragDecoder->FragSize );
+    }
+}
+
+static void FragRebuildFromLog( void )
+{
+    uint16_t lostWords = FRAG_BIT_ARRAY_WORDS( FragDecoder->Status.FragNbLost );
+    uint32_t *vector = FragDecoder->Vector;
+    FragParityRow_t *matrixRow;
+    uint16_t firstOneInRow;
+    bool pushed;
+
+    for( uint32_t i = 0; i < ( ( uint32_t )FragDecoder->M2BSize * FragDecoder->M2BWords ); i++ )
+    {
+        FragDecoder->MatrixM2B[i] = 0;
+    }
+    for( uint16_t i = 0; i < FragDecoder->M2BWords; i++ )
+    {
+        FragDecoder->S[i] = 0;
+    }
+    FragDecoder->M2BLine = 0;
+
+    for( uint16_t k = 0; k < FragDecoder->LogNb; k++ )
+    {
+        if( FragDecoder->LogN[k] == 0 )
+        {
+            continue;
+        }
+        memset1( ( uint8_t* )vector, 0, FragDecoder->M2BWords * sizeof( uint32_t ) );
+
+        matrixRow = FragGetParityRow( FragDecoder->LogN[k] );
+        for( int32_t j = 0; j < matrixRow->NbCoeff; j++ )
+        {
+            int32_t i = matrixRow->Coeff[j];
+
+            if( GetParity( i, FragDecoder->FragMissing ) == 1 )
+            {
+                SetParity( FragGetMissingRank( i ), vector );
+            }
+        }
+
+        pushed = false;
+        while( BitArrayIsAllZeros( vector, lostWords ) == 0 )
+        {
+            firstOneInRow = BitArrayFindFirstOne( vector, lostWords );
+            if( GetParity( firstOneInRow, FragDecoder->S ) == 0 )
+            {
+                FragPushLineToBinaryMatrix( vector, firstOneInRow );
+                FragDecoder->LogOfM2BRow[firstOneInRow] = k;
+                SetParity( firstOneInRow, FragDecoder->S );
+                FragDecoder->M2BLine++;
+                pushed = true;
+                break;
             }
+            XorParityLine( vector, FRAG_M2B_ROW( firstOneInRow ), lostWords );
         }
+        if( pushed == false )
+        {
+            // A combination of the previous entries now
+            FragDecoder->LogN[k] = 0;
+        }
+    }
+}
+#endif
+
+int32_t FragDecoderSolve( uint8_t decoderId )
+{
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    uint8_t acc[FRAG_MAX_SIZE];
+    uint8_t tmp[FRAG_MAX_SIZE];
+
+    if( ( FragSelectSession( decoderId ) == false ) || ( FragDecoder->Arena == NULL ) ||
+        ( FragDecoder->IsSolvePending == false ) )
+    {
+        return FRAG_SESSION_ONGOING;
+    }
+    FragSolveFromLog( acc, tmp );
+    FragDecoder->IsSolvePending = false;
+    if( FragDecoder->IsWriteFailed == true )
+    {
+        // A row missing from the storage can't be rebuilt
+        return FRAG_SESSION_FINISHED;
     }
+    return FragDecoder->Status.FragNbLost;
+#else
+    // The missing rows are rebuilt as the fragments come
+    ( void )decoderId;
     return FRAG_SESSION_ONGOING;
+#endif
+}
+
+void FragDecoderPrefetch( void )
+{
+    // At most one row per call, whatever the number of sessions
+    for( uint8_t i = 0; i < FRAG_DECODER_MAX_SESSIONS; i++ )
+    {
+        if( ( FragSelectSession( i ) == true ) && ( FragPrefetchSession( ) == true ) )
+        {
+            return;
+        }
+    }
 }
 
-FragDecoderStatus_t FragDecoderGetStatus( void )
-{ 
-    return FragDecoder.Status;
+FragDecoderStatus_t FragDecoderGetStatus( uint8_t decoderId )
+{
+    FragDecoderStatus_t status = { 0 };
+
+    if( FragSelectSession( decoderId ) == true )
+    {
+        status = FragDecoder->Status;
+    }
+    return status;
 }
 
 /*
@@ -502,17 +1283,22 @@ FragDecoderStatus_t FragDecoderGetStatus( void )
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
 static void SetRow( uint8_t *src, uint16_t row, uint16_t size )
 {
-    if( ( FragDecoder.Callbacks != NULL ) && ( FragDecoder.Callbacks->FragDecoderWrite != NULL ) )
+    if( ( FragDecoder->Callbacks != NULL ) && ( FragDecoder->Callbacks->FragDecoderWrite != NULL ) )
     {
-        FragDecoder.Callbacks->FragDecoderWrite( row * size, src, size );
+        if( FragDecoder->Callbacks->FragDecoderWrite( FragDecoder->StorageOffset + ( row * size ), src, size ) != 0 )
+        {
+            // The row is lost, FragDecoderProcess ends the session
+            FragDecoder->IsWriteFailed = true;
+            FragDecoder->Status.MatrixError = 1;
+        }
     }
 }
 
 static void GetRow( uint8_t *dst, uint16_t row, uint16_t size )
 {
-    if( ( FragDecoder.Callbacks != NULL ) && ( FragDecoder.Callbacks->FragDecoderRead != NULL ) )
+    if( ( FragDecoder->Callbacks != NULL ) && ( FragDecoder->Callbacks->FragDecoderRead != NULL ) )
     {
-        FragDecoder.Callbacks->FragDecoderRead( row * size, dst, size );
+        FragDecoder->Callbacks->FragDecoderRead( FragDecoder->StorageOffset + ( row * size ), dst, size );
     }
 }
 #else
@@ -527,19 +1313,31 @@ static void GetRow( uint8_t *dst, uint8_t *src, uint16_t row, uint16_t size )
 }
 #endif
 
-static uint8_t GetParity( uint16_t index, uint8_t *matrixRow  )
+static uint8_t GetParity( uint16_t index, uint32_t *matrixRow )
+{
+    return ( matrixRow[index >> 5] >> ( index & 0x1F ) ) & 0x01;
+}
+
+static void SetParity( uint16_t index, uint32_t *matrixRow )
 {
-    uint8_t parity;
-    parity = matrixRow[index >> 3];
-    parity = ( parity >> ( 7 - ( index % 8 ) ) ) & 0x01;
-    return parity;
+    matrixRow[index >> 5] |= 1UL << ( index & 0x1F );
 }
 
-static void SetParity( uint16_t index, uint8_t *matrixRow, uint8_t parity )
+static uint32_t BitCtz( uint32_t x )
 {
-    uint8_t mask = 0xFF - ( 1 << ( 7 - ( index % 8 ) ) );
-    parity = parity << ( 7 - ( index % 8 ) );
-    matrixRow[index >> 3] = ( matrixRow[index >> 3] & mask ) + parity;
+#if defined( __GNUC__ )
+    // Single RBIT + CLZ on Cortex-M3/M4
+    return __builtin_ctz( x );
+#else
+    uint32_t n = 0;
+
+    while( ( x & 0x01 ) == 0 )
+    {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
 }
 
 static bool IsPowerOfTwo( uint32_t x )
@@ -559,17 +1357,30 @@ static bool IsPowerOfTwo( uint32_t x )
 
 static void XorDataLine( uint8_t *line1, uint8_t *line2, int32_t size )
 {
-    for( int32_t i = 0; i < size; i++ )
+    int32_t i = 0;
+    uint32_t word1;
+    uint32_t word2;
+
+    // XOR 4 bytes at a time, the fixed size copies compile into single word loads and stores
+    // (unaligned accesses are allowed on Cortex-M4) without type punning the byte lines
+    for( ; i < ( size & ~0x03 ); i += 4 )
+    {
+        memcpy( &word1, &line1[i], sizeof( word1 ) );
+        memcpy( &word2, &line2[i], sizeof( word2 ) );
+        word1 ^= word2;
+        memcpy( &line1[i], &word1, sizeof( word1 ) );
+    }
+    for( ; i < size; i++ )
     {
         line1[i] = line1[i] ^ line2[i];
     }
 }
 
-static void XorParityLine( uint8_t* line1, uint8_t* line2, int32_t size )
+static void XorParityLine( uint32_t* line1, uint32_t* line2, int32_t words )
 {
-    for( int32_t i = 0; i < size; i++ )
+    for( int32_t i = 0; i < words; i++ )
     {
-        SetParity( i, line1, ( GetParity( i, line1 ) ^ GetParity( i, line2 ) ) );
+        line1[i] ^= line2[i];
     }
 }
 
@@ -580,7 +1391,7 @@ static int32_t FragPrbs23( int32_t value )
     return ( value >> 1 ) + ( ( b0 ^ b1 ) << 22 );;
 }
 
-static void FragGetParityMatrixRow( int32_t n, int32_t m, uint8_t *matrixRow )
+static void FragGetParityMatrixRow( int32_t n, int32_t m, FragParityRow_t *matrixRow )
 {
     int32_t mTemp;
     int32_t x;
@@ -597,10 +1408,8 @@ static void FragGetParityMatrixRow( int32_t n, int32_t m, uint8_t *matrixRow )
     }
 
     x = 1 + ( 1001 * n );
-    for( uint8_t i = 0; i < ( ( m >> 3 ) + 1 ); i++ )
-    {
-        matrixRow[i] = 0;
-    }
+    matrixRow->N = n;
+    matrixRow->NbCoeff = 0;
     while( nbCoeff < ( m >> 1 ) )
     {
         r = 1 << 16;
@@ -609,28 +1418,48 @@ static void FragGetParityMatrixRow( int32_t n, int32_t m, uint8_t *matrixRow )
             x = FragPrbs23( x );
             r = x % ( m + mTemp );
         }
-        SetParity( r, matrixRow, 1 );
+        // A column drawn twice is still set only once
+        if( GetParity( r, FragDecoder->ParityRowMask ) == 0 )
+        {
+            SetParity( r, FragDecoder->ParityRowMask );
+            matrixRow->Coeff[matrixRow->NbCoeff++] = r;
+        }
         nbCoeff += 1;
     }
+    for( uint16_t i = 0; i < matrixRow->NbCoeff; i++ )
+    {
+        FragDecoder->ParityRowMask[matrixRow->Coeff[i] >> 5] = 0;
+    }
+}
+
+static FragParityRow_t* FragGetParityRow( uint16_t n )
+{
+    FragParityRow_t *row = FRAG_PARITY_ROW( n );
+
+    if( row->N != n )
+    {
+        FragGetParityMatrixRow( n, FragDecoder->FragNb, row );
+    }
+    return row;
 }
 
-static uint16_t BitArrayFindFirstOne( uint8_t *bitArray, uint16_t size )
+static uint16_t BitArrayFindFirstOne( uint32_t *bitArray, uint16_t words )
 {
-    for( uint16_t i = 0; i < size; i++)
+    for( uint16_t i = 0; i < words; i++)
     {
-        if ( GetParity( i, bitArray ) == 1 )
+        if ( bitArray[i] != 0 )
         {
-            return i;
+            return ( i << 5 ) + BitCtz( bitArray[i] );
         }
     }
     return 0;
 }
 
-static uint8_t BitArrayIsAllZeros( uint8_t *bitArray, uint16_t  size )
+static uint8_t BitArrayIsAllZeros( uint32_t *bitArray, uint16_t words )
 {
-    for( uint16_t i = 0; i < size; i++ )
+    for( uint16_t i = 0; i < words; i++ )
     {
-        if( GetParity( i, bitArray ) == 1 )
+        if( bitArray[i] != 0 )
         {
             return 0;
         }
@@ -638,122 +1467,277 @@ static uint8_t BitArrayIsAllZeros( uint8_t *bitArray, uint16_t  size )
     return 1;
 }
 
+static uint32_t BitPopCount( uint32_t x )
+{
+#if defined( __GNUC__ )
+    return __builtin_popcount( x );
+#else
+    x = x - ( ( x >> 1 ) & 0x55555555 );
+    x = ( x & 0x33333333 ) + ( ( x >> 2 ) & 0x33333333 );
+    x = ( x + ( x >> 4 ) ) & 0x0F0F0F0F;
+    return ( x * 0x01010101 ) >> 24;
+#endif
+}
+
 /*!
  * \brief Finds & marks missing fragments
  *
  * \param [IN]  counter Current fragment counter
- * \param [OUT] FragDecoder.FragNbMissingIndex[] array is updated in place
+ * \param [OUT] FragDecoder->FragMissing[] map is updated in place
  */
 static void FragFindMissingFrags( uint16_t counter )
 {
     int32_t i;
-    for( i = FragDecoder.Status.FragNbLastRx; i < ( counter - 1 ); i++ )
+    for( i = FragDecoder->Status.FragNbLastRx; i < ( counter - 1 ); i++ )
     {
-        if( i < FragDecoder.FragNb )
+        if( i < FragDecoder->FragNb )
         {
-            FragDecoder.Status.FragNbLost++;
-            FragDecoder.FragNbMissingIndex[i] = FragDecoder.Status.FragNbLost;
+            // The ranks are computed once the lost fragments are known
+            SetParity( i, FragDecoder->FragMissing );
+            FragDecoder->Status.FragNbLost++;
         }
     }
-    if( i < FragDecoder.FragNb )
+    if( i < FragDecoder->FragNb )
     {
-        FragDecoder.Status.FragNbLastRx = counter;
+        FragDecoder->Status.FragNbLastRx = counter;
     }
     else
     {
-        FragDecoder.Status.FragNbLastRx = FragDecoder.FragNb + 1;
+        FragDecoder->Status.FragNbLastRx = FragDecoder->FragNb + 1;
     }
-    DBG( "RECEIVED    : %5d / %5d Fragments\r\n", FragDecoder.Status.FragNbRx, FragDecoder.FragNb );
-    DBG( "              %5d / %5d Bytes\r\n", FragDecoder.Status.FragNbRx * FragDecoder.FragSize, FragDecoder.FragNb * FragDecoder.FragSize );
-    DBG( "LOST        :       %7d Fragments\r\n\r\n", FragDecoder.Status.FragNbLost );
+    DBG( "RECEIVED    : %5d / %5d Fragments\r\n", FragDecoder->Status.FragNbRx, FragDecoder->FragNb );
+    DBG( "              %5d / %5d Bytes\r\n", FragDecoder->Status.FragNbRx * FragDecoder->FragSize, FragDecoder->FragNb * FragDecoder->FragSize );
+    DBG( "LOST        :       %7d Fragments\r\n\r\n", FragDecoder->Status.FragNbLost );
 }
 
-/*!
- * \brief Finds the index (frag counter) of the x th missing frag
- *
- * \param [IN] x   x th missing frag
- *
- * \retval counter The counter value associated to the x th missing frag
- */
-static uint16_t FragFindMissingIndex( uint16_t x )
+static uint32_t FragGetFixedSize( uint16_t fragNb )
+{
+    uint32_t words = FRAG_BIT_ARRAY_WORDS( fragNb );
+
+    return FRAG_DECODER_NVM_HEADER_SIZE +
+           ( words * sizeof( uint32_t ) ) +                                 // FragMissing
+           FRAG_ALIGN( words * sizeof( uint16_t ) ) +                       // FragMissingRank
+           ( FRAG_PARITY_ROW_CACHE_NB * FRAG_PARITY_ROW_SIZE( fragNb ) ) +  // ParityRows
+           ( words * sizeof( uint32_t ) );                                  // ParityRowMask
+}
+
+static uint32_t FragGetLostSize( uint16_t lostNb )
+{
+    uint32_t words = FRAG_BIT_ARRAY_WORDS( lostNb );
+
+    // MatrixM2B, S and Vector, then the arrays indexed by lost fragment
+    return ( ( ( uint32_t )lostNb + 2 ) * words * sizeof( uint32_t ) ) +
+           ( FRAG_LOST_INDEX_ARRAYS * FRAG_ALIGN( lostNb * sizeof( uint16_t ) ) );
+}
+
+static uint32_t FragGetNvmCtxSize( uint16_t fragNb, uint16_t m2bSize )
+{
+    return FRAG_DECODER_NVM_HEADER_SIZE + ( FRAG_BIT_ARRAY_WORDS( fragNb ) * sizeof( uint32_t ) ) +
+           FragGetLostSize( m2bSize );
+}
+
+static void FragLayout( void )
+{
+    uint32_t fragWords = FRAG_BIT_ARRAY_WORDS( FragDecoder->FragNb );
+    uint32_t lostIndexSize = FRAG_ALIGN( FragDecoder->M2BSize * sizeof( uint16_t ) );
+    uint8_t *p = FragDecoder->Arena + FRAG_DECODER_NVM_HEADER_SIZE;
+    uint8_t *top = FragDecoder->Arena + FragArenaSessionSize;
+
+    // Saved part, from the start of the arena
+    FragDecoder->M2BWords = FRAG_BIT_ARRAY_WORDS( FragDecoder->M2BSize );
+    FragDecoder->FragMissing = ( uint32_t* )p;
+    p += fragWords * sizeof( uint32_t );
+    FragDecoder->MatrixM2B = ( uint32_t* )p;
+    p += ( uint32_t )FragDecoder->M2BSize * FragDecoder->M2BWords * sizeof( uint32_t );
+    FragDecoder->S = ( uint32_t* )p;
+    p += FragDecoder->M2BWords * sizeof( uint32_t );
+    FragDecoder->Vector = ( uint32_t* )p;
+    p += FragDecoder->M2BWords * sizeof( uint32_t );
+    FragDecoder->FragMissingIndex = ( uint16_t* )p;
+    p += lostIndexSize;
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    FragDecoder->LogN = ( uint16_t* )p;
+    p += lostIndexSize;
+    FragDecoder->LogOfM2BRow = ( uint16_t* )p;
+    p += lostIndexSize;
+#endif
+    FragDecoder->NvmCtxSize = p - FragDecoder->Arena;
+
+    // Rebuilt part, from the end of the arena
+    top -= fragWords * sizeof( uint32_t );
+    FragDecoder->ParityRowMask = ( uint32_t* )top;
+    top -= FRAG_PARITY_ROW_CACHE_NB * FRAG_PARITY_ROW_SIZE( FragDecoder->FragNb );
+    FragDecoder->ParityRows = top;
+    top -= FRAG_ALIGN( fragWords * sizeof( uint16_t ) );
+    FragDecoder->FragMissingRank = ( uint16_t* )top;
+}
+
+static void FragLayoutLost( void )
+{
+    uint32_t *p;
+
+    FragDecoder->M2BSize = FragDecoder->Status.FragNbLost;
+    FragLayout( );
+    p = FragDecoder->MatrixM2B;
+    while( p < ( uint32_t* )( FragDecoder->Arena + FragDecoder->NvmCtxSize ) )
+    {
+        *p++ = 0;
+    }
+    FragUpdateMissingRanks( );
+}
+
+static void FragUpdateMissingRanks( void )
 {
-    for( uint16_t i = 0; i < FragDecoder.FragNb; i++ )
+    uint16_t rank = 0;
+
+    for( uint16_t w = 0; w < FRAG_BIT_ARRAY_WORDS( FragDecoder->FragNb ); w++ )
     {
-        if( FragDecoder.FragNbMissingIndex[i] == ( x + 1 ) )
+        uint32_t bits = FragDecoder->FragMissing[w];
+
+        FragDecoder->FragMissingRank[w] = rank;
+        while( bits != 0 )
         {
-            return i;
+            if( rank < FragDecoder->M2BSize )
+            {
+                FragDecoder->FragMissingIndex[rank] = ( w << 5 ) + BitCtz( bits );
+            }
+            bits &= bits - 1;
+            rank++;
         }
     }
-    return 0;
 }
 
-/*!
- * \brief Extacts a row from the binary matrix and expands it to a bitArray
- *
- * \param [IN] bitArray  Pointer to the bit array
- * \param [IN] rowIndex  Matrix row index
- * \param [IN] bitsInRow Number of bits in one row
- */
-static void FragExtractLineFromBinaryMatrix( uint8_t* bitArray, uint16_t rowIndex, uint16_t bitsInRow )
+static int32_t FragProcessLateFrag( uint16_t index, uint8_t *rawData )
 {
-    uint32_t findByte = 0;
-    uint32_t findBitInByte = 0;
-
-    if( rowIndex > 0 )
+    if( GetParity( index, FragDecoder->FragMissing ) == 0 )
     {
-        findByte      = ( rowIndex * bitsInRow - ( ( rowIndex * ( rowIndex - 1 ) ) >> 1 ) ) >> 3;
-        findBitInByte = ( rowIndex * bitsInRow - ( ( rowIndex * ( rowIndex - 1 ) ) >> 1 ) ) % 8;
+        return FRAG_SESSION_ONGOING;  // Duplicate, the row is already stored
     }
-    if( rowIndex > 0 )
+#if( FRAG_DECODER_DEFERRED_SOLVE == 0 )
+    if( FragDecoder->M2BLine != 0 )
     {
-        for( uint16_t i = 0; i < rowIndex; i++ )
-        {
-            SetParity( i, bitArray, 0 );
-        }
+        // The reduced equations already replaced the lost rows in the file
+        // and can't be rebuilt without their column, a coded fragment will
+        // make up for this one
+        return FRAG_SESSION_ONGOING;
     }
-    for( uint16_t i = rowIndex; i < bitsInRow; i++ )
+#endif
+
+    // The fragment leaves the lost fragments system
+    FragDecoder->FragMissing[index >> 5] &= ~( 1UL << ( index & 0x1F ) );
+    FragDecoder->Status.FragNbLost--;
+    if( FragDecoder->M2BSize != 0 )
     {
-        SetParity( i,
-                   bitArray, 
-                   ( FragDecoder.MatrixM2B[findByte] >> ( 7 - findBitInByte ) ) & 0x01 );
+        FragUpdateMissingRanks( );
+    }
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+    SetRow( rawData, index, FragDecoder->FragSize );
+#else
+    SetRow( FragDecoder->File, rawData, index, FragDecoder->FragSize );
+#endif
+    DBG( "LATE        : %5d, %5d lost\r\n", index + 1, FragDecoder->Status.FragNbLost );
 
-        findBitInByte++;
-        if( findBitInByte == 8 )
+    if( FragDecoder->Status.FragNbLastRx < FragDecoder->FragNb )
+    {
+        return FRAG_SESSION_ONGOING;  // Uncoded fragments still to come
+    }
+    if( FragDecoder->Status.FragNbLost == 0 )
+    {
+        return FragDecoder->Status.FragNbLost;
+    }
+#if( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+    if( FragDecoder->LogNb != 0 )
+    {
+        FragRebuildFromLog( );
+        if( FragDecoder->M2BLine == FragDecoder->Status.FragNbLost )
         {
-            findBitInByte = 0;
-            findByte++;
+            FragDecoder->IsSolvePending = true;
         }
     }
+#endif
+    return FRAG_SESSION_ONGOING;
+}
+
+/*!
+ * \brief Finds the index (frag counter) of the x th missing frag
+ *
+ * \param [IN] x   x th missing frag
+ *
+ * \retval counter The counter value associated to the x th missing frag
+ */
+static uint16_t FragFindMissingIndex( uint16_t x )
+{
+    return FragDecoder->FragMissingIndex[x];
+}
+
+/*!
+ * \brief Gets the rank of a missing fragment amongst the missing fragments
+ *
+ * \param [IN] index Missing fragment index
+ *
+ * \retval x         The fragment is the x th missing frag
+ */
+static uint16_t FragGetMissingRank( uint16_t index )
+{
+    return FragDecoder->FragMissingRank[index >> 5] +
+           BitPopCount( FragDecoder->FragMissing[index >> 5] & ( ( 1UL << ( index & 0x1F ) ) - 1 ) );
 }
 
 /*!
- * \brief Collapses and Pushs a row of a bit array to the matrix
+ * \brief Pushes a row of a bit array to the matrix
  *
  * \param [IN] bitArray  Pointer to the bit array
  * \param [IN] rowIndex  Matrix row index
- * \param [IN] bitsInRow Number of bits in one row
  */
-static void FragPushLineToBinaryMatrix( uint8_t *bitArray, uint16_t rowIndex, uint16_t bitsInRow )
+static void FragPushLineToBinaryMatrix( uint32_t *bitArray, uint16_t rowIndex )
+{
+    for( uint16_t i = 0; i < FragDecoder->M2BWords; i++ )
+    {
+        FRAG_M2B_ROW( rowIndex )[i] = bitArray[i];
+    }
+}
+
+static void FragResetCaches( void )
 {
-    uint32_t findByte = 0;
-    uint32_t findBitInByte = 0;
+    for( uint32_t i = 0; i < FRAG_PARITY_ROW_CACHE_NB; i++ )
+    {
+        FRAG_PARITY_ROW( i )->N = 0;
+    }
+    for( uint16_t i = 0; i < FRAG_BIT_ARRAY_WORDS( FragDecoder->FragNb ); i++ )
+    {
+        FragDecoder->ParityRowMask[i] = 0;
+    }
+}
 
-    if ( rowIndex > 0) {
-        findByte      = ( rowIndex * bitsInRow - ( ( rowIndex * ( rowIndex - 1 ) ) >> 1 ) ) >> 3;
-        findBitInByte = ( rowIndex * bitsInRow - ( ( rowIndex * ( rowIndex - 1 ) ) >> 1 ) ) % 8;
+static bool FragSelectSession( uint8_t decoderId )
+{
+    if( decoderId >= FRAG_DECODER_MAX_SESSIONS )
+    {
+        return false;
+    }
+#if( FRAG_DECODER_MAX_SESSIONS > 1 )
+    FragDecoder = &FragDecoders[decoderId];
+#endif
+    return true;
+}
 
+static bool FragPrefetchSession( void )
+{
+    // Coded fragments are only processed when some uncoded ones were lost
+    if( ( FragDecoder->Arena == NULL ) || ( FragDecoder->Status.FragNbLost == 0 ) ||
+        ( FragDecoder->Status.FragNbLost > FragDecoder->MaxLost ) ||
+        ( FragDecoder->M2BLine == FragDecoder->Status.FragNbLost ) )
+    {
+        return false;
     }
-    for( uint16_t i = rowIndex; i < bitsInRow; i++ )
+
+    for( uint16_t n = FragDecoder->LastCodedN + 1; n <= ( FragDecoder->LastCodedN + FRAG_PARITY_ROW_CACHE_NB ); n++ )
     {
-        if( GetParity( i, bitArray ) == 0 )
-        {
-            FragDecoder.MatrixM2B[findByte] = FragDecoder.MatrixM2B[findByte] & ( 0xFF - ( 1 << ( 7 - findBitInByte ) ) );
-        }
-        findBitInByte++;
-        if( findBitInByte == 8 )
+        if( FRAG_PARITY_ROW( n )->N != n )
         {
-            findBitInByte = 0;
-            findByte++;
+            FragGetParityMatrixRow( n, FragDecoder->FragNb, FRAG_PARITY_ROW( n ) );
+            return true;
         }
     }
+    return false;
 }
@@ -35,6 +35,16 @@
 
 #define FRAGMENTATION_MAX_SESSIONS                  4
 
+/*!
+ * Decoder session of a fragmentation session. A single decoder session is
+ * taken over by the last fragmentation session set up
+ */
+#if( FRAG_DECODER_MAX_SESSIONS > 1 )
+#define FRAGMENTATION_DECODER_ID( fragIndex )       ( fragIndex )
+#else
+#define FRAGMENTATION_DECODER_ID( fragIndex )       0
+#endif
+
 /*!
  * Package current context
  */
@@ -106,6 +116,13 @@ static void LmhpFragmentationProcess( void );
  */
 static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication );
 
+/*!
+ * Reports the end of a session, successful or not, through OnDone
+ *
+ * \param [IN] fragIndex          Session index
+ */
+static void LmhpFragmentationOnSessionDone( uint8_t fragIndex );
+
 static LmhpFragmentationState_t LmhpFragmentationState =
 {
     .Initialized = false,
@@ -175,11 +192,81 @@ LmhPackage_t *LmhpFragmentationPackageFactory( void )
     return &LmhpFragmentationPackage;
 }
 
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+void* LmhpFragmentationGetNvmCtx( size_t* fragmentationNvmCtxSize )
+{
+    *fragmentationNvmCtxSize = sizeof( FragSessionData );
+    return FragSessionData;
+}
+
+bool LmhpFragmentationRestoreNvmCtx( void* fragmentationNvmCtx, size_t fragmentationNvmCtxSize,
+                                     void* fragDecoderNvmCtx, size_t fragDecoderNvmCtxSize )
+{
+    uint8_t *decoderNvmCtx = ( uint8_t* )fragDecoderNvmCtx;
+    size_t offset = 0;
+
+    if( ( LmhpFragmentationParams == NULL ) || ( fragmentationNvmCtx == NULL ) ||
+        ( fragmentationNvmCtxSize != sizeof( FragSessionData ) ) || ( fragDecoderNvmCtx == NULL ) )
+    {
+        return false;
+    }
+    // The decoder states are sized on their sessions. They are all checked
+    // before any is restored, so that a bad one leaves the decoders as they are
+    for( uint8_t i = 0; i < FRAG_DECODER_MAX_SESSIONS; i++ )
+    {
+        size_t decoderNvmCtxSize = fragDecoderNvmCtxSize - offset;
+
+        if( FragDecoderCheckNvmCtx( i, decoderNvmCtx + offset, &decoderNvmCtxSize ) == false )
+        {
+            return false;
+        }
+        offset += decoderNvmCtxSize;
+    }
+    if( offset != fragDecoderNvmCtxSize )
+    {
+        return false;
+    }
+    offset = 0;
+    for( uint8_t i = 0; i < FRAG_DECODER_MAX_SESSIONS; i++ )
+    {
+        size_t decoderNvmCtxSize = fragDecoderNvmCtxSize - offset;
+
+        FragDecoderRestoreNvmCtx( i, decoderNvmCtx + offset, &decoderNvmCtxSize,
+                                  &LmhpFragmentationParams->DecoderCallbacks );
+        offset += decoderNvmCtxSize;
+    }
+    memcpy1( ( uint8_t* )FragSessionData, ( uint8_t* )fragmentationNvmCtx, sizeof( FragSessionData ) );
+    for( uint8_t i = 0; i < FRAGMENTATION_MAX_SESSIONS; i++ )
+    {
+        if( ( FragSessionData[i].FragGroupData.IsActive == true ) &&
+            ( FragSessionData[i].FragDecoderPorcessStatus == FRAG_SESSION_ONGOING ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+bool LmhpFragmentationIsSessionOngoing( void )
+{
+    for( uint8_t i = 0; i < FRAGMENTATION_MAX_SESSIONS; i++ )
+    {
+        if( ( FragSessionData[i].FragGroupData.IsActive == true ) &&
+            ( FragSessionData[i].FragDecoderPorcessStatus == FRAG_SESSION_ONGOING ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void LmhpFragmentationInit( void *params, uint8_t *dataBuffer, uint8_t dataBufferMaxSize )
 {
     if( ( params != NULL ) && ( dataBuffer != NULL ) )
     {
         LmhpFragmentationParams = ( LmhpFragmentationParams_t* )params;
+        FragDecoderSetArena( LmhpFragmentationParams->DecoderArena, LmhpFragmentationParams->DecoderArenaSize );
         LmhpFragmentationState.DataBuffer = dataBuffer;
         LmhpFragmentationState.DataBufferMaxSize = dataBufferMaxSize;
         LmhpFragmentationState.Initialized = true;
@@ -210,8 +297,34 @@ static bool LmhpFragmentationIsRunning( void )
 
 static void LmhpFragmentationProcess( void )
 {
+    bool isOngoing = false;
+
     // TODO: Start a timer to randomly delay the answer
 
+    for( uint8_t i = 0; i < FRAGMENTATION_MAX_SESSIONS; i++ )
+    {
+        if( ( FragSessionData[i].FragGroupData.IsActive == true ) &&
+            ( FragSessionData[i].FragDecoderPorcessStatus == FRAG_SESSION_ONGOING ) )
+        {
+            // The missing rows are rebuilt here rather than in the MCPS
+            // indication of the fragment which completed the system
+            FragSessionData[i].FragDecoderPorcessStatus = FragDecoderSolve( FRAGMENTATION_DECODER_ID( i ) );
+            if( FragSessionData[i].FragDecoderPorcessStatus >= 0 )
+            {
+                LmhpFragmentationOnSessionDone( i );
+            }
+            else
+            {
+                isOngoing = true;
+            }
+        }
+    }
+    if( isOngoing == true )
+    {
+        // Use the idle time between two fragments to get the next
+        // coded fragment parity row ready
+        FragDecoderPrefetch( );
+    }
 }
 
 static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication )
@@ -242,7 +355,7 @@ static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication
                 uint8_t participants = fragIndex & 0x01;
 
                 fragIndex >>= 1;
-                FragSessionData[fragIndex].FragDecoderStatus = FragDecoderGetStatus( );
+                FragSessionData[fragIndex].FragDecoderStatus = FragDecoderGetStatus( FRAGMENTATION_DECODER_ID( fragIndex ) );
 
                 if( ( participants == 1 ) ||
                     ( ( participants == 0 ) && ( FragSessionData[fragIndex].FragDecoderStatus.FragNbLost > 0 ) ) )
@@ -288,26 +401,36 @@ static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication
                     status |= 0x01; // Encoding unsupported
                 }
 
-#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                if( ( fragSessionData.FragGroupData.FragNb * fragSessionData.FragGroupData.FragSize ) > FragDecoderGetMaxFileSize( ) )
-                {
-                    status |= 0x02; // Not enough Memory
-                }
-#else
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 0 )
                 if( ( fragSessionData.FragGroupData.FragNb * fragSessionData.FragGroupData.FragSize ) > LmhpFragmentationParams->BufferSize )
                 {
                     status |= 0x02; // Not enough Memory
                 }
 #endif
-                if( fragSessionData.FragGroupData.FragNb > FRAG_MAX_NB )
-                {
-                	status |= 0x02; // Not enough Memory
-                }
                 status |= ( fragSessionData.FragGroupData.FragSession.Fields.FragIndex << 6 ) & 0xC0;
-                if( fragSessionData.FragGroupData.FragSession.Fields.FragIndex >= FRAGMENTATION_MAX_SESSIONS )
+                if( ( fragSessionData.FragGroupData.FragSession.Fields.FragIndex >= FRAGMENTATION_MAX_SESSIONS ) ||
+                    ( ( FRAG_DECODER_MAX_SESSIONS > 1 ) &&
+                      ( fragSessionData.FragGroupData.FragSession.Fields.FragIndex >= FRAG_DECODER_MAX_SESSIONS ) ) )
                 {
                     status |= 0x04; // FragSession index not supported
                 }
+                else
+                {
+                    uint8_t decoderId = FRAGMENTATION_DECODER_ID( fragSessionData.FragGroupData.FragSession.Fields.FragIndex );
+
+                    // The decoder arena and storage are sized on the session
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+                    if( FragDecoderGetMaxLost( decoderId, fragSessionData.FragGroupData.FragNb,
+                                               fragSessionData.FragGroupData.FragSize,
+                                               &LmhpFragmentationParams->DecoderRegions[decoderId] ) < 0 )
+#else
+                    if( FragDecoderGetMaxLost( decoderId, fragSessionData.FragGroupData.FragNb,
+                                               fragSessionData.FragGroupData.FragSize ) < 0 )
+#endif
+                    {
+                        status |= 0x02; // Not enough Memory
+                    }
+                }
 
                 // Descriptor is not really defined in the specification
                 // Not clear how to handle this.
@@ -320,19 +443,36 @@ static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication
                 if( ( status & 0x0F ) == 0 )
                 {
                     // The FragSessionSetup is accepted
+                    uint8_t fragIndex = fragSessionData.FragGroupData.FragSession.Fields.FragIndex;
+
                     fragSessionData.FragGroupData.IsActive = true;
                     fragSessionData.FragDecoderPorcessStatus = FRAG_SESSION_ONGOING;
-                    FragSessionData[fragSessionData.FragGroupData.FragSession.Fields.FragIndex] = fragSessionData;
+                    // Sessions sharing the decoder session are not decoded anymore
+                    for( uint8_t i = 0; i < FRAGMENTATION_MAX_SESSIONS; i++ )
+                    {
+                        if( FRAGMENTATION_DECODER_ID( i ) == FRAGMENTATION_DECODER_ID( fragIndex ) )
+                        {
+                            FragSessionData[i].FragDecoderPorcessStatus = FRAG_SESSION_NOT_STARTED;
+                        }
+                    }
+                    FragSessionData[fragIndex] = fragSessionData;
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                    FragDecoderInit( fragSessionData.FragGroupData.FragNb,
+                    FragDecoderInit( FRAGMENTATION_DECODER_ID( fragIndex ),
+                                     fragSessionData.FragGroupData.FragNb,
                                      fragSessionData.FragGroupData.FragSize,
-                                     &LmhpFragmentationParams->DecoderCallbacks );
+                                     &LmhpFragmentationParams->DecoderCallbacks,
+                                     &LmhpFragmentationParams->DecoderRegions[FRAGMENTATION_DECODER_ID( fragIndex )] );
 #else
-                    FragDecoderInit( fragSessionData.FragGroupData.FragNb,
+                    FragDecoderInit( FRAGMENTATION_DECODER_ID( fragIndex ),
+                                     fragSessionData.FragGroupData.FragNb,
                                      fragSessionData.FragGroupData.FragSize,
                                      LmhpFragmentationParams->Buffer,
                                      LmhpFragmentationParams->BufferSize );
 #endif
+                    if( LmhpFragmentationParams->OnSessionChange != NULL )
+                    {
+                        LmhpFragmentationParams->OnSessionChange( );
+                    }
                 }
                 LmhpFragmentationState.DataBuffer[dataBufferIndex++] = FRAGMENTATION_FRAG_SESSION_SETUP_ANS;
                 LmhpFragmentationState.DataBuffer[dataBufferIndex++] = status;
@@ -358,6 +498,10 @@ static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication
                 {
                     // Delete session
                     FragSessionData[id].FragGroupData.IsActive = false;
+                    if( LmhpFragmentationParams->OnSessionChange != NULL )
+                    {
+                        LmhpFragmentationParams->OnSessionChange( );
+                    }
                 }
                 LmhpFragmentationState.DataBuffer[dataBufferIndex++] = FRAGMENTATION_FRAG_SESSION_DELETE_ANS;
                 LmhpFragmentationState.DataBuffer[dataBufferIndex++] = status;
@@ -391,34 +535,29 @@ static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication
                     //}
                 }
 
-                if( FragSessionData[fragIndex].FragDecoderPorcessStatus == FRAG_SESSION_ONGOING )
+                if( FragSessionData[fragIndex].FragDecoderPorcessStatus != FRAG_SESSION_ONGOING )
                 {
-                    FragSessionData[fragIndex].FragDecoderPorcessStatus = FragDecoderProcess( fragCounter, &mcpsIndication->Buffer[cmdIndex] );
-                    FragSessionData[fragIndex].FragDecoderStatus = FragDecoderGetStatus( );
-                    if( LmhpFragmentationParams->OnProgress != NULL )
-                    {
-                        LmhpFragmentationParams->OnProgress( FragSessionData[fragIndex].FragDecoderStatus.FragNbRx,
-                                                             FragSessionData[fragIndex].FragGroupData.FragNb,
-                                                             FragSessionData[fragIndex].FragGroupData.FragSize,
-                                                             FragSessionData[fragIndex].FragDecoderStatus.FragNbLost );
-                    }
+                    // Late fragment of a finished session, or fragment of no
+                    // session at all: the redundancy sent after the file was
+                    // rebuilt is dropped as it comes. A data fragment fills the
+                    // rest of the frame
+                    cmdIndex = mcpsIndication->BufferSize;
+                    break;
                 }
-				if( FragSessionData[fragIndex].FragDecoderPorcessStatus >= 0 )
+
+                FragSessionData[fragIndex].FragDecoderPorcessStatus = FragDecoderProcess( FRAGMENTATION_DECODER_ID( fragIndex ),
+                                                                                          fragCounter, &mcpsIndication->Buffer[cmdIndex] );
+                FragSessionData[fragIndex].FragDecoderStatus = FragDecoderGetStatus( FRAGMENTATION_DECODER_ID( fragIndex ) );
+                if( LmhpFragmentationParams->OnProgress != NULL )
                 {
-                    // Fragmentation successfully done
-					PRINTF("Fragmentation done with status %d\r\n", FragSessionData[fragIndex].FragDecoderPorcessStatus);
-                    FragSessionData[fragIndex].FragDecoderPorcessStatus = FRAG_SESSION_NOT_STARTED;
-                    if( LmhpFragmentationParams->OnDone != NULL )
-                    {
-#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
-                        LmhpFragmentationParams->OnDone( FragSessionData[fragIndex].FragDecoderPorcessStatus,
-                                                        ( FragSessionData[fragIndex].FragGroupData.FragNb * FragSessionData[fragIndex].FragGroupData.FragSize ) - FragSessionData[fragIndex].FragGroupData.Padding );
-#else
-                         LmhpFragmentationParams->OnDone( FragSessionData[fragIndex].FragDecoderPorcessStatus,
-                                                         LmhpFragmentationParams->Buffer,
-                                                         ( FragSessionData[fragIndex].FragGroupData.FragNb * FragSessionData[fragIndex].FragGroupData.FragSize ) - FragSessionData[fragIndex].FragGroupData.Padding );
-#endif
-                    }
+                    LmhpFragmentationParams->OnProgress( FragSessionData[fragIndex].FragDecoderStatus.FragNbRx,
+                                                         FragSessionData[fragIndex].FragGroupData.FragNb,
+                                                         FragSessionData[fragIndex].FragGroupData.FragSize,
+                                                         FragSessionData[fragIndex].FragDecoderStatus.FragNbLost );
+                }
+                if( FragSessionData[fragIndex].FragDecoderPorcessStatus >= 0 )
+                {
+                    LmhpFragmentationOnSessionDone( fragIndex );
                 }
                 cmdIndex += FragSessionData[fragIndex].FragGroupData.FragSize;
                 break;
@@ -449,3 +588,30 @@ static void LmhpFragmentationOnMcpsIndication( McpsIndication_t *mcpsIndication
         }
     }
 }
+
+static void LmhpFragmentationOnSessionDone( uint8_t fragIndex )
+{
+    int32_t status = FragSessionData[fragIndex].FragDecoderPorcessStatus;
+
+    FragSessionData[fragIndex].FragDecoderStatus = FragDecoderGetStatus( FRAGMENTATION_DECODER_ID( fragIndex ) );
+    if( FragSessionData[fragIndex].FragDecoderStatus.MatrixError != 0 )
+    {
+        // Too many lost fragments or a failed storage write
+        status = FRAG_SESSION_FAILED;
+    }
+
+    // Fragmentation done, successfully or not
+    PRINTF("Fragmentation done with status %d\r\n", status);
+    FragSessionData[fragIndex].FragDecoderPorcessStatus = FRAG_SESSION_NOT_STARTED;
+    if( LmhpFragmentationParams->OnDone != NULL )
+    {
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+        LmhpFragmentationParams->OnDone( status,
+                                        ( FragSessionData[fragIndex].FragGroupData.FragNb * FragSessionData[fragIndex].FragGroupData.FragSize ) - FragSessionData[fragIndex].FragGroupData.Padding );
+#else
+        LmhpFragmentationParams->OnDone( status,
+                                        LmhpFragmentationParams->Buffer,
+                                        ( FragSessionData[fragIndex].FragGroupData.FragNb * FragSessionData[fragIndex].FragGroupData.FragSize ) - FragSessionData[fragIndex].FragGroupData.Padding );
+#endif
+    }
+}
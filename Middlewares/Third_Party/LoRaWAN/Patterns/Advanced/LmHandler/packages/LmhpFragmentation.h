@@ -39,11 +39,24 @@
  */
 typedef struct LmhpFragmentationParams_s
 {
+    /*!
+     * RAM the decoder sessions are laid out in, see FragDecoderSetArena
+     */
+    void *DecoderArena;
+    /*!
+     * Size of the decoder arena in bytes
+     */
+    uint32_t DecoderArenaSize;
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
     /*!
      * FragDecoder Write/Read function callbacks
      */
     FragDecoderCallbacks_t DecoderCallbacks;
+    /*!
+     * Storage region of each decoder session. A zero Size lets the session
+     * use all the storage
+     */
+    FragDecoderRegion_t DecoderRegions[FRAG_DECODER_MAX_SESSIONS];
 #else
     /*!
      * Pointer to the un-fragmented received buffer.
@@ -67,7 +80,7 @@ typedef struct LmhpFragmentationParams_s
     /*!
      * Notifies that the fragmentation session is finished
      *
-     * \param [IN] status Fragmentation session status [FRAG_SESSION_ONGOING,
+     * \param [IN] status Fragmentation session status [FRAG_SESSION_FAILED,
      *                                                  FRAG_SESSION_FINISHED or
      *                                                  FragDecoder.Status.FragNbLost]
      * \param [IN] size   Received file size
@@ -77,7 +90,7 @@ typedef struct LmhpFragmentationParams_s
     /*!
      * Notifies that the fragmentation session is finished
      *
-     * \param [IN] status Fragmentation session status [FRAG_SESSION_ONGOING,
+     * \param [IN] status Fragmentation session status [FRAG_SESSION_FAILED,
      *                                                  FRAG_SESSION_FINISHED or
      *                                                  FragDecoder.Status.FragNbLost]
      * \param [IN] file   Pointer to the reception file buffer
@@ -85,8 +98,49 @@ typedef struct LmhpFragmentationParams_s
      */
     void ( *OnDone )( int32_t status, uint8_t *file, uint32_t size );
 #endif
+    /*!
+     * Notifies that a fragmentation session was set up or deleted, the state
+     * returned by LmhpFragmentationGetNvmCtx changed. Optional, may be NULL
+     */
+    void ( *OnSessionChange )( void );
 }LmhpFragmentationParams_t;
 
 LmhPackage_t *LmhpFragmentationPackageFactory( void );
 
+/*!
+ * Tells whether a fragmentation session is still receiving fragments. The
+ * session whose OnDone callback is running is no longer counted.
+ *
+ * \retval ongoing Returns true if at least one session is ongoing
+ */
+bool LmhpFragmentationIsSessionOngoing( void );
+
+#if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
+/*!
+ * Returns a pointer to the fragmentation sessions state. Together with the
+ * decoder state it allows to resume an ongoing session after a reset.
+ *
+ * \param [OUT] fragmentationNvmCtxSize Size of the sessions state
+ *
+ * \retval ctx Points to the sessions state
+ */
+void* LmhpFragmentationGetNvmCtx( size_t* fragmentationNvmCtxSize );
+
+/*!
+ * Restores the fragmentation sessions and decoder states. The package must
+ * be initialized and the storage must be restored to the same point first.
+ *
+ * \param [IN] fragmentationNvmCtx     Sessions state to be restored
+ * \param [IN] fragmentationNvmCtxSize Size of the sessions state
+ * \param [IN] fragDecoderNvmCtx       Decoder states to be restored, one per
+ *                                     decoder session back to back, each of
+ *                                     the size FragDecoderGetNvmCtx returned
+ * \param [IN] fragDecoderNvmCtxSize   Size of the decoder states
+ *
+ * \retval status Returns true if both states were restored and a session is ongoing
+ */
+bool LmhpFragmentationRestoreNvmCtx( void* fragmentationNvmCtx, size_t fragmentationNvmCtxSize,
+                                     void* fragDecoderNvmCtx, size_t fragDecoderNvmCtxSize );
+#endif
+
 #endif // __LMHP_FRAGMENTATION_H__
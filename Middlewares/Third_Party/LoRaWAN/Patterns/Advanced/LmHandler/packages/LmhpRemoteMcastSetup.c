@@ -180,6 +180,32 @@ LmhPackage_t *LmhpRemoteMcastSetupPackageFactory( void )
     return &LmhpRemoteMcastSetupPackage;
 }
 
+void* LmhpRemoteMcastSetupGetNvmCtx( size_t* remoteMcastSetupNvmCtxSize )
+{
+    *remoteMcastSetupNvmCtxSize = sizeof( McSessionData );
+    return McSessionData;
+}
+
+bool LmhpRemoteMcastSetupRestoreNvmCtx( void* remoteMcastSetupNvmCtx, size_t remoteMcastSetupNvmCtxSize )
+{
+    if( ( LmhpRemoteMcastSetupState.Initialized == false ) || ( remoteMcastSetupNvmCtx == NULL ) ||
+        ( remoteMcastSetupNvmCtxSize != sizeof( McSessionData ) ) )
+    {
+        return false;
+    }
+    memcpy1( ( uint8_t* )McSessionData, ( uint8_t* )remoteMcastSetupNvmCtx, sizeof( McSessionData ) );
+
+    // The class C sessions are not started again: the RTC calendar is reset
+    // on every boot, so the session times cannot be compared with the system
+    // time until the clock is synchronized again. A new class C session
+    // request is needed to listen to the group again
+    for( uint8_t i = 0; i < LORAMAC_MAX_MC_CTX; i++ )
+    {
+        McSessionData[i].SessionTime = 0;
+    }
+    return true;
+}
+
 static void LmhpRemoteMcastSetupInit( void * params, uint8_t *dataBuffer, uint8_t dataBufferMaxSize )
 {
     if( dataBuffer != NULL )
@@ -409,8 +435,12 @@ static void OnSessionStartTimer( void *context )
         PRINTF( "Class C switch failed, rescheduled in 1 sec\r\n" );
     }
 
-    TimerSetValue( &SessionStopTimer, ( 1 << McSessionData[0].SessionTimeout ) * 1000 );
-    TimerStart( &SessionStopTimer );
+    // The session end is not pushed back by the retries
+    if( TimerIsStarted( &SessionStopTimer ) == false )
+    {
+        TimerSetValue( &SessionStopTimer, ( 1 << McSessionData[0].SessionTimeout ) * 1000 );
+        TimerStart( &SessionStopTimer );
+    }
 }
 
 static void OnSessionStopTimer( void *context )
@@ -418,5 +448,22 @@ static void OnSessionStopTimer( void *context )
     TimerStop( &SessionStopTimer );
 
     // Switch back to Class A
-    LmHandlerRequestClass( CLASS_A );
+    if( LmHandlerRequestClass( CLASS_A ) != LORAMAC_HANDLER_SUCCESS )
+    {
+        // Failed to switch to Class A, delay 1 sec and retry
+        TimerSetValue( &SessionStopTimer, 1000 );
+        TimerStart( &SessionStopTimer );
+        PRINTF( "Class A switch failed, rescheduled in 1 sec\r\n" );
+    }
+}
+
+void LmhpRemoteMcastSetupStopSession( void )
+{
+    if( LmhpRemoteMcastSetupState.Initialized == false )
+    {
+        return;
+    }
+    // Neither the session start nor its retries switch to Class C again
+    TimerStop( &SessionStartTimer );
+    OnSessionStopTimer( NULL );
 }
@@ -44,4 +44,34 @@
 
 LmhPackage_t *LmhpRemoteMcastSetupPackageFactory( void );
 
+/*!
+ * Returns a pointer to the multicast sessions state, so that the multicast
+ * groups can be restored after a reset.
+ *
+ * \param [OUT] remoteMcastSetupNvmCtxSize Size of the sessions state
+ *
+ * \retval ctx Points to the sessions state
+ */
+void* LmhpRemoteMcastSetupGetNvmCtx( size_t* remoteMcastSetupNvmCtxSize );
+
+/*!
+ * Restores the multicast sessions state. The package must be initialized.
+ * The class C sessions are not started again, as the system time does not
+ * survive a reset: the server has to send a new class C session request.
+ *
+ * \param [IN] remoteMcastSetupNvmCtx     Sessions state to be restored
+ * \param [IN] remoteMcastSetupNvmCtxSize Size of the sessions state
+ *
+ * \retval status Returns true if the sessions state is restored
+ */
+bool LmhpRemoteMcastSetupRestoreNvmCtx( void* remoteMcastSetupNvmCtx, size_t remoteMcastSetupNvmCtxSize );
+
+/*!
+ * Ends the class C session before its timeout, once the data it carries is
+ * no longer needed: the device switches back to class A right away instead
+ * of listening until the session timer expires. A session not started yet
+ * is cancelled.
+ */
+void LmhpRemoteMcastSetupStopSession( void );
+
 #endif // __LMHP_REMOTE_MCAST_SETUP_H__
@@ -33,6 +33,7 @@
 
 #include <stdio.h>
 #include "NvmCtxMgmt.h"
+#include "NvmJournal.h"
 #include "utilities.h"
 
 
@@ -41,13 +42,13 @@
  * Enables/Disables the context storage management storage at all. Must be enabled for LoRaWAN 1.1.x.
  * WARNING: Still under development and not tested yet.
  */
-#define CONTEXT_MANAGEMENT_ENABLED         0
+#define CONTEXT_MANAGEMENT_ENABLED         1
 
 /*!
  * Enables/Disables maximum persistent context storage management. All module contexts will be saved on a non-volatile memory.
  * WARNING: Still under development and not tested yet.
  */
-#define MAX_PERSISTENT_CTX_MGMT_ENABLED    0
+#define MAX_PERSISTENT_CTX_MGMT_ENABLED    1
 
 #if ( MAX_PERSISTENT_CTX_MGMT_ENABLED == 1 )
 #define NVM_CTX_STORAGE_MASK               0xFF
@@ -109,18 +110,41 @@ typedef union uLoRaMacCtxsUpdateInfo
 
 LoRaMacCtxUpdateStatus_t CtxUpdateStatus = { .Value = 0 };
 
-/*
- * Nvmm handles
+/*!
+ * \brief Writes a module context to the NVM journal, the module being the record id
+ *
+ * \param [IN] module  Context module
+ * \param [IN] ctx     Context
+ * \param [IN] size    Context size, 0 when the module is disabled
+ *
+ * \retval status      true if the context is stored
  */
-static NvmmDataBlock_t SecureElementNvmCtxDataBlock;
-static NvmmDataBlock_t CryptoNvmCtxDataBlock;
-#if ( MAX_PERSISTENT_CTX_MGMT_ENABLED == 1 )
-static NvmmDataBlock_t MacNvmCtxDataBlock;
-static NvmmDataBlock_t RegionNvmCtxDataBlock;
-static NvmmDataBlock_t CommandsNvmCtxDataBlock;
-static NvmmDataBlock_t ConfirmQueueNvmCtxDataBlock;
-static NvmmDataBlock_t ClassBNvmCtxDataBlock;
-#endif
+static bool NvmCtxWrite( LoRaMacNvmCtxModule_t module, void* ctx, size_t size )
+{
+    return NvmJournalWrite( ( uint8_t )module, ctx, ( uint16_t )size ) == NVM_JOURNAL_OK;
+}
+
+/*!
+ * \brief Gets a module context from the NVM journal. The context is left in
+ *        flash, the modules copy it when restored.
+ *
+ * \param [IN]  module  Context module
+ * \param [IN]  size    Expected context size
+ * \param [OUT] ctx     Stored context, NULL for an empty context
+ *
+ * \retval status       true if a context of this size is stored
+ */
+static bool NvmCtxRead( LoRaMacNvmCtxModule_t module, size_t size, void** ctx )
+{
+    const void* data;
+
+    if( NvmJournalGet( ( uint8_t )module, ( uint16_t )size, &data ) != NVM_JOURNAL_OK )
+    {
+        return false;
+    }
+    *ctx = ( size != 0 ) ? ( void* )data : NULL;
+    return true;
+}
 #endif
 
 void NvmCtxMgmtEvent( LoRaMacNvmCtxModule_t module )
@@ -179,6 +203,7 @@ NvmCtxMgmtStatus_t NvmCtxMgmtStore( void )
     mibReq.Type = MIB_NVM_CTXS;
     LoRaMacMibGetRequestConfirm( &mibReq );
     LoRaMacCtxs_t* MacContexts = mibReq.Param.Contexts;
+    NvmCtxMgmtStatus_t status = NVMCTXMGMT_STATUS_SUCCESS;
 
     // Input checks
     if( ( CtxUpdateStatus.Value & NVM_CTX_STORAGE_MASK ) == 0 )
@@ -193,68 +218,100 @@ NvmCtxMgmtStatus_t NvmCtxMgmtStore( void )
     // Write
     if( CtxUpdateStatus.Elements.Crypto == 1 )
     {
-        if( NvmmWrite( &CryptoNvmCtxDataBlock, MacContexts->CryptoNvmCtx, MacContexts->CryptoNvmCtxSize ) != NVMM_SUCCESS )
+        if( NvmCtxWrite( LORAMAC_NVMCTXMODULE_CRYPTO, MacContexts->CryptoNvmCtx, MacContexts->CryptoNvmCtxSize ) == false )
+        {
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+        else
         {
-            return NVMCTXMGMT_STATUS_FAIL;
+            CtxUpdateStatus.Elements.Crypto = 0;
         }
     }
 
     if( CtxUpdateStatus.Elements.SecureElement == 1 )
     {
-        if( NvmmWrite( &SecureElementNvmCtxDataBlock, MacContexts->SecureElementNvmCtx, MacContexts->SecureElementNvmCtxSize ) != NVMM_SUCCESS )
+        if( NvmCtxWrite( LORAMAC_NVMCTXMODULE_SECURE_ELEMENT, MacContexts->SecureElementNvmCtx, MacContexts->SecureElementNvmCtxSize ) == false )
         {
-            return NVMCTXMGMT_STATUS_FAIL;
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+        else
+        {
+            CtxUpdateStatus.Elements.SecureElement = 0;
         }
     }
 
 #if ( MAX_PERSISTENT_CTX_MGMT_ENABLED == 1 )
     if( CtxUpdateStatus.Elements.Mac == 1 )
     {
-        if( NvmmWrite( &MacNvmCtxDataBlock, MacContexts->MacNvmCtx, MacContexts->MacNvmCtxSize ) != NVMM_SUCCESS )
+        if( NvmCtxWrite( LORAMAC_NVMCTXMODULE_MAC, MacContexts->MacNvmCtx, MacContexts->MacNvmCtxSize ) == false )
+        {
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+        else
         {
-            return NVMCTXMGMT_STATUS_FAIL;
+            CtxUpdateStatus.Elements.Mac = 0;
         }
     }
 
     if( CtxUpdateStatus.Elements.Region == 1 )
     {
-        if( NvmmWrite( &RegionNvmCtxDataBlock, MacContexts->RegionNvmCtx, MacContexts->RegionNvmCtxSize ) != NVMM_SUCCESS )
+        if( NvmCtxWrite( LORAMAC_NVMCTXMODULE_REGION, MacContexts->RegionNvmCtx, MacContexts->RegionNvmCtxSize ) == false )
+        {
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+        else
         {
-            return NVMCTXMGMT_STATUS_FAIL;
+            CtxUpdateStatus.Elements.Region = 0;
         }
     }
 
     if( CtxUpdateStatus.Elements.Commands == 1 )
     {
-        if( NvmmWrite( &CommandsNvmCtxDataBlock, MacContexts->CommandsNvmCtx, MacContexts->CommandsNvmCtxSize ) != NVMM_SUCCESS )
+        if( NvmCtxWrite( LORAMAC_NVMCTXMODULE_COMMANDS, MacContexts->CommandsNvmCtx, MacContexts->CommandsNvmCtxSize ) == false )
         {
-            return NVMCTXMGMT_STATUS_FAIL;
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+        else
+        {
+            CtxUpdateStatus.Elements.Commands = 0;
         }
     }
 
     if( CtxUpdateStatus.Elements.ClassB == 1 )
     {
-        if( NvmmWrite( &ClassBNvmCtxDataBlock, MacContexts->ClassBNvmCtx, MacContexts->ClassBNvmCtxSize ) != NVMM_SUCCESS )
+        if( NvmCtxWrite( LORAMAC_NVMCTXMODULE_CLASS_B, MacContexts->ClassBNvmCtx, MacContexts->ClassBNvmCtxSize ) == false )
+        {
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+        else
         {
-            return NVMCTXMGMT_STATUS_FAIL;
+            CtxUpdateStatus.Elements.ClassB = 0;
         }
     }
 
     if( CtxUpdateStatus.Elements.ConfirmQueue == 1 )
     {
-        if( NvmmWrite( &ConfirmQueueNvmCtxDataBlock, MacContexts->ConfirmQueueNvmCtx, MacContexts->ConfirmQueueNvmCtxSize ) != NVMM_SUCCESS )
+        if( NvmCtxWrite( LORAMAC_NVMCTXMODULE_CONFIRM_QUEUE, MacContexts->ConfirmQueueNvmCtx, MacContexts->ConfirmQueueNvmCtxSize ) == false )
         {
-            return NVMCTXMGMT_STATUS_FAIL;
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+        else
+        {
+            CtxUpdateStatus.Elements.ConfirmQueue = 0;
         }
     }
 #endif
 
-    CtxUpdateStatus.Value = 0x00;
+    // Contexts failing to be stored are kept flagged and retried on next call
+    if( status == NVMCTXMGMT_STATUS_SUCCESS )
+    {
+        CtxUpdateStatus.Value = 0x00;
+    }
 
     // Resume LoRaMac
     LoRaMacStart( );
 
-    return NVMCTXMGMT_STATUS_SUCCESS;
+    return status;
 #else
     return NVMCTXMGMT_STATUS_FAIL;
 #endif
@@ -271,21 +328,8 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
     mibReq.Type = MIB_NVM_CTXS;
     LoRaMacMibGetRequestConfirm( &mibReq );
 
-
-    uint8_t NvmCryptoCtxRestore[mibReq.Param.Contexts->CryptoNvmCtxSize];
-    uint8_t NvmSecureElementCtxRestore[mibReq.Param.Contexts->SecureElementNvmCtxSize];
-#if ( MAX_PERSISTENT_CTX_MGMT_ENABLED == 1 )
-    uint8_t NvmMacCtxRestore[mibReq.Param.Contexts->MacNvmCtxSize];
-    uint8_t NvmRegionCtxRestore[mibReq.Param.Contexts->RegionNvmCtxSize];
-    uint8_t NvmCommandsCtxRestore[mibReq.Param.Contexts->CommandsNvmCtxSize];
-    uint8_t NvmClassBCtxRestore[mibReq.Param.Contexts->ClassBNvmCtxSize];
-    uint8_t NvmConfirmQueueCtxRestore[mibReq.Param.Contexts->ConfirmQueueNvmCtxSize];
-#endif
-
-    if ( NvmmDeclare( &CryptoNvmCtxDataBlock, mibReq.Param.Contexts->CryptoNvmCtxSize ) == NVMM_SUCCESS )
+    if( NvmCtxRead( LORAMAC_NVMCTXMODULE_CRYPTO, mibReq.Param.Contexts->CryptoNvmCtxSize, &contexts.CryptoNvmCtx ) == true )
     {
-        NvmmRead( &CryptoNvmCtxDataBlock, NvmCryptoCtxRestore, mibReq.Param.Contexts->CryptoNvmCtxSize );
-        contexts.CryptoNvmCtx = &NvmCryptoCtxRestore;
         contexts.CryptoNvmCtxSize = mibReq.Param.Contexts->CryptoNvmCtxSize;
     }
     else
@@ -293,10 +337,8 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
         status = NVMCTXMGMT_STATUS_FAIL;
     }
 
-    if ( NvmmDeclare( &SecureElementNvmCtxDataBlock, mibReq.Param.Contexts->SecureElementNvmCtxSize ) == NVMM_SUCCESS )
+    if( NvmCtxRead( LORAMAC_NVMCTXMODULE_SECURE_ELEMENT, mibReq.Param.Contexts->SecureElementNvmCtxSize, &contexts.SecureElementNvmCtx ) == true )
     {
-        NvmmRead( &SecureElementNvmCtxDataBlock, NvmSecureElementCtxRestore, mibReq.Param.Contexts->SecureElementNvmCtxSize );
-        contexts.SecureElementNvmCtx = &NvmSecureElementCtxRestore;
         contexts.SecureElementNvmCtxSize = mibReq.Param.Contexts->SecureElementNvmCtxSize;
     }
     else
@@ -305,10 +347,8 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
     }
 
 #if ( MAX_PERSISTENT_CTX_MGMT_ENABLED == 1 )
-    if( NvmmDeclare( &MacNvmCtxDataBlock, mibReq.Param.Contexts->MacNvmCtxSize ) == NVMM_SUCCESS )
+    if( NvmCtxRead( LORAMAC_NVMCTXMODULE_MAC, mibReq.Param.Contexts->MacNvmCtxSize, &contexts.MacNvmCtx ) == true )
     {
-        NvmmRead( &MacNvmCtxDataBlock, NvmMacCtxRestore, mibReq.Param.Contexts->MacNvmCtxSize );
-        contexts.MacNvmCtx = &NvmMacCtxRestore;
         contexts.MacNvmCtxSize = mibReq.Param.Contexts->MacNvmCtxSize;
     }
     else
@@ -316,10 +356,8 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
         status = NVMCTXMGMT_STATUS_FAIL;
     }
 
-    if ( NvmmDeclare( &RegionNvmCtxDataBlock, mibReq.Param.Contexts->RegionNvmCtxSize ) == NVMM_SUCCESS )
+    if( NvmCtxRead( LORAMAC_NVMCTXMODULE_REGION, mibReq.Param.Contexts->RegionNvmCtxSize, &contexts.RegionNvmCtx ) == true )
     {
-        NvmmRead( &RegionNvmCtxDataBlock, NvmRegionCtxRestore, mibReq.Param.Contexts->RegionNvmCtxSize );
-        contexts.RegionNvmCtx = &NvmRegionCtxRestore;
         contexts.RegionNvmCtxSize = mibReq.Param.Contexts->RegionNvmCtxSize;
     }
     else
@@ -327,10 +365,8 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
         status = NVMCTXMGMT_STATUS_FAIL;
     }
 
-    if ( NvmmDeclare( &CommandsNvmCtxDataBlock, mibReq.Param.Contexts->CommandsNvmCtxSize ) == NVMM_SUCCESS )
+    if( NvmCtxRead( LORAMAC_NVMCTXMODULE_COMMANDS, mibReq.Param.Contexts->CommandsNvmCtxSize, &contexts.CommandsNvmCtx ) == true )
     {
-        NvmmRead( &CommandsNvmCtxDataBlock, NvmCommandsCtxRestore, mibReq.Param.Contexts->CommandsNvmCtxSize );
-        contexts.CommandsNvmCtx = &NvmCommandsCtxRestore;
         contexts.CommandsNvmCtxSize = mibReq.Param.Contexts->CommandsNvmCtxSize;
     }
     else
@@ -338,10 +374,8 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
         status = NVMCTXMGMT_STATUS_FAIL;
     }
 
-    if ( NvmmDeclare( &ClassBNvmCtxDataBlock, mibReq.Param.Contexts->ClassBNvmCtxSize ) == NVMM_SUCCESS )
+    if( NvmCtxRead( LORAMAC_NVMCTXMODULE_CLASS_B, mibReq.Param.Contexts->ClassBNvmCtxSize, &contexts.ClassBNvmCtx ) == true )
     {
-        NvmmRead( &ClassBNvmCtxDataBlock, NvmClassBCtxRestore, mibReq.Param.Contexts->ClassBNvmCtxSize );
-        contexts.ClassBNvmCtx = &NvmClassBCtxRestore;
         contexts.ClassBNvmCtxSize = mibReq.Param.Contexts->ClassBNvmCtxSize;
     }
     else
@@ -349,10 +383,8 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
         status = NVMCTXMGMT_STATUS_FAIL;
     }
 
-    if ( NvmmDeclare( &ConfirmQueueNvmCtxDataBlock, mibReq.Param.Contexts->ConfirmQueueNvmCtxSize ) == NVMM_SUCCESS )
+    if( NvmCtxRead( LORAMAC_NVMCTXMODULE_CONFIRM_QUEUE, mibReq.Param.Contexts->ConfirmQueueNvmCtxSize, &contexts.ConfirmQueueNvmCtx ) == true )
     {
-        NvmmRead( &ConfirmQueueNvmCtxDataBlock, NvmConfirmQueueCtxRestore, mibReq.Param.Contexts->ConfirmQueueNvmCtxSize );
-        contexts.ConfirmQueueNvmCtx = &NvmConfirmQueueCtxRestore;
         contexts.ConfirmQueueNvmCtxSize = mibReq.Param.Contexts->ConfirmQueueNvmCtxSize;
     }
     else
@@ -361,17 +393,21 @@ NvmCtxMgmtStatus_t NvmCtxMgmtRestore( void )
     }
 #endif
 
-    // Enforce storing all contexts
-    if( status == NVMCTXMGMT_STATUS_FAIL )
-    {
-        CtxUpdateStatus.Value = 0xFF;
-        NvmCtxMgmtStore( );
-    }
-    else
+    if( status == NVMCTXMGMT_STATUS_SUCCESS )
     {  // If successful query the mac to restore contexts
         mibReq.Type = MIB_NVM_CTXS;
         mibReq.Param.Contexts = &contexts;
-        LoRaMacMibSetRequestConfirm( &mibReq );
+        if( LoRaMacMibSetRequestConfirm( &mibReq ) != LORAMAC_STATUS_OK )
+        {
+            status = NVMCTXMGMT_STATUS_FAIL;
+        }
+    }
+
+    // Enforce storing all contexts. This is deferred to the next NvmCtxMgmtStore
+    // call so that the keys and EUIs set up by the caller are stored as well.
+    if( status == NVMCTXMGMT_STATUS_FAIL )
+    {
+        CtxUpdateStatus.Value = 0xFF;
     }
 
     return status;
@@ -0,0 +1,69 @@
+/*  _        _   _ _ _ _
+   / \   ___| |_(_) (_) |_ _   _
+  / _ \ / __| __| | | | __| | | |
+ / ___ \ (__| |_| | | | |_| |_| |
+/_/   \_\___|\__|_|_|_|\__|\__, |
+                           |___/
+    (C)2020 Actility
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Description: CRC32 (CCITT - 0x04C11DB7, reflected) engines
+*/
+
+#ifndef __CRC32__
+#define __CRC32__
+
+#include "stdint.h"
+#include "stdbool.h"
+
+/*
+ * Available CRC32 engines:
+ * bitwise loop, no table, smallest and slowest
+ * slice by 4, 4 KB table in flash
+ * slice by 8, 8 KB table in flash
+ * STM32L4 CRC peripheral, no table. The peripheral is reconfigured
+ * on every crc32_update call so it must not be used from interrupts
+ * by anyone else.
+ */
+#define CRC32_ENGINE_BITWISE		1
+#define CRC32_ENGINE_SLICE_BY_4		4
+#define CRC32_ENGINE_SLICE_BY_8		8
+#define CRC32_ENGINE_HW				0
+
+#define CRC32_ENGINE				CRC32_ENGINE_SLICE_BY_8
+
+/*
+ * crc32_update runs the CRC32_ENGINE engine. The bitwise engine is
+ * always built as the reference of crc32_self_test; CRC32_ALL_ENGINES
+ * builds the table engines as well, so that a host check can compare
+ * them side by side. The peripheral engine only exists on the target.
+ */
+#if ( CRC32_ENGINE == CRC32_ENGINE_SLICE_BY_8 ) || defined( CRC32_ALL_ENGINES )
+#define CRC32_TABLE_NB				8
+#elif ( CRC32_ENGINE == CRC32_ENGINE_SLICE_BY_4 )
+#define CRC32_TABLE_NB				4
+#endif
+
+/*
+ * A CRC is computed by passing CRC32_INITIAL_VALUE and the data, in as
+ * many pieces as needed, to crc32_update and applying CRC32_FINAL
+ * to the result
+ */
+#define CRC32_INITIAL_VALUE			0xFFFFFFFF
+#define CRC32_FINAL(crc)			(~(crc))
+
+uint32_t crc32_update (uint32_t crc, const uint8_t *buf, uint32_t len);
+uint32_t crc32_compute (const uint8_t *buf, uint32_t len);
+bool	 crc32_self_test (void);
+
+uint32_t crc32_update_bitwise (uint32_t crc, const uint8_t *buf, uint32_t len);
+#if defined( CRC32_TABLE_NB )
+uint32_t crc32_update_slice4 (uint32_t crc, const uint8_t *buf, uint32_t len);
+#endif
+#if ( CRC32_TABLE_NB == 8 )
+uint32_t crc32_update_slice8 (uint32_t crc, const uint8_t *buf, uint32_t len);
+#endif
+#if ( CRC32_ENGINE == CRC32_ENGINE_HW )
+uint32_t crc32_update_hw (uint32_t crc, const uint8_t *buf, uint32_t len);
+#endif
+
+#endif /* __CRC32__ */
@@ -9,13 +9,20 @@ License: Revised BSD License, see LICENSE.TXT file include in the project
 Description: Flash API
 */
 
+#include "stddef.h"
 #include "string.h"
 #include "storage.h"
+#include "crc32.h"
 #include "sfu_app_new_image.h"
 #include "stm32l4xx_hal.h"
 #include "FragDecoder.h"
 #include "FlashMemHandler.h"
 #include "util_console.h"
+#include "mapping_export.h"
+#if ( ACTILITY_SMART_DELTA == 1 )
+#include "patch.h"
+#include "verify_signature.h"
+#endif
 //-----------------------------------------------------------------------------------------------
 static bool str_busy = false;
 static SFU_FwImageFlashTypeDef *fw_active_area_p = NULL;
@@ -25,10 +32,176 @@ static SFU_FwImageFlashTypeDef *fw_source_area_p = NULL;
 
 __attribute__((aligned (8))) static uint8_t ram_storage[RAM_STORAGE_SZ];
 
-static uint8_t dirty_pages[MAX_PAGES/8 + 1];
+/*
+ * RAM set by storage_set_ram, 32 bits aligned. storage_init takes the
+ * ready page bitmaps of the slots from its start, the datafile state
+ * is laid out in the rest by storage_datafile_init.
+ */
+static uint32_t *storage_ram = NULL;
+static uint32_t storage_ram_words = 0;
+
+#define BITMAP_WORDS(bits)	(((bits) + 31) / 32)
+
+static uint32_t page_erases = 0;
 
-static void dirty_pages_init (void);
+/*
+ * Runs of consecutive fragment slots, sorted and disjoint, with the CRC32
+ * register obtained from a zero register over their content. A fragment
+ * written right after a run extends it. The CRC of the whole datafile is
+ * folded from them by storage_crc32, only the slots they do not cover are
+ * read back. The runs stop before the last datafile row, whatever its
+ * padding, so that the last run is never read back.
+ */
+#define MAX_CRC_RUNS		STORAGE_MAX_CRC_RUNS
+
+typedef struct {
+	uint16_t first;
+	uint16_t nb;
+	uint32_t crc;
+} crc_run_t;
+
+static crc_run_t crc_runs[MAX_CRC_RUNS];
+static uint32_t crc_runs_nb = 0;
+/* Fragment size crc_runs and crc_shift were computed with, 0 if none */
+static uint32_t slot_crc_size = 0;
+/* Columns of the linear map shifting a CRC32 register over slot_crc_size zero bytes */
+static uint32_t crc_shift[32];
+
+/*
+ * Pages of a slot are erased in the background by storage_erase_slot_step
+ * once storage_slot_prepare is called, or on demand by prepare_page when
+ * they are about to be used. Bit n of ready_pages is set once page n is
+ * known to be erased or in use since then.
+ */
+static uint32_t *ready_pages[STORAGE_SLOT_SOURCE + 1];
+/* Pages of each slot, as given by its slot info */
+static uint32_t slot_pages[STORAGE_SLOT_SOURCE + 1];
+/* Next page of each slot to be checked by storage_erase_slot_step */
+static uint32_t erase_step_offset[STORAGE_SLOT_SOURCE + 1];
+
+/*
+ * A page rebuilt by datafile_scrub_slot is saved to the backup region
+ * first: its image fills the first page of the region and the second one
+ * starts with a header programmed once the image is complete, then zeroed
+ * once the page is rebuilt. A reset between the erase of the page and its
+ * rewrite is recovered from the backup on the next restore.
+ */
+#define BACKUP_IMAGE_ADDR	REGION_BACKUP_START
+#define BACKUP_HEADER_ADDR	(REGION_BACKUP_START + FLASH_PAGE_SIZE)
+
+typedef struct {
+	uint32_t pgaddr;	/* Address of the page being rebuilt */
+	uint32_t crc;		/* CRC32 of the image followed by pgaddr */
+} page_backup_t;
+
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+#if ( FRAG_DECODER_DEFERRED_SOLVE == 0 )
+#error "STORAGE_FULL_IMAGE_IN_PLACE requires FRAG_DECODER_DEFERRED_SOLVE"
+#endif
+
+typedef enum {
+  DATAFILE_UNDECIDED = 0,	/* datafile header not received yet */
+  DATAFILE_IN_SOURCE,		/* fragments in the source slot */
+  DATAFILE_IN_PLACE,		/* full image without holes in the scratch slot */
+} datafile_layout_t;
+#endif
+
+#if ( STORAGE_PACKED_DATAFILE == 1 )
+#if ( FRAG_DECODER_DEFERRED_SOLVE == 0 )
+#error "STORAGE_PACKED_DATAFILE requires FRAG_DECODER_DEFERRED_SOLVE"
+#endif
+/* Fragments are back to back in the source slot */
+#define SOURCE_ROW_PITCH(size)	(size)
+#else
+/* Fragments are padded to a double word multiple in the source slot */
+#define SOURCE_ROW_PITCH(size)	((((size) - 1) / 8 + 1) * 8)
+#endif
+
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 ) || ( STORAGE_PACKED_DATAFILE == 1 )
+#define DATAFILE_PENDING_DWS	1
+/*
+ * Double words shared by two fragments, one of them not received yet,
+ * for a session with a given number of lost fragments. Every lost
+ * fragment leaves at most two of them, plus the last one of each run of
+ * rows being written in sequence: the file, the deferred solve log and
+ * its reduced rows.
+ */
+#define DATAFILE_DWS(lost)	(2 * (uint32_t)(lost) + 3)
+
+typedef struct {
+  uint32_t dw;				/* double word index in the slot */
+  uint8_t slot;				/* source or scratch slot */
+  uint8_t data[8];
+  uint8_t mask;				/* bytes of data already received */
+} pending_dw_t;
+
+static storage_status_t packed_read (storage_slot_t slot, uint32_t offset, uint8_t *data, uint32_t len);
+#else
+#define DATAFILE_PENDING_DWS	0
+#define DATAFILE_DWS(lost)	0
+#endif
+
+#if ( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+/* Rows of a session with a given number of lost fragments: the file, the log and its reduced rows */
+#define DATAFILE_ROWS(frag_nb, lost)	((uint32_t)(frag_nb) + 2 * (uint32_t)(lost))
+#else
+#define DATAFILE_ROWS(frag_nb, lost)	((uint32_t)(frag_nb))
+#endif
+
+/*
+ * State of the datafile being received, saved by storage_datafile_get_ctx
+ * so that a session can be resumed after a reset. In the storage RAM, it
+ * is followed by the written_slots bitmap of its slots_nb fragment slots,
+ * then by pending_dws, of which only the pending_dws_nb first entries are
+ * saved.
+ */
+typedef struct {
+  uint32_t original_frag_size;
+  uint16_t frag_nb;
+  /* Fragment slots of the source slot tracked in written_slots */
+  uint16_t slots_nb;
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+  datafile_layout_t layout;
+  uint8_t frag_size;
+#endif
+#if ( DATAFILE_PENDING_DWS == 1 )
+  uint32_t pending_dws_nb;
+#endif
+} datafile_ctx_t;
+
+/* State used until storage_init lays one out in the storage RAM, it tracks no slot */
+static datafile_ctx_t datafile_none = {
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+  .layout = DATAFILE_IN_SOURCE,
+#endif
+};
+static datafile_ctx_t *datafile = &datafile_none;
+/* Bit n is set once fragment slot n was programmed since the last erase */
+static uint32_t *written_slots = NULL;
+#if ( DATAFILE_PENDING_DWS == 1 )
+static pending_dw_t *pending_dws = NULL;
+static uint32_t max_pending_dws = 0;
+#endif
+/* Storage RAM words left to the datafile state */
+static uint32_t datafile_words = 0;
+
+static uint32_t datafile_ctx_words (uint32_t slots_nb, uint32_t dws_nb);
+static void datafile_layout (uint16_t slots_nb);
+static void frag_slots_init (void);
+static bool slot_is_written (uint32_t slot);
+static bool page_is_blank(uint32_t pgaddr);
+static bool page_is_ready (storage_slot_t slot, uint32_t pg);
+static storage_status_t prepare_page (storage_slot_t slot, uint32_t start, uint32_t pg);
+static storage_status_t prepare_range (storage_slot_t slot, uint32_t offset, uint32_t len);
+static bool range_is_ready (storage_slot_t slot, uint32_t offset, uint32_t len);
 static bool flash_is_empty(const void *psrc, uint32_t len);
+static void slot_crc_update (uint32_t slot, const uint8_t *data, uint32_t size);
+static storage_status_t crc32_read (storage_slot_t slot, uint32_t offset, uint32_t length, uint32_t *crc);
+static HAL_StatusTypeDef write_page_skip_blank (uint32_t pgaddr, const uint8_t *buf, uint32_t len);
+static storage_status_t datafile_scrub_slot (storage_slot_t slot);
+static uint32_t page_backup_crc (uint32_t pgaddr);
+static storage_status_t page_backup_rebuild (uint32_t pgaddr, const uint8_t *image);
+static storage_status_t page_backup_recover (bool discard);
 
 //---------------------------------------------------------------------------------------------------------------
 __weak uint32_t storage_GetSourceAreaInfo(SFU_FwImageFlashTypeDef *pArea) {
@@ -36,11 +209,11 @@ __weak uint32_t storage_GetSourceAreaInfo(SFU_FwImageFlashTypeDef *pArea) {
 }
 //---------------------------------------------------------------------------------------------------------------
 /**
- * @brief Helper function to move full image with alignment holes from
- * 		  one slot to another.
- * @param src : Source image slot consisting of fragments aligned on double word
+ * @brief Helper function to move full image from one slot to another.
+ * @param src : Source image slot
  * @param dst : Destination image slot for image without alignment holes
  * @param size : Size of destination image
+ * @param flag : Read the source as a datafile, through storage_read_no_holes
  * @retval storage_status_t STR_OK on success, anything
  * 		  else on failure
  */
@@ -75,17 +248,252 @@ storage_status_t move_image(storage_slot_t src, storage_slot_t dst, uint32_t siz
 	return st;
 }
 
-void storage_datafile_init (void) {
+/**
+ * @brief Starts a new datafile. Nothing is erased here, the source and scratch
+ * 		  slots are prepared in the background by storage_erase_slot_step and
+ * 		  fragment writes only wait for the pages they target.
+ * @param frag_nb : Number of fragments of the datafile
+ * @param frag_size : Fragment size
+ */
+void storage_datafile_init (uint16_t frag_nb, uint8_t frag_size) {
+	int32_t max_lost = storage_datafile_max_lost(frag_nb, frag_size);
+
+	storage_slot_prepare(STORAGE_SLOT_SOURCE);
+	storage_slot_prepare(STORAGE_SLOT_SCRATCH);
+	datafile->original_frag_size = 0;
+	/* Only the rows the session can use are tracked */
+	datafile_layout(max_lost < 0 ? 0 : DATAFILE_ROWS(frag_nb, max_lost));
+	frag_slots_init();
+	page_erases = 0;
+	slot_crc_size = 0;
+	/* A backup left by an interrupted restore belongs to the previous session */
+	(void)page_backup_recover(true);
+	datafile->frag_nb = frag_nb;
+#if ( DATAFILE_PENDING_DWS == 1 )
+	datafile->pending_dws_nb = 0;
+#endif
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+	datafile->frag_size = frag_size;
+	/*
+	 * A fragment must cover both ends of the double words it shares
+	 * and the header must be in the file to decide on the layout
+	 */
+	if( frag_size >= 16 && (uint32_t)frag_nb * frag_size > HEADER_OFFSET + 8 ) {
+		datafile->layout = DATAFILE_UNDECIDED;
+	} else {
+		datafile->layout = DATAFILE_IN_SOURCE;
+	}
+#else
+	(void)frag_size;
+#endif
+}
+
+/**
+ * @brief Gives the storage RAM words a datafile state takes
+ * @param slots_nb : Fragment slots tracked in its bitmap
+ * @param dws_nb : Double words it can keep in RAM
+ */
+static uint32_t datafile_ctx_words (uint32_t slots_nb, uint32_t dws_nb) {
+
+#if ( DATAFILE_PENDING_DWS == 1 )
+	return sizeof(datafile_ctx_t) / 4 + BITMAP_WORDS(slots_nb) + dws_nb * sizeof(pending_dw_t) / 4;
+#else
+	(void)dws_nb;
+	return sizeof(datafile_ctx_t) / 4 + BITMAP_WORDS(slots_nb);
+#endif
+}
+
+/**
+ * @brief Lays the bitmap of the datafile fragment slots out after the
+ * 		  datafile state, the double words kept in RAM take the rest of
+ * 		  the storage RAM
+ * @param slots_nb : Fragment slots tracked
+ */
+static void datafile_layout (uint16_t slots_nb) {
+
+	if( datafile == &datafile_none ) {
+		return;
+	}
+	datafile->slots_nb = slots_nb;
+	written_slots = (uint32_t *)(datafile + 1);
+#if ( DATAFILE_PENDING_DWS == 1 )
+	pending_dws = (pending_dw_t *)(written_slots + BITMAP_WORDS(slots_nb));
+	max_pending_dws = (datafile_words - datafile_ctx_words(slots_nb, 0)) * 4 / sizeof(pending_dw_t);
+#endif
+}
+
+/**
+ * @brief Gives the number of lost fragments a datafile can be decoded
+ * 		  with in the source slot. The datafile rows and the ones of the
+ * 		  deferred solve must all fit the slot, and the storage RAM must
+ * 		  hold their bitmap and the double words they leave in RAM.
+ * @param frag_nb : Number of fragments of the datafile
+ * @param frag_size : Fragment size
+ * @retval Number of lost fragments, -1 if the datafile doesn't fit
+ */
+int32_t storage_datafile_max_lost (uint16_t frag_nb, uint8_t frag_size) {
+	uint32_t len, rows;
+	int32_t max_lost;
+
+	if( frag_size == 0 || frag_size > FRAG_MAX_SIZE || storage_get_slot_info(STORAGE_SLOT_SOURCE, NULL, &len) != STR_OK ) {
+		return -1;
+	}
+	rows = len / SOURCE_ROW_PITCH(frag_size);
+	if( rows > UINT16_MAX ) {
+		rows = UINT16_MAX;
+	}
+	if( rows < frag_nb || datafile_ctx_words(DATAFILE_ROWS(frag_nb, 0), DATAFILE_DWS(0)) > datafile_words ) {
+		return -1;
+	}
+#if ( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+	/* The deferred solve log and its reduced rows follow the datafile */
+	for( max_lost = 0; max_lost < (int32_t)(rows - frag_nb) / 2
+			&& datafile_ctx_words(DATAFILE_ROWS(frag_nb, max_lost + 1), DATAFILE_DWS(max_lost + 1)) <= datafile_words; max_lost++ ) {
+	}
+#else
+	max_lost = frag_nb;
+#endif
+	return max_lost;
+}
 
-	storage_erase_slot(STORAGE_SLOT_SOURCE);
-	dirty_pages_init();
+/**
+ * @brief Tells whether the datafile of the current session was decoded
+ * 		  in place in the scratch slot. It is then read back from there
+ * 		  through the STORAGE_SLOT_SOURCE datafile accessors.
+ */
+bool storage_datafile_in_place (void) {
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+	return datafile->layout == DATAFILE_IN_PLACE;
+#else
+	return false;
+#endif
+}
+
+/**
+ * @brief Gets the state of the datafile being received, to be saved with
+ * 		  the fragmentation decoder state so that the session can be resumed
+ * @param size : Size of the state
+ * @retval Pointer to the state
+ */
+const void *storage_datafile_get_ctx (uint32_t *size) {
+
+	*size = sizeof(datafile_ctx_t) + BITMAP_WORDS(datafile->slots_nb) * sizeof(uint32_t);
+#if ( DATAFILE_PENDING_DWS == 1 )
+	*size += datafile->pending_dws_nb * sizeof(pending_dw_t);
+#endif
+	return datafile;
+}
+
+/**
+ * @brief Resumes the datafile of a session interrupted by a reset, from a
+ * 		  state returned by storage_datafile_get_ctx. Fragments written
+ * 		  after the state was saved are wiped from the source and scratch
+ * 		  slots so that their slots can be programmed again, the pages not
+ * 		  used yet are left to the background erase. The slot CRCs are
+ * 		  computed again from the fragments kept.
+ * @param ctx : Saved state
+ * @param size : Size of the saved state
+ * @retval storage_status_t STR_OK on success, anything else on failure
+ */
+storage_status_t storage_datafile_restore_ctx (const void *ctx, uint32_t size) {
+	__attribute__((aligned (8))) uint8_t frag_buf[FRAG_MAX_SIZE];
+	const datafile_ctx_t *saved = (const datafile_ctx_t *)ctx;
+	storage_status_t st;
+	uint32_t slot;
+
+	uint32_t bitmap_size;
+
+	if( datafile == &datafile_none || size < sizeof(datafile_ctx_t) ) {
+		return STR_BAD_LEN;
+	}
+	/* The state must fit the storage RAM as laid out for a new session */
+	bitmap_size = BITMAP_WORDS(saved->slots_nb) * sizeof(uint32_t);
+#if ( DATAFILE_PENDING_DWS == 1 )
+	const pending_dw_t *saved_dws = (const pending_dw_t *)((const uint8_t *)ctx + sizeof(datafile_ctx_t) + bitmap_size);
+
+	if( size != sizeof(datafile_ctx_t) + bitmap_size + saved->pending_dws_nb * sizeof(pending_dw_t) ) {
+		return STR_BAD_LEN;
+	}
+	for( slot = 0; slot < saved->pending_dws_nb; slot++ ) {
+		if( saved_dws[slot].slot != STORAGE_SLOT_SOURCE && saved_dws[slot].slot != STORAGE_SLOT_SCRATCH ) {
+			return STR_INCONSISTENCY;
+		}
+	}
+#else
+	if( size != sizeof(datafile_ctx_t) + bitmap_size ) {
+		return STR_BAD_LEN;
+	}
+#endif
+	if( saved->original_frag_size > FRAG_MAX_SIZE
+			|| datafile_ctx_words(saved->slots_nb, DATAFILE_DWS(0)) > datafile_words
+			|| size > datafile_words * 4 ) {
+		return STR_INCONSISTENCY;
+	}
+	memcpy(datafile, saved, size);
+	datafile_layout(datafile->slots_nb);
+	page_erases = 0;
+	slot_crc_size = 0;
+	storage_slot_prepare(STORAGE_SLOT_SOURCE);
+	storage_slot_prepare(STORAGE_SLOT_SCRATCH);
+	if( (st = page_backup_recover(false)) != STR_OK
+			|| (st = datafile_scrub_slot(STORAGE_SLOT_SOURCE)) != STR_OK
+			|| (st = datafile_scrub_slot(STORAGE_SLOT_SCRATCH)) != STR_OK ) {
+		return st;
+	}
+	for( slot = 0; slot < datafile->slots_nb && datafile->original_frag_size != 0; slot++ ) {
+		if( slot_is_written(slot) ) {
+			if( FragDecoderActilityRead(slot * datafile->original_frag_size, frag_buf, datafile->original_frag_size) != 0 ) {
+				return STR_HAL_ERR;
+			}
+			slot_crc_update(slot, frag_buf, datafile->original_frag_size);
+		}
+	}
+	return STR_OK;
+}
+
+/**
+ * @brief Number of pages erased by FragDecoderActilityWrite since
+ * 		  the last storage_datafile_init. Each one is a full page
+ * 		  read->erase->write cycle. Always 0 with the packed layout,
+ * 		  where fragments are never rewritten.
+ */
+uint32_t storage_get_page_erase_count (void) {
+	return page_erases;
+}
+
+/**
+ * @brief Gives the storage the RAM it tracks the slot pages and the datafile
+ * 		  state in, to be called before storage_init. The fragment slots a
+ * 		  datafile can use and the lost fragments it can be decoded with
+ * 		  are bounded by its size.
+ * @param ram : RAM, NULL to withdraw it
+ * @param size : Size in bytes
+ */
+void storage_set_ram (void *ram, uint32_t size) {
+	uintptr_t start = ((uintptr_t)ram + 3) & ~(uintptr_t)3;
+
+	if( ram == NULL || start - (uintptr_t)ram >= size ) {
+		storage_ram = NULL;
+		storage_ram_words = 0;
+	} else {
+		storage_ram = (uint32_t *)start;
+		storage_ram_words = (size - (start - (uintptr_t)ram)) / 4;
+	}
+	datafile = &datafile_none;
+	written_slots = NULL;
+#if ( DATAFILE_PENDING_DWS == 1 )
+	pending_dws = NULL;
+	max_pending_dws = 0;
+#endif
+	datafile_words = 0;
 }
 
 storage_status_t storage_init(void) {
     STORAGE_RESOURCE_TAKE();
     storage_status_t str_st = STR_OK;
 
-    uint32_t rc;
+    uint32_t rc, slot, words;
+    uint32_t *p;
     static SFU_FwImageFlashTypeDef fw_active_area;
     static SFU_FwImageFlashTypeDef fw_newimg_area;
     static SFU_FwImageFlashTypeDef fw_scratch_area;
@@ -116,6 +524,32 @@ storage_status_t storage_init(void) {
         str_st = STR_HAL_ERR;
         goto storage_init_err;
     }
+    slot_pages[STORAGE_SLOT_ACTIVE] = (fw_active_area.MaxSizeInBytes + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    slot_pages[STORAGE_SLOT_NEWIMG] = (fw_newimg_area.MaxSizeInBytes + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    slot_pages[STORAGE_SLOT_SCRATCH] = (fw_scratch_area.MaxSizeInBytes + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    slot_pages[STORAGE_SLOT_SOURCE] = (fw_source_area.MaxSizeInBytes + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+    /* The ready page bitmaps first, then the datafile state */
+    for( words = 0, slot = STORAGE_SLOT_ACTIVE; slot <= STORAGE_SLOT_SOURCE; slot++ ) {
+        words += BITMAP_WORDS(slot_pages[slot]);
+    }
+    if( storage_ram == NULL || words + datafile_ctx_words(0, DATAFILE_DWS(0)) > storage_ram_words ) {
+        str_st = STR_NOMEM;
+        goto storage_init_err;
+    }
+    for( p = storage_ram, slot = STORAGE_SLOT_ACTIVE; slot <= STORAGE_SLOT_SOURCE; slot++ ) {
+        ready_pages[slot] = p;
+        memset(ready_pages[slot], 0, BITMAP_WORDS(slot_pages[slot]) * sizeof(uint32_t));
+        p += BITMAP_WORDS(slot_pages[slot]);
+    }
+    datafile = (datafile_ctx_t *)p;
+    datafile_words = storage_ram_words - words;
+    memset(datafile, 0, sizeof(datafile_ctx_t));
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+    datafile->layout = DATAFILE_IN_SOURCE;
+#endif
+    datafile_layout(0);
+    /* No background erase until a slot is prepared */
+    memset(erase_step_offset, 0xFF, sizeof(erase_step_offset));
     (void)rc;   // avoid warnings 
     fw_active_area_p = &fw_active_area;
     fw_newimg_area_p = &fw_newimg_area;
@@ -348,11 +782,30 @@ storage_status_t storage_erase_slot(storage_slot_t slot) {
       goto storage_erase_slot_err;
     }
 
-    HAL_StatusTypeDef rc;
-    if ((rc = FlashMemHandlerFct.Erase_Size((void *)area_p->DownloadAddr, area_p->MaxSizeInBytes)) != HAL_OK) {
-    	str_st = STR_HAL_ERR;
+    /*
+     * Only erase the runs of pages which are not blank already, a slot
+     * prepared with storage_erase_slot_step costs a read only
+     */
+    uint32_t pos, start;
+    for( pos = 0; pos < area_p->MaxSizeInBytes; ) {
+    	while( pos < area_p->MaxSizeInBytes && page_is_blank(area_p->DownloadAddr + pos) ) {
+    		pos += FLASH_PAGE_SIZE;
+    	}
+    	start = pos;
+    	while( pos < area_p->MaxSizeInBytes && !page_is_blank(area_p->DownloadAddr + pos) ) {
+    		pos += FLASH_PAGE_SIZE;
+    	}
+    	if( pos > start
+    			&& FlashMemHandlerFct.Erase_Size((void *)(area_p->DownloadAddr + start), pos - start) != HAL_OK ) {
+    		str_st = STR_HAL_ERR;
+    		break;
+    	}
+    }
+    if( str_st == STR_OK && slot <= STORAGE_SLOT_SOURCE ) {
+    	/* The whole slot is ready, nothing left for the background erase */
+    	memset(ready_pages[slot], 0xFF, BITMAP_WORDS(slot_pages[slot]) * sizeof(uint32_t));
+    	erase_step_offset[slot] = area_p->MaxSizeInBytes;
     }
-    (void)rc;  // avoid warnings 
     
 storage_erase_slot_err:
 
@@ -360,18 +813,84 @@ storage_erase_slot_err:
     return str_st;
 }
 //-----------------------------------------------------------------------------------------------
+/**
+ * @brief Erases at most one page of a slot being prepared, to be called while
+ * 		  the MCU is idle. The pages are handled in order, blank ones and
+ * 		  the ones already prepared on demand are skipped.
+ * @param slot : Slot to prepare
+ * @retval STR_OK while pages remain, STR_BAD_OFFSET once the whole slot
+ * 		  was handled, anything else on failure
+ */
+storage_status_t storage_erase_slot_step(storage_slot_t slot) {
+	storage_status_t str_st;
+	uint32_t start, len, pg;
+
+	if( (str_st = storage_get_slot_info(slot, &start, &len)) != STR_OK ) {
+		return str_st;
+	}
+	STORAGE_RESOURCE_TAKE();
+	while( erase_step_offset[slot] < len && page_is_ready(slot, erase_step_offset[slot] / FLASH_PAGE_SIZE) ) {
+		erase_step_offset[slot] += FLASH_PAGE_SIZE;
+	}
+	if( erase_step_offset[slot] >= len ) {
+		str_st = STR_BAD_OFFSET;
+	} else {
+		pg = erase_step_offset[slot] / FLASH_PAGE_SIZE;
+		erase_step_offset[slot] += FLASH_PAGE_SIZE;
+		str_st = prepare_page(slot, start, pg);
+	}
+	STORAGE_RESOURCE_GIVE();
+	return str_st;
+}
+
+/**
+ * @brief Starts preparing a slot: none of its pages is considered erased
+ * 		  any more and storage_erase_slot_step erases them from the start
+ * @param slot : Slot to prepare, STORAGE_SLOT_SCRATCH or STORAGE_SLOT_SOURCE
+ */
+void storage_slot_prepare (storage_slot_t slot) {
 
-static void dirty_pages_init (void) {
-	memset(dirty_pages, 0, sizeof(dirty_pages));
+	if( slot > STORAGE_SLOT_SOURCE ) {
+		return;
+	}
+	if( ready_pages[slot] == NULL ) {
+		return;
+	}
+	memset(ready_pages[slot], 0, BITMAP_WORDS(slot_pages[slot]) * sizeof(uint32_t));
+	erase_step_offset[slot] = 0;
 }
 
-static void mark_page_dirty (uint32_t pg) {
-	dirty_pages[ pg / 8 ] |= 1 << (pg % 8);
+/**
+ * @brief Tells whether the page holding an offset of a slot being prepared
+ * 		  is erased or already in use
+ * @param slot : Slot being prepared
+ * @param offset : Offset in the slot
+ */
+bool storage_page_is_ready (storage_slot_t slot, uint32_t offset) {
+
+	if( slot > STORAGE_SLOT_SOURCE ) {
+		return false;
+	}
+	return page_is_ready(slot, offset / FLASH_PAGE_SIZE);
 }
+//-----------------------------------------------------------------------------------------------
 
-static bool page_is_dirty (uint32_t pg) {
+static void frag_slots_init (void) {
+	if( written_slots != NULL ) {
+		memset(written_slots, 0, BITMAP_WORDS(datafile->slots_nb) * sizeof(uint32_t));
+	}
+}
 
-	return (dirty_pages[ pg / 8 ] & (1 << (pg % 8))) != 0 ? true : false;
+static void mark_slot_written (uint32_t slot) {
+	written_slots[ slot / 32 ] |= 1UL << (slot % 32);
+}
+
+static bool slot_is_written (uint32_t slot) {
+	/* FragDecoderActilityWrite refuses the slots out of the tracked range */
+	if( slot >= datafile->slots_nb ) {
+		return false;
+	}
+	return (written_slots[ slot / 32 ] & (1UL << (slot % 32))) != 0 ? true : false;
 }
 
 static bool flash_is_empty(const void *psrc, uint32_t len) {
@@ -383,126 +902,702 @@ static bool flash_is_empty(const void *psrc, uint32_t len) {
   return true;
 }
 
-static uint32_t original_frag_size = 0;
+static bool page_is_ready (storage_slot_t slot, uint32_t pg) {
+	if( pg >= slot_pages[ slot ] ) {
+		return false;
+	}
+	return (ready_pages[ slot ][ pg / 32 ] & (1UL << (pg % 32))) != 0 ? true : false;
+}
+
+/**
+ * @brief Erases a page of a slot being prepared, unless it is blank or
+ * 		  already prepared, and marks it ready
+ * @param slot : Slot being prepared
+ * @param start : Slot start address
+ * @param pg : Page index in the slot
+ */
+static storage_status_t prepare_page (storage_slot_t slot, uint32_t start, uint32_t pg) {
+	if( pg >= slot_pages[ slot ] ) {
+		return STR_BAD_OFFSET;
+	}
+	if( !page_is_ready(slot, pg) ) {
+		if( !page_is_blank(start + pg * FLASH_PAGE_SIZE)
+				&& FlashMemHandlerFct.Erase_Size((void *)(start + pg * FLASH_PAGE_SIZE), FLASH_PAGE_SIZE) != HAL_OK ) {
+			return STR_HAL_ERR;
+		}
+		ready_pages[ slot ][ pg / 32 ] |= 1UL << (pg % 32);
+	}
+	return STR_OK;
+}
+
+/**
+ * @brief Prepares the pages of a slot a range of bytes is about to use
+ */
+static storage_status_t prepare_range (storage_slot_t slot, uint32_t offset, uint32_t len) {
+	storage_status_t st;
+	uint32_t start, pg;
+
+	if( (st = storage_get_slot_info(slot, &start, NULL)) != STR_OK ) {
+		return st;
+	}
+	for( pg = offset / FLASH_PAGE_SIZE; pg <= (offset + len - 1) / FLASH_PAGE_SIZE; pg++ ) {
+		if( (st = prepare_page(slot, start, pg)) != STR_OK ) {
+			return st;
+		}
+	}
+	return STR_OK;
+}
+
+/**
+ * @brief Tells whether all the pages a range of bytes of a slot spans are
+ * 		  prepared. Unlike prepare_range it never erases, for the read paths.
+ */
+static bool range_is_ready (storage_slot_t slot, uint32_t offset, uint32_t len) {
+	uint32_t pg;
+
+	for( pg = offset / FLASH_PAGE_SIZE; pg <= (offset + len - 1) / FLASH_PAGE_SIZE; pg++ ) {
+		if( !page_is_ready(slot, pg) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Tells whether a double word of a slot holds data of the current
+ * 		  datafile state. In place or packed, a double word shared by two
+ * 		  fragments is only programmed once both are received.
+ * @param slot : Source or scratch slot
+ * @param offset : Double word offset in the slot
+ */
+static bool datafile_dw_is_written (storage_slot_t slot, uint32_t offset) {
+	uint32_t pitch, row;
+
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+	if( slot == STORAGE_SLOT_SCRATCH && datafile->layout == DATAFILE_IN_PLACE ) {
+		for( row = offset / datafile->frag_size; row <= (offset + 7) / datafile->frag_size; row++ ) {
+			if( row >= datafile->frag_nb || !slot_is_written(row) ) {
+				return false;
+			}
+		}
+		return true;
+	}
+#endif
+	if( slot != STORAGE_SLOT_SOURCE || datafile->original_frag_size == 0 ) {
+		return false;
+	}
+	pitch = SOURCE_ROW_PITCH(datafile->original_frag_size);
+#if ( STORAGE_PACKED_DATAFILE == 1 )
+	for( row = offset / pitch; row <= (offset + 7) / pitch; row++ ) {
+		if( !slot_is_written(row) ) {
+			return false;
+		}
+	}
+	return true;
+#else
+	row = offset / pitch;
+	return slot_is_written(row);
+#endif
+}
+
+/**
+ * @brief Brings the pages of a slot holding data of the datafile state back
+ * 		  to that state and marks them ready. The double words written since
+ * 		  the state was saved are erased with a read->erase->write cycle, they
+ * 		  may even have been left half programmed by a reset.
+ * @param slot : Source or scratch slot
+ */
+static storage_status_t datafile_scrub_slot (storage_slot_t slot) {
+	uint32_t start, len, pg, pos;
+	uint8_t * ram_buf;
+	uint64_t dw;
+	bool used, changed;
+
+	if( storage_get_slot_info(slot, &start, &len) != STR_OK || storage_get_rambuf(&ram_buf) < FLASH_PAGE_SIZE ) {
+		return STR_INCONSISTENCY;
+	}
+	for( pg = 0; pg < len / FLASH_PAGE_SIZE; pg++ ) {
+		used = false;
+		for( pos = 0; pos < FLASH_PAGE_SIZE && !used; pos += 8 ) {
+			used = datafile_dw_is_written(slot, pg * FLASH_PAGE_SIZE + pos);
+		}
+		if( !used ) {
+			/* Left to storage_erase_slot_step or prepare_page */
+			continue;
+		}
+		changed = false;
+		for( pos = 0; pos < FLASH_PAGE_SIZE; pos += 8 ) {
+			if( datafile_dw_is_written(slot, pg * FLASH_PAGE_SIZE + pos) ) {
+				if( FlashMemHandlerFct.Read((void *)(start + pg * FLASH_PAGE_SIZE + pos), ram_buf + pos, 8) != HAL_OK ) {
+					return STR_HAL_ERR;
+				}
+			} else {
+				/* A double word with an ECC error is not blank either */
+				if( FlashMemHandlerFct.Read((void *)(start + pg * FLASH_PAGE_SIZE + pos), &dw, 8) != HAL_OK || dw != ~0ULL ) {
+					changed = true;
+				}
+				memset(ram_buf + pos, FLASH_BLANK_BYTE, 8);
+			}
+		}
+		if( changed && page_backup_rebuild(start + pg * FLASH_PAGE_SIZE, ram_buf) != STR_OK ) {
+			return STR_HAL_ERR;
+		}
+		ready_pages[ slot ][ pg / 32 ] |= 1UL << (pg % 32);
+	}
+	return STR_OK;
+}
+
+/**
+ * @brief CRC32 of the image in the backup region followed by the address
+ * 		  of the page it belongs to
+ */
+static uint32_t page_backup_crc (uint32_t pgaddr) {
+	uint32_t crc;
+
+	crc = crc32_update(CRC32_INITIAL_VALUE, (const uint8_t *)BACKUP_IMAGE_ADDR, FLASH_PAGE_SIZE);
+	crc = crc32_update(crc, (const uint8_t *)&pgaddr, sizeof(pgaddr));
+	return CRC32_FINAL(crc);
+}
+
+/**
+ * @brief Erases a page and programs it back from an image in RAM. The image
+ * 		  is saved to the backup region first, so that the rows it holds are
+ * 		  never only in RAM.
+ * @param pgaddr : Address of the page
+ * @param image : Page image, FLASH_PAGE_SIZE bytes
+ */
+static storage_status_t page_backup_rebuild (uint32_t pgaddr, const uint8_t *image) {
+	const uint64_t zero = 0;
+	page_backup_t hdr;
+
+	if( (!page_is_blank(BACKUP_IMAGE_ADDR)
+			&& FlashMemHandlerFct.Erase_Size((void *)BACKUP_IMAGE_ADDR, FLASH_PAGE_SIZE) != HAL_OK)
+			|| (!page_is_blank(BACKUP_HEADER_ADDR)
+			&& FlashMemHandlerFct.Erase_Size((void *)BACKUP_HEADER_ADDR, FLASH_PAGE_SIZE) != HAL_OK)
+			|| write_page_skip_blank(BACKUP_IMAGE_ADDR, image, FLASH_PAGE_SIZE) != HAL_OK ) {
+		return STR_HAL_ERR;
+	}
+	/* The header commits the backup, the page can then be erased */
+	hdr.pgaddr = pgaddr;
+	hdr.crc = page_backup_crc(pgaddr);
+	if( FlashMemHandlerFct.Write((void *)BACKUP_HEADER_ADDR, &hdr, sizeof(hdr)) != HAL_OK
+			|| FlashMemHandlerFct.Erase_Size((void *)pgaddr, FLASH_PAGE_SIZE) != HAL_OK
+			|| write_page_skip_blank(pgaddr, image, FLASH_PAGE_SIZE) != HAL_OK
+			|| FlashMemHandlerFct.Write((void *)BACKUP_HEADER_ADDR, &zero, sizeof(zero)) != HAL_OK ) {
+		return STR_HAL_ERR;
+	}
+	return STR_OK;
+}
+
+/**
+ * @brief Completes or discards the rebuild of a page interrupted by a reset.
+ * 		  A header that can't be read or doesn't match the image was left by
+ * 		  a reset before the page was erased or after it was rebuilt.
+ * @param discard : Invalidates the backup instead of rebuilding the page
+ */
+static storage_status_t page_backup_recover (bool discard) {
+	const uint64_t zero = 0;
+	uint32_t slot, start, len;
+	page_backup_t hdr;
+	uint8_t * ram_buf;
+	bool found = false;
+
+	if( FlashMemHandlerFct.Read((void *)BACKUP_HEADER_ADDR, &hdr, sizeof(hdr)) != HAL_OK
+			|| hdr.crc != page_backup_crc(hdr.pgaddr) || (hdr.pgaddr % FLASH_PAGE_SIZE) != 0 ) {
+		return STR_OK;
+	}
+	/* Only a page of the source or scratch slots can be rebuilt */
+	for( slot = STORAGE_SLOT_SCRATCH; slot <= STORAGE_SLOT_SOURCE; slot++ ) {
+		if( storage_get_slot_info((storage_slot_t)slot, &start, &len) == STR_OK && hdr.pgaddr >= start && hdr.pgaddr - start < len ) {
+			found = true;
+		}
+	}
+	if( found && !discard ) {
+		if( storage_get_rambuf(&ram_buf) < FLASH_PAGE_SIZE ) {
+			return STR_INCONSISTENCY;
+		}
+		memcpy(ram_buf, (const void *)BACKUP_IMAGE_ADDR, FLASH_PAGE_SIZE);
+		if( FlashMemHandlerFct.Erase_Size((void *)hdr.pgaddr, FLASH_PAGE_SIZE) != HAL_OK
+				|| write_page_skip_blank(hdr.pgaddr, ram_buf, FLASH_PAGE_SIZE) != HAL_OK ) {
+			return STR_HAL_ERR;
+		}
+	}
+	if( FlashMemHandlerFct.Write((void *)BACKUP_HEADER_ADDR, &zero, sizeof(zero)) != HAL_OK ) {
+		return STR_HAL_ERR;
+	}
+	return STR_OK;
+}
+
+static bool page_is_blank(uint32_t pgaddr) {
+  const uint32_t *p = (const uint32_t *)pgaddr;
+
+  for(uint32_t i = 0; i < FLASH_PAGE_SIZE / 4; i++) {
+    if(p[i] != 0xFFFFFFFF) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Records the content of a fragment slot in the CRC runs
+ * @param slot : Fragment slot
+ * @param data : Fragment written to the slot
+ * @param size : Fragment size
+ */
+static void slot_crc_update (uint32_t slot, const uint8_t *data, uint32_t size) {
+	uint32_t i;
+
+	/*
+	 * The last datafile row may be partial, it is read back. The rows of
+	 * the deferred solve following the datafile are not part of its CRC.
+	 */
+	if( slot >= datafile->slots_nb || slot + 1 >= datafile->frag_nb ) {
+		return;
+	}
+	if( size != slot_crc_size ) {
+		/* Column j is the register obtained from bit j alone after size zero bytes */
+		for( uint32_t j = 0; j < 32; j++ ) {
+			uint32_t crc = 1UL << j;
+			for( i = 0; i < size * 8; i++ ) {
+				crc = (crc >> 1) ^ (0xEDB88320 & ~((crc & 0x01) - 1));
+			}
+			crc_shift[j] = crc;
+		}
+		slot_crc_size = size;
+		crc_runs_nb = 0;
+	}
+	/* Fragments mostly come in order, look for the last run starting at or before the slot */
+	for( i = crc_runs_nb; i > 0 && crc_runs[i - 1].first > slot; i-- ) {
+	}
+	if( i > 0 && slot < crc_runs[i - 1].first + crc_runs[i - 1].nb ) {
+		/* A rewritten slot can't be taken out of the run register, the run is read back instead */
+		i--;
+		crc_runs_nb--;
+		memmove(&crc_runs[i], &crc_runs[i + 1], (crc_runs_nb - i) * sizeof(crc_run_t));
+	} else if( i > 0 && slot == crc_runs[i - 1].first + crc_runs[i - 1].nb ) {
+		crc_runs[i - 1].crc = crc32_update(crc_runs[i - 1].crc, data, size);
+		crc_runs[i - 1].nb++;
+		return;
+	}
+	if( crc_runs_nb == MAX_CRC_RUNS ) {
+		return;
+	}
+	memmove(&crc_runs[i + 1], &crc_runs[i], (crc_runs_nb - i) * sizeof(crc_run_t));
+	crc_runs[i].first = slot;
+	crc_runs[i].nb = 1;
+	crc_runs[i].crc = crc32_update(0, data, size);
+	crc_runs_nb++;
+}
+
+/**
+ * @brief Shifts a CRC32 register over slot_crc_size zero bytes
+ */
+static uint32_t crc32_shift_slot (uint32_t crc) {
+	uint32_t res = 0;
+
+	for( uint32_t j = 0; j < 32; j++, crc >>= 1 ) {
+		res ^= crc_shift[j] & (0 - (crc & 0x01));
+	}
+	return res;
+}
+
+/**
+ * @brief Helper function to program a page image back after an erase.
+ * 		  Blank double words are skipped so that the unwritten fragment
+ * 		  slots of the page stay erased and can later be programmed directly.
+ * @param pgaddr : Flash address of the page
+ * @param buf : Page image, double word aligned
+ * @param len : Page size
+ * @retval HAL_OK on success
+ */
+static HAL_StatusTypeDef write_page_skip_blank (uint32_t pgaddr, const uint8_t *buf, uint32_t len) {
+	const uint32_t *dw = (const uint32_t *)buf;
+	uint32_t start, pos;
+
+	for( pos = 0; pos < len; ) {
+		while( pos < len && (dw[pos / 4] & dw[pos / 4 + 1]) == 0xFFFFFFFF ) {
+			pos += 8;
+		}
+		start = pos;
+		while( pos < len && (dw[pos / 4] & dw[pos / 4 + 1]) != 0xFFFFFFFF ) {
+			pos += 8;
+		}
+		if( pos > start
+				&& FlashMemHandlerFct.Write((void *)(pgaddr + start), buf + start, pos - start) != HAL_OK ) {
+			return HAL_ERROR;
+		}
+	}
+	return HAL_OK;
+}
+
+#if ( DATAFILE_PENDING_DWS == 1 )
+/**
+ * @brief Merges bytes into a double word shared by two fragments and
+ * 		  programs it once all its bytes are known
+ * @param slot : Source or scratch slot
+ * @param base : Slot start address
+ * @param offset : Slot offset of the first byte
+ * @param data : Bytes to merge
+ * @param len : Number of bytes, all within the same double word
+ */
+static storage_status_t pending_dw_merge (storage_slot_t slot, uint32_t base, uint32_t offset, const uint8_t *data, uint32_t len) {
+	uint32_t i, k;
+	uint64_t dw;
+
+	for( i = 0; i < datafile->pending_dws_nb
+			&& (pending_dws[i].dw != offset / 8 || pending_dws[i].slot != slot); i++ );
+	if( i == datafile->pending_dws_nb ) {
+		if( datafile->pending_dws_nb >= max_pending_dws ) {
+			return STR_NOMEM;
+		}
+		datafile->pending_dws_nb++;
+		pending_dws[i].dw = offset / 8;
+		pending_dws[i].slot = slot;
+		pending_dws[i].mask = 0;
+		memset(pending_dws[i].data, FLASH_BLANK_BYTE, 8);
+	}
+	for( k = 0; k < len; k++ ) {
+		pending_dws[i].data[offset % 8 + k] = data[k];
+		pending_dws[i].mask |= 1 << (offset % 8 + k);
+	}
+	if( pending_dws[i].mask == 0xFF ) {
+		memcpy(&dw, pending_dws[i].data, 8);
+		if( FlashMemHandlerFct.Write((void *)(base + pending_dws[i].dw * 8), &dw, 8) != HAL_OK ) {
+			return STR_HAL_ERR;
+		}
+		pending_dws[i] = pending_dws[--datafile->pending_dws_nb];
+	}
+	return STR_OK;
+}
+
+/**
+ * @brief Programs a fragment at its offset in a slot where fragments are
+ * 		  back to back. Pages are erased when first used unless already
+ * 		  blank, the double words shared with a fragment not received yet
+ * 		  are kept in RAM.
+ * @param slot : Source or scratch slot
+ * @param start : Slot offset of the fragment
+ * @param data : Fragment
+ * @param size : Fragment size
+ */
+static storage_status_t packed_write (storage_slot_t slot, uint32_t start, const uint8_t *data, uint32_t size) {
+	uint32_t base, len, end, a, b, n, rbsz;
+	uint8_t * ram_buf;
+	storage_status_t st;
+
+	if( (st = storage_get_slot_info(slot, &base, &len)) != STR_OK ) {
+		return st;
+	}
+	end = start + size;
+	if( end > len ) {
+		return STR_BAD_LEN;
+	}
+	if( (st = prepare_range(slot, start, size)) != STR_OK ) {
+		return st;
+	}
+	a = start;
+	if( a % 8 ) {
+		b = (a / 8 + 1) * 8;
+		if( b > end ) {
+			b = end;
+		}
+		if( (st = pending_dw_merge(slot, base, a, data, b - a)) != STR_OK ) {
+			return st;
+		}
+		a = b;
+	}
+	/* Whole double words, staged in the aligned RAM buffer */
+	rbsz = storage_get_rambuf(&ram_buf);
+	for( b = end & ~7UL; a < b; a += n ) {
+		n = b - a > rbsz ? rbsz : b - a;
+		memcpy(ram_buf, data + (a - start), n);
+		if( FlashMemHandlerFct.Write((void *)(base + a), ram_buf, n) != HAL_OK ) {
+			return STR_HAL_ERR;
+		}
+	}
+	if( end > a ) {
+		return pending_dw_merge(slot, base, a, data + (a - start), end - a);
+	}
+	return STR_OK;
+}
+
+/**
+ * @brief Reads a slot where fragments are back to back, including the
+ * 		  bytes of the double words still kept in RAM
+ * @param slot : Source or scratch slot
+ * @param offset : Slot offset
+ * @param data : Buffer to store the data
+ * @param len : Number of bytes
+ */
+static storage_status_t packed_read (storage_slot_t slot, uint32_t offset, uint8_t *data, uint32_t len) {
+	uint32_t base, slen, i, k, pos;
+
+	if( storage_get_slot_info(slot, &base, &slen) != STR_OK ) {
+		return STR_INCONSISTENCY;
+	}
+	if( offset + len > slen ) {
+		return STR_BAD_LEN;
+	}
+	if( FlashMemHandlerFct.Read((void *)(base + offset), data, len) != HAL_OK ) {
+		return STR_HAL_ERR;
+	}
+	for( i = 0; i < datafile->pending_dws_nb; i++ ) {
+		if( pending_dws[i].slot != slot ) {
+			continue;
+		}
+		for( k = 0; k < 8; k++ ) {
+			pos = pending_dws[i].dw * 8 + k;
+			if( (pending_dws[i].mask & (1 << k)) && pos >= offset && pos < offset + len ) {
+				data[pos - offset] = pending_dws[i].data[k];
+			}
+		}
+	}
+	return STR_OK;
+}
+#endif
+
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+/**
+ * @brief Forgets the double words of a slot kept in RAM
+ * @param slot : Source or scratch slot
+ */
+static void pending_dws_drop (storage_slot_t slot) {
+	uint32_t i;
+
+	for( i = 0; i < datafile->pending_dws_nb; ) {
+		if( pending_dws[i].slot == slot ) {
+			pending_dws[i] = pending_dws[--datafile->pending_dws_nb];
+		} else {
+			i++;
+		}
+	}
+}
+
+/**
+ * @brief Chooses the datafile layout once its header is received. A full
+ * 		  image is moved in place right away, with the few fragments
+ * 		  received so far, and the next ones are written there directly.
+ * @param slot : Fragment slot just written to the source slot
+ */
+static void datafile_layout_check (uint32_t slot) {
+	__attribute__((aligned (8))) uint8_t frag_buf[FRAG_MAX_SIZE];
+	uint8_t hdr[8];
+	uint32_t magic, row;
+
+	if( slot >= datafile->frag_nb ) {
+		/* Coded fragments are coming and the header was lost */
+		datafile->layout = DATAFILE_IN_SOURCE;
+		return;
+	}
+	if( !slot_is_written(0) ) {
+		return;
+	}
+	for( row = HEADER_OFFSET / datafile->frag_size; row <= (HEADER_OFFSET + 7) / datafile->frag_size; row++ ) {
+		if( !slot_is_written(row) ) {
+			return;
+		}
+	}
+	datafile->layout = DATAFILE_IN_SOURCE;
+	if( storage_read_no_holes(STORAGE_SLOT_SOURCE, 0, (uint8_t *)&magic, sizeof(magic)) != STR_OK
+			|| storage_read_no_holes(STORAGE_SLOT_SOURCE, HEADER_OFFSET, hdr, sizeof(hdr)) != STR_OK
+			|| magic != FIRMWARE_MAGIC ) {
+		return;
+	}
+#if ( ACTILITY_SMART_DELTA == 1 )
+	if( SmartDeltaVerifyHeader(hdr) == SMARTDELTA_OK ) {
+		return;
+	}
+#endif
+	for( row = 0; row < datafile->frag_nb; row++ ) {
+		if( slot_is_written(row) ) {
+			if( storage_read_no_holes(STORAGE_SLOT_SOURCE, row * datafile->frag_size, frag_buf, datafile->frag_size) != STR_OK
+					|| packed_write(STORAGE_SLOT_SCRATCH, row * datafile->frag_size, frag_buf, datafile->frag_size) != STR_OK ) {
+				/* The source slot still holds everything */
+				pending_dws_drop(STORAGE_SLOT_SCRATCH);
+				return;
+			}
+		}
+	}
+	datafile->layout = DATAFILE_IN_PLACE;
+	/* The file rows of the source slot are not read any more */
+	pending_dws_drop(STORAGE_SLOT_SOURCE);
+}
+#endif
+
+/**
+ * @brief Completes the datafile once the session is finished: the double
+ * 		  words left in RAM are programmed, so that the datafile can be read
+ * 		  straight from flash. In place, the fragment padding beyond the file
+ * 		  size is zeroed, as SBSFU only accepts blank or zero bytes after the
+ * 		  firmware image.
+ * @param size : Datafile size
+ * @retval storage_status_t STR_OK on success
+ */
+storage_status_t storage_datafile_commit (uint32_t size) {
+#if ( DATAFILE_PENDING_DWS == 1 )
+	uint32_t base, len;
+	uint64_t dw;
+
+	while( datafile->pending_dws_nb > 0 ) {
+		datafile->pending_dws_nb--;
+		if( storage_get_slot_info((storage_slot_t)pending_dws[datafile->pending_dws_nb].slot, &base, &len) != STR_OK ) {
+			return STR_INCONSISTENCY;
+		}
+		memcpy(&dw, pending_dws[datafile->pending_dws_nb].data, 8);
+		if( FlashMemHandlerFct.Write((void *)(base + pending_dws[datafile->pending_dws_nb].dw * 8), &dw, 8) != HAL_OK ) {
+			return STR_HAL_ERR;
+		}
+	}
+#endif
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+	uint32_t pos, end;
+	const uint64_t zero = 0;
+
+	if( datafile->layout != DATAFILE_IN_PLACE ) {
+		return STR_OK;
+	}
+	if( storage_get_slot_info(STORAGE_SLOT_SCRATCH, &base, &len) != STR_OK ) {
+		return STR_INCONSISTENCY;
+	}
+	end = (uint32_t)datafile->frag_nb * datafile->frag_size;
+	for( pos = (size + 7) & ~7UL; pos < end; pos += 8 ) {
+		memcpy(&dw, (void *)(base + pos), 8);
+		if( dw != zero && dw != ~zero
+				&& FlashMemHandlerFct.Write((void *)(base + pos), &zero, 8) != HAL_OK ) {
+			return STR_HAL_ERR;
+		}
+	}
+#else
+	(void)size;
+#endif
+	return STR_OK;
+}
+
+#if ( DATAFILE_PENDING_DWS == 1 )
+/**
+ * @brief Writes a fragment to a slot where fragments are back to back
+ * @param dst : Source or scratch slot
+ * @param offset : Slot offset of the fragment
+ * @param slot : Fragment slot
+ * @param data : Fragment
+ * @param size : Fragment size
+ * @retval 0 on success, -1 on failure
+ */
+static uint8_t datafile_packed_write (storage_slot_t dst, uint32_t offset, uint32_t slot, const uint8_t *data, uint32_t size) {
+	__attribute__((aligned (8))) uint8_t frag_buf[FRAG_MAX_SIZE];
+
+	if( slot_is_written(slot) ) {
+		/* Packed fragments can't be rewritten, only repeated */
+		if( packed_read(dst, offset, frag_buf, size) != STR_OK || memcmp(frag_buf, data, size) != 0 ) {
+			return (uint8_t) - 1;
+		}
+		return 0;
+	}
+	if( packed_write(dst, offset, data, size) != STR_OK ) {
+		return (uint8_t) - 1;
+	}
+	mark_slot_written(slot);
+	slot_crc_update(slot, data, size);
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+	if( dst == STORAGE_SLOT_SOURCE && datafile->layout == DATAFILE_UNDECIDED ) {
+		datafile_layout_check(slot);
+	}
+#endif
+	return 0;
+}
+#endif
 
 uint8_t FragDecoderActilityWrite(uint32_t addr, uint8_t *data, uint32_t size)
 {
-  uint32_t ptr, len, aligned, alignaddr, pg, pgaddr, nextpgaddr;
-  uint16_t row, first;
-  uint32_t rbsz;
+  uint32_t ptr, len, aligned, alignaddr, slot;
+#if ( STORAGE_PACKED_DATAFILE == 0 )
+  __attribute__((aligned (8))) uint8_t frag_buf[((FRAG_MAX_SIZE - 1) / 8 + 1) * 8];
+  uint32_t pgaddr, pgoff, done, chunk, rbsz;
   uint8_t * ram_buf;
+#endif
 
-  rbsz = storage_get_rambuf(&ram_buf);
-  original_frag_size = size; /* will need it in image alignment holes cleanup process */
-  storage_get_slot_info(STORAGE_SLOT_SOURCE, &ptr, &len);
-  if( (addr % size) != 0 ) {
+  datafile->original_frag_size = size; /* will need it in image alignment holes cleanup process */
+  if( storage_get_slot_info(STORAGE_SLOT_SOURCE, &ptr, &len) != STR_OK ) {
+	  return (uint8_t) - 1;
+  }
+  if( (addr % size) != 0 || size > FRAG_MAX_SIZE ) {
 	  return (uint8_t) - 1; /* addr should be multiple of size */
   }
-  row = addr / size;
-  aligned = ((size - 1) / 8 + 1) * 8;	/* align fragment size to write it to flash correctly */
-  alignaddr = aligned * row;
+  slot = addr / size;
+  if( slot >= datafile->slots_nb ) {
+	  return (uint8_t) - 1; /* Slot state not tracked, see storage_datafile_max_lost */
+  }
+  aligned = SOURCE_ROW_PITCH(size);
+  alignaddr = aligned * slot;
   if( alignaddr + aligned > len ) {
-	  return (uint8_t) - 1; /* If datafile from aligned fragments will not fit SWAP slot */
+	  return (uint8_t) - 1; /* If datafile will not fit SWAP slot */
   }
-  pg = alignaddr / rbsz;
-  pgaddr = pg * rbsz + ptr;
-  nextpgaddr = pgaddr + rbsz;
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+  if( datafile->layout == DATAFILE_IN_PLACE && slot < datafile->frag_nb ) {
+	  return datafile_packed_write(STORAGE_SLOT_SCRATCH, slot * size, slot, data, size);
+  }
+#endif
+#if ( STORAGE_PACKED_DATAFILE == 1 )
+  (void)ptr;
+  return datafile_packed_write(STORAGE_SLOT_SOURCE, alignaddr, slot, data, size);
+#else
+  rbsz = storage_get_rambuf(&ram_buf);
+  /* Only wait for the erase of the pages the fragment spans */
+  if( prepare_range(STORAGE_SLOT_SOURCE, alignaddr, aligned) != STR_OK ) {
+	  return (uint8_t) - 1;
+  }
+  memset(frag_buf, 0, aligned);
+  memcpy(frag_buf, data, size);
+
   /*
-   * First check that we are not trying to write fragment
-   * on to the dirty page. Dirty page is one that passed read->erase->write
-   * cycle at least once.
-   * When we process main fragments we never write to the same place so
-   * all pages are fresh and we will just write fragments.
-   * Only when processing redundancy fragments we will start rewrite pages
-   * and mark them dirty.
-   * We also need to specially handle cases when current page is not dirty but next
-   * is (for fragments that cross page boundary). In real life this will probably
-   * never happen but for the simplicity we just mark current page dirty.
-   *
-   * And finally if flash for the fragment we are about to write is not empty
-   * we should mark page dirty and process current page via read->erase->write page
+   * The source slot pages are erased before their first use and every
+   * fragment slot programmed since storage_datafile_init is tracked in
+   * written_slots. A slot that was
+   * never written is still blank, even on a page that already passed a
+   * read->erase->write cycle, so the fragment is programmed directly.
+   * This is the case of all main fragments.
    */
+  if( !slot_is_written(slot) ) {
+	  if( FlashMemHandlerFct.Write((void *)(alignaddr + ptr), frag_buf, aligned) != HAL_OK) {
+		  return (uint8_t) - 1;
+	  }
+	  mark_slot_written(slot);
+	  slot_crc_update(slot, data, size);
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+	  if( datafile->layout == DATAFILE_UNDECIDED ) {
+		  datafile_layout_check(slot);
+	  }
+#endif
+	  return 0;
+  }
 
-  if( page_is_dirty(pg) || page_is_dirty(pg + 1)
-		  || !flash_is_empty((void *)(alignaddr + ptr), aligned) ) {
-
-	  /*
-	   * Fragment could start on one page and end on another.
-	   * In this worst case we should read/erase/write fragment
-	   * on 2 sequential pages
-	   */
-	  mark_page_dirty( pg );
+  /*
+   * The slot is rewritten: read->erase->write every page the fragment
+   * spans. A fragment could start on one page and end on the next one.
+   */
+  for( done = 0; done < aligned; done += chunk ) {
+	  pgoff = (alignaddr + done) % rbsz;
+	  pgaddr = (alignaddr + done) - pgoff + ptr;
+	  chunk = rbsz - pgoff;
+	  if( chunk > aligned - done ) {
+		  chunk = aligned - done;
+	  }
 	  if( FlashMemHandlerFct.Read((void *)pgaddr, ram_buf, rbsz) != HAL_OK ) {
 		  return (uint8_t) - 1;
 	  }
+	  memcpy(ram_buf + pgoff, frag_buf + done, chunk);
 	  if ( FlashMemHandlerFct.Erase_Size((void *)pgaddr, rbsz) != HAL_OK ) {
 		  return (uint8_t) - 1;
 	  }
-	  if( (alignaddr + aligned - 1) / rbsz > pg ) {
-		  first = rbsz - (alignaddr % rbsz);
-		  memcpy(ram_buf + rbsz - first, data, first);
-		  if( FlashMemHandlerFct.Write((void *)pgaddr, ram_buf, rbsz) != HAL_OK ) {
-		  	  return (uint8_t) - 1;
-		  }
-		  if( (page_is_dirty(pg) && !page_is_dirty(pg + 1))
-				  && flash_is_empty((void *)nextpgaddr, aligned - first) ) {
-			/*
-			 * Current page is dirty and next is not and we just write remaining
-			 * part of the fragment on the new page without erasing it and rewriting
-			 * completely. Page is aligned on 64 bit boundary and fragment also so the remainder
-			 * will be aligned as well and we do not specially care about "aligned - first"
-			 */
-			  memset(ram_buf, 0, aligned - first);
-			  memcpy(ram_buf, data + first, size - first);
-			  if( FlashMemHandlerFct.Write((void *)nextpgaddr, ram_buf, aligned - first) != HAL_OK ) {
-				  return (uint8_t) - 1;
-			  }
-		  } else {
-			  /*
-			   * Next page is dirty or not empty so we should do read->erase-write cycle for
-			   * it and put remaining part of the fragment at the beginning
-			   * of the page. Mark page dirty to be sure.
-			   */
-			  mark_page_dirty( pg + 1 );
-			  if( FlashMemHandlerFct.Read((void *)nextpgaddr, ram_buf, rbsz) != HAL_OK ) {
-				  return (uint8_t) - 1;
-			  }
-			  memset(ram_buf, 0, aligned - first);
-			  memcpy(ram_buf, data + first, size - first);
-			  if ( FlashMemHandlerFct.Erase_Size((void *)nextpgaddr, rbsz) != HAL_OK ) {
-				  return (uint8_t) - 1;
-			  }
-			  if( FlashMemHandlerFct.Write((void *)nextpgaddr, ram_buf, rbsz) != HAL_OK ) {
-				  return (uint8_t) - 1;
-			  }
-		  }
-	  } else {
-		  /*
-		   * Just write back dirty page. We do not need any special
-		   * handling if the fragment is in the middle of dirty page
-		   */
-		  memset(ram_buf + alignaddr % rbsz, 0, aligned);
-		  memcpy(ram_buf + alignaddr % rbsz, data, size);
-		  if( FlashMemHandlerFct.Write((void *)pgaddr, ram_buf, rbsz) != HAL_OK ) {
-		   	  return (uint8_t) - 1;
-		  }
-	  }
-  } else {
-	  memset(ram_buf, 0, aligned);
-	  memcpy(ram_buf, data, size);
-	  if( FlashMemHandlerFct.Write((void *)(alignaddr + ptr), ram_buf, aligned) != HAL_OK) {
+	  page_erases++;
+	  if( write_page_skip_blank(pgaddr, ram_buf, rbsz) != HAL_OK ) {
 		  return (uint8_t) - 1;
 	  }
-	  /*
-	   * If we wrote fragment consisting of only FFs we should mark current page dirty
-	   * otherwise we will not be able to distinguish it from the erased space
-	   * and fail later
-	   */
-	  if( flash_is_empty((void *)(alignaddr + ptr), aligned) ) {
-		  mark_page_dirty( pg );
-	  }
   }
+  slot_crc_update(slot, data, size);
   return 0;
+#endif
 }
 
 uint8_t FragDecoderActilityRead(uint32_t addr, uint8_t *data, uint32_t size)
@@ -510,24 +1605,50 @@ uint8_t FragDecoderActilityRead(uint32_t addr, uint8_t *data, uint32_t size)
   uint32_t ptr, len, aligned, alignaddr;
   uint16_t row;
 
-  storage_get_slot_info(STORAGE_SLOT_SOURCE, &ptr, &len);
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+  if( datafile->layout == DATAFILE_IN_PLACE && addr / size < datafile->frag_nb ) {
+	  if( !range_is_ready(STORAGE_SLOT_SCRATCH, addr, size) ) {
+		  memset(data, FLASH_BLANK_BYTE, size);
+		  return 0;
+	  }
+	  return packed_read(STORAGE_SLOT_SCRATCH, addr, data, size) == STR_OK ? 0 : (uint8_t) - 1;
+  }
+#endif
+  if( storage_get_slot_info(STORAGE_SLOT_SOURCE, &ptr, &len) != STR_OK ) {
+	  return (uint8_t) - 1;
+  }
   row = addr / size;
-  aligned = ((size - 1) / 8 + 1) * 8;	/* align fragment size to read it from flash correctly */
+  aligned = SOURCE_ROW_PITCH(size);
   alignaddr = aligned * row;
   if( alignaddr + aligned > len ) {
-	  return (uint8_t) - 1; /* If datafile from aligned fragments will not fit SWAP slot */
+	  return (uint8_t) - 1; /* If datafile will not fit SWAP slot */
   }
+  /*
+   * A row on a page not prepared yet holds data of a previous session, it
+   * was not written in this one and reads as erased. Pages are only erased
+   * on the write and background paths.
+   */
+  if( !range_is_ready(STORAGE_SLOT_SOURCE, alignaddr, aligned) ) {
+	  memset(data, FLASH_BLANK_BYTE, size);
+	  return 0;
+  }
+#if ( STORAGE_PACKED_DATAFILE == 1 )
+  (void)ptr;
+  return packed_read(STORAGE_SLOT_SOURCE, alignaddr, data, size) == STR_OK ? 0 : (uint8_t) - 1;
+#else
   if( FlashMemHandlerFct.Read((void *)(alignaddr + ptr), data, size) == HAL_OK ) {
 	  return 0; // Success
   }
   return (uint8_t) - 1;
+#endif
 }
 
 /**
- * @brief Helper function to read image date with alignment holes of any size
- * 		  and return buffer without them
- * @param slot : Source image slot consisting of fragments aligned on double word
- * @param offset : Offset in image when alignment holes removed
+ * @brief Helper function to read the datafile as a contiguous image. Packed
+ * 		  fragments are read straight from the slot, padded ones have
+ * 		  their alignment holes removed.
+ * @param slot : Source image slot
+ * @param offset : Offset in image
  * @param data : Buffer to store data without holes
  * @param size : Size of data to move to data buffer
  * @retval storage_status_t STR_OK on success, anything
@@ -535,19 +1656,32 @@ uint8_t FragDecoderActilityRead(uint32_t addr, uint8_t *data, uint32_t size)
  */
 storage_status_t storage_read_no_holes (storage_slot_t slot, uint32_t offset, uint8_t* data, uint32_t len) {
 
+#if ( STORAGE_FULL_IMAGE_IN_PLACE == 1 )
+	if( slot == STORAGE_SLOT_SOURCE && datafile->layout == DATAFILE_IN_PLACE ) {
+		if( offset + len > (uint32_t)datafile->frag_nb * datafile->frag_size ) {
+			return STR_BAD_LEN;
+		}
+		return packed_read(STORAGE_SLOT_SCRATCH, offset, data, len);
+	}
+#endif
+#if ( STORAGE_PACKED_DATAFILE == 1 )
+	return packed_read(slot, offset, data, len);
+#else
 	uint32_t ptr, aligned, row_offset, ssize;
 	int32_t ll, sz;
 	uint16_t row;
 
 	ll = len;
-	storage_get_slot_info(slot, &ptr, &ssize);
-	row = offset / original_frag_size;
-	row_offset = offset % original_frag_size;
-	aligned = ((original_frag_size - 1) / 8 + 1) * 8;
+	if( storage_get_slot_info(slot, &ptr, &ssize) != STR_OK ) {
+		return STR_INCONSISTENCY;
+	}
+	row = offset / datafile->original_frag_size;
+	row_offset = offset % datafile->original_frag_size;
+	aligned = ((datafile->original_frag_size - 1) / 8 + 1) * 8;
 	if( aligned * row + row_offset + ll > ssize ) {
 		  return STR_BAD_LEN; /* If requested data is beyond the boundary of SWAP slot */
 	}
-	sz = original_frag_size - row_offset;
+	sz = datafile->original_frag_size - row_offset;
 	if( ll < sz ) {
 		sz = ll;
 	}
@@ -558,52 +1692,75 @@ storage_status_t storage_read_no_holes (storage_slot_t slot, uint32_t offset, ui
 	while( ll > 0 ) {
 		data += sz;
 		row++;
-		sz = original_frag_size;
+		sz = datafile->original_frag_size;
 		ll -= sz;
 		if( ll < 0 ) {
-			sz = ll + original_frag_size;
+			sz = ll + datafile->original_frag_size;
 		}
 		if( FlashMemHandlerFct.Read((void *)(aligned * row + ptr), data, sz) != HAL_OK ) {
 				return STR_HAL_ERR;
 		}
 	}
 	return STR_OK;
+#endif
 }
 
-#define CRC32_BUFSZ	32
-
-storage_status_t storage_crc32 (storage_slot_t slot, uint32_t offset, uint32_t length, uint32_t *crc_out) {
-
+#define CRC32_BUFSZ	128
 
+/**
+ * @brief Updates a CRC32 register with a range of a slot read back
+ */
+static storage_status_t crc32_read (storage_slot_t slot, uint32_t offset, uint32_t length, uint32_t *crc) {
 	  uint32_t len;
 	  uint8_t buf[CRC32_BUFSZ];
 	  storage_status_t st;
 
-	  // The CRC calculation follows CCITT - 0x04C11DB7
-	  const uint32_t reversedPolynom = 0xEDB88320;
-
-	  // CRC initial value
-	  uint32_t crc = 0xFFFFFFFF;
-	  uint32_t ptr = offset;
-
 	  while (length)
 	  {
 		  len = length > CRC32_BUFSZ ? CRC32_BUFSZ : length;
 		  length -= len;
-		  if ((st = storage_read_no_holes (slot, ptr, buf, len)) != STR_OK) {
+		  if ((st = storage_read_no_holes (slot, offset, buf, len)) != STR_OK) {
 			return st;
 		  }
-		  for (uint16_t i = 0; i < len; ++i)
-		  {
-			crc ^= (uint32_t)buf[i];
-			for (uint16_t i = 0; i < 8; i++)
-			{
-			  crc = (crc >> 1) ^ (reversedPolynom & ~((crc & 0x01) - 1));
-			}
+		  *crc = crc32_update(*crc, buf, len);
+		  offset += len;
+	  }
+	  return STR_OK;
+}
+
+storage_status_t storage_crc32 (storage_slot_t slot, uint32_t offset, uint32_t length, uint32_t *crc_out) {
+	  storage_status_t st;
+
+	  // CRC initial value
+	  uint32_t crc = CRC32_INITIAL_VALUE;
+	  uint32_t ptr = offset;
+
+	  /*
+	   * The datafile CRC is folded from the CRC runs recorded while the
+	   * fragments were written, the slots out of the runs and a trailing
+	   * partial fragment are read
+	   */
+	  if( slot == STORAGE_SLOT_SOURCE && offset == 0 && slot_crc_size == datafile->original_frag_size
+			  && slot_crc_size != 0 ) {
+		  uint32_t i, n, rows = length / slot_crc_size;
+
+		  for( i = 0; i < crc_runs_nb && crc_runs[i].first + crc_runs[i].nb <= rows; i++ ) {
+			  if( (st = crc32_read(slot, ptr, crc_runs[i].first * slot_crc_size - ptr, &crc)) != STR_OK ) {
+				  return st;
+			  }
+			  for( n = 0; n < crc_runs[i].nb; n++ ) {
+				  crc = crc32_shift_slot(crc);
+			  }
+			  crc ^= crc_runs[i].crc;
+			  ptr = (crc_runs[i].first + crc_runs[i].nb) * slot_crc_size;
 		  }
-		  ptr += len;
+		  length -= ptr;
+	  }
+
+	  if ((st = crc32_read(slot, ptr, length, &crc)) != STR_OK) {
+		  return st;
 	  }
-	  *crc_out = ~crc;
+	  *crc_out = CRC32_FINAL(crc);
 	  return STR_OK;
 }
 
@@ -23,21 +23,44 @@ Description: Flash API
  */
 #define RAM_STORAGE_SZ   2048
 #define FLASH_BLANK_BYTE   (0xFF)
-/*
- * Number of RAM_STORAGE_SZ len pages in SWAP slot where data fragments are received
- * Array of MAX_PAGES / 8 is used to store dirty pages information
- *
- * NOTE: You need to adjust it if SWAP slot size is changed !
- *
- */
-#define MAX_PAGES		149
-
 /*!
  * Length of firmware image header. Should be exactly the same
  * as header length used in SBSFU
  */
 #define HEADER_OFFSET   512
 
+/*!
+ * Magic number starting a firmware image header
+ */
+#define FIRMWARE_MAGIC	0x4D554653
+
+/*
+ * If set to 1 a full image datafile (one without Smart Delta header) is
+ * decoded straight to its final place, without alignment holes, in the
+ * download slot instead of being moved there once complete.
+ * Requires FRAG_DECODER_DEFERRED_SOLVE as fragments can only be
+ * written once in place.
+ */
+#define STORAGE_FULL_IMAGE_IN_PLACE		1
+
+/*
+ * If set to 1 the fragments of a datafile are stored back to back in the
+ * source slot instead of being padded to a double word multiple, so that
+ * a larger datafile fits the slot and can be read straight from flash once
+ * storage_datafile_commit is called. Double words shared by two fragments
+ * are kept in RAM until both are received.
+ * Requires FRAG_DECODER_DEFERRED_SOLVE as fragments can only be
+ * written once.
+ */
+#define STORAGE_PACKED_DATAFILE			1
+
+/*
+ * Runs of consecutive fragment slots whose CRC is tracked in RAM, 8 bytes
+ * each. Every gap in the fragments received in order starts a new run,
+ * the slots left out of the runs are read back to compute the datafile CRC.
+ */
+#define STORAGE_MAX_CRC_RUNS			64
+
 #define STORAGE_CRITICAL_ENTER()    (__disable_irq())   /* TODO: it needs to use another method for enter and exit of critical section. It must be RTOS compatible.*/
 #define STORAGE_CRITICAL_EXIT()     (__enable_irq())    /* TODO: it needs to use another method for enter and exit of critical section. It must be RTOS compatible.*/
 
@@ -68,13 +91,23 @@ uint8_t FragDecoderActilityWrite(uint32_t addr, uint8_t *data, uint32_t size);
 storage_status_t move_image(storage_slot_t src, storage_slot_t dst, uint32_t size, uint8_t flag);
 storage_status_t storage_check_blank_slot(storage_slot_t slot);
 storage_status_t storage_crc32 (storage_slot_t slot, uint32_t offset, uint32_t length, uint32_t *crc_out);
-void 			 storage_datafile_init (void);
+storage_status_t storage_datafile_commit (uint32_t size);
+const void *	 storage_datafile_get_ctx (uint32_t *size);
+storage_status_t storage_datafile_restore_ctx (const void *ctx, uint32_t size);
+bool 			 storage_datafile_in_place (void);
+void 			 storage_datafile_init (uint16_t frag_nb, uint8_t frag_size);
+int32_t 		 storage_datafile_max_lost (uint16_t frag_nb, uint8_t frag_size);
 storage_status_t storage_erase_slot(storage_slot_t slot);
+storage_status_t storage_erase_slot_step(storage_slot_t slot);
+void 			 storage_slot_prepare (storage_slot_t slot);
+bool 			 storage_page_is_ready (storage_slot_t slot, uint32_t offset);
 uint32_t 	     storage_get_rambuf(uint8_t **ram_buf);
+uint32_t 	     storage_get_page_erase_count (void);
 storage_status_t storage_get_slot_info(storage_slot_t slot, uint32_t *start, uint32_t *len);
 storage_status_t storage_init(void);
 bool 			 storage_isbusy(void);
 storage_status_t storage_read(storage_slot_t slot, uint32_t offset, uint8_t* data, uint32_t len);
+void 			 storage_set_ram (void *ram, uint32_t size);
 void 			 storage_setbusy(bool busy);
 storage_status_t storage_write(storage_slot_t slot, uint32_t offset, uint8_t* data, uint32_t len);
 storage_status_t storage_read_no_holes (storage_slot_t slot, uint32_t offset, uint8_t* data, uint32_t len);
@@ -71,6 +71,15 @@
 #define CHUNK_SIZE_SIGN_VERIFICATION (1024U)  /*!< Signature verification chunk size*/
 #define SFU_IMG_CHUNK_SIZE  (512U)
 
+/**
+  * @brief  With a SHA256 FW tag, the Secure Engine hashes the FW image directly in the FLASH:
+  *         no chunk is copied in RAM for the signature verification.
+  */
+#if (SECBOOT_CRYPTO_SCHEME == SECBOOT_ECCDSA_WITHOUT_ENCRYPT_SHA256) || \
+    (SECBOOT_CRYPTO_SCHEME == SECBOOT_ECCDSA_WITH_AES128_CBC_SHA256)
+#define SFU_FWIMG_VERIFY_IN_FLASH
+#endif /* SECBOOT_CRYPTO_SCHEME */
+
 /**
   * @brief  FW slot and swap offset
   */
@@ -215,6 +224,7 @@ static SFU_ErrorStatus VerifyFwRawHeaderTag(uint8_t *pFWInfoInput)
   *        and at the end compare the obtained TAG with the one provided as input
   *        in pSE_GMCInit parameter.
   * @note: SHA-256 tag: a hash of the firmware is performed and compared with the digest stored in the Firmware header.
+  *        Each payload area is hashed in place by a single SE_AuthenticateFW_AppendFlash call.
   * @param pSE_Status: Secure Engine Status.
   *        This parameter can be a value of @ref SE_Status_Structure_definition.
   * @param pSE_Metadata: Firmware metadata.
@@ -229,18 +239,22 @@ static SFU_ErrorStatus VerifyTagScatter(SE_StatusTypeDef *pSeStatus, SE_FwRawHea
   SE_ErrorStatus se_ret_status = SE_ERROR;
   SFU_ErrorStatus sfu_ret_status = SFU_SUCCESS;
   /* Loop variables */
+#if !defined(SFU_FWIMG_VERIFY_IN_FLASH)
   uint32_t i = 0;
+#endif /* !SFU_FWIMG_VERIFY_IN_FLASH */
   uint32_t j = 0;
   /* Variables to handle the FW image chunks to be injected in the verification procedure and the result */
   int32_t fw_tag_len = 0;             /* length of the authentication tag to be verified */
   int32_t fw_verified_total_size = 0; /* number of bytes that have been processed during authentication check */
-  int32_t fw_chunk_size;              /* size of a FW chunk to be verified */
   /* Authentication tag computed in this procedure (to be compared with the one stored in the FW metadata) */
   uint8_t fw_tag_output[SE_TAG_LEN] __attribute__((aligned(4)));
+#if !defined(SFU_FWIMG_VERIFY_IN_FLASH)
+  int32_t fw_chunk_size;              /* size of a FW chunk to be verified */
   /* FW chunk produced by the verification procedure if any   */
   uint8_t fw_chunk[CHUNK_SIZE_SIGN_VERIFICATION] __attribute__((aligned(4)));
   /* FW chunk provided as input to the verification procedure */
   uint8_t fw_image_chunk[CHUNK_SIZE_SIGN_VERIFICATION] __attribute__((aligned(4)));
+#endif /* !SFU_FWIMG_VERIFY_IN_FLASH */
   /* Variables to handle the FW image (this will be split in chunks) */
   int32_t payloadsize;
   uint8_t *ppayload;
@@ -301,6 +315,25 @@ static SFU_ErrorStatus VerifyTagScatter(SE_StatusTypeDef *pSeStatus, SE_FwRawHea
     {
       payloadsize = pSE_Payload->PayloadSize[j];
       ppayload = pSE_Payload->pPayload[j];
+#if defined(SFU_FWIMG_VERIFY_IN_FLASH)
+      /* The whole payload area is hashed in place: no copy, no output chunk, one Secure Engine call.
+         A double ECC error is caught by reading the area here first, as NMI_Handler only recovers from it
+         during a SBSFU flash read */
+      if ((payloadsize > 0) && (se_ret_status == SE_SUCCESS) && (*pSeStatus == SE_OK))
+      {
+        sfu_ret_status = SFU_LL_FLASH_Check_DoubleECC(ppayload, payloadsize);
+        if (sfu_ret_status == SFU_SUCCESS)
+        {
+          se_ret_status = SE_AuthenticateFW_AppendFlash(pSeStatus, ppayload, payloadsize);
+        }
+        else
+        {
+          *pSeStatus = SE_ERR_FLASH_READ;
+          se_ret_status = SE_ERROR;
+        }
+        fw_verified_total_size += payloadsize;
+      }
+#else
       i = 0;
       fw_chunk_size = CHUNK_SIZE_SIGN_VERIFICATION;
 
@@ -344,6 +377,7 @@ static SFU_ErrorStatus VerifyTagScatter(SE_StatusTypeDef *pSeStatus, SE_FwRawHea
         }
         fw_verified_total_size += fw_chunk_size;
       }
+#endif /* SFU_FWIMG_VERIFY_IN_FLASH */
     }
   }
 
@@ -725,6 +759,56 @@ static SFU_ErrorStatus VerifyFwSignatureAfterDecrypt(SE_StatusTypeDef *pSeStatus
   return VerifyFwSignatureScatter(pSeStatus, pFwImageHeader, &payload_desc, SE_FW_IMAGE_PARTIAL);
 }
 
+/**
+  * @brief  Check if a block of slot #0 already holds the content it must have once the image is installed.
+  * @note   Only the bytes taken from the updated image and the bytes cleaned beyond the final image are compared:
+  *         the other bytes of the block are restored from its own backup by the swap.
+  * @param  pBlock0 Address of the block in slot #0
+  * @param  pBlock1 Address of the block of the updated image, in slot #1 or in swap area
+  * @param  Begin Offset in the block of the first byte taken from the updated image
+  * @param  End Offset in the block of the first byte following the updated image
+  * @param  EmptyBegin Offset in the block of the first byte beyond the final image
+  * @param  pBuffer RAM buffer of SFU_IMG_CHUNK_SIZE bytes
+  * @retval SFU_SUCCESS if the block is unchanged, SFU_ERROR otherwise.
+  */
+static SFU_ErrorStatus CompareSlot0Block(uint8_t *pBlock0, uint8_t *pBlock1, uint32_t Begin, uint32_t End,
+                                         uint32_t EmptyBegin, uint8_t *pBuffer)
+{
+  /* The buffer is split in 2 halves: slot #0 content and expected content */
+  uint8_t *p_expected = pBuffer + (SFU_IMG_CHUNK_SIZE / 2U);
+  uint32_t offset;
+  uint32_t length;
+
+  if (End > EmptyBegin)
+  {
+    End = EmptyBegin;
+  }
+  for (offset = Begin; offset < End; offset += length)
+  {
+    length = ((End - offset) < (SFU_IMG_CHUNK_SIZE / 2U)) ? (End - offset) : (SFU_IMG_CHUNK_SIZE / 2U);
+    /* A double ECC error is reported as a difference: the block is then installed again */
+    if ((SFU_LL_FLASH_Read(pBuffer, pBlock0 + offset, length) != SFU_SUCCESS)
+        || (SFU_LL_FLASH_Read(p_expected, pBlock1 + offset, length) != SFU_SUCCESS)
+        || (memcmp(pBuffer, p_expected, length) != 0))
+    {
+      return SFU_ERROR;
+    }
+  }
+
+  memset(p_expected, 0xFF, SFU_IMG_CHUNK_SIZE / 2U);
+  for (offset = EmptyBegin; offset < SFU_IMG_SWAP_REGION_SIZE; offset += length)
+  {
+    length = ((SFU_IMG_SWAP_REGION_SIZE - offset) < (SFU_IMG_CHUNK_SIZE / 2U)) ?
+             (SFU_IMG_SWAP_REGION_SIZE - offset) : (SFU_IMG_CHUNK_SIZE / 2U);
+    if ((SFU_LL_FLASH_Read(pBuffer, pBlock0 + offset, length) != SFU_SUCCESS)
+        || (memcmp(pBuffer, p_expected, length) != 0))
+    {
+      return SFU_ERROR;
+    }
+  }
+  return SFU_SUCCESS;
+}
+
 
 /**
   * @brief  Swap Slot 0 with decrypted FW to install
@@ -735,6 +819,8 @@ static SFU_ErrorStatus VerifyFwSignatureAfterDecrypt(SE_StatusTypeDef *pSeStatus
   *         Each of these blocks is swapped using smaller chunks of SFU_IMG_CHUNK_SIZE size.
   *         The swap starts from the tail of the image and ends with the beginning of the image ("swap from tail to
   *         head").
+  *         A block of slot #0 which already holds its final content (typically after a delta update) is neither
+  *         backed up nor erased and programmed: it is only marked as swapped in the trailer.
   * @param  None.
   * @retval SFU_SUCCESS if successful, a SFU_ErrorStatus error otherwise.
   */
@@ -764,6 +850,7 @@ static SFU_ErrorStatus SwapFirmwareImages(void)
   uint32_t offset_block_partial_begin;
   uint32_t offset_block_partial_end;
   uint32_t offset_block_final_end;
+  uint32_t number_of_unchanged = 0U;
 
   TRACE("\r\n\t  Image preparation done.\r\n\t  Swapping the firmware images");
 
@@ -849,6 +936,44 @@ static SFU_ErrorStatus SwapFirmwareImages(void)
       return SFU_ERROR;
     }
 
+    /*
+     * If neither CPY_TO_SLOT1(i) nor CPY_TO_SLOT0(i) is written yet, check if the block of slot #0 is left unchanged
+     * by the installation. The block containing the header is always installed, as the header area is programmed
+     * afterwards by the validation.
+     * An unchanged block is marked CPY_TO_SLOT0 first: if the installation is interrupted before CPY_TO_SLOT1 is
+     * written too, the resume only backs up the block, which is harmless. The other order would let the resume
+     * rebuild the block from a backup which has never been done.
+     */
+    e_ret_status = SFU_LL_FLASH_Read(&trailer, TRAILER_CPY_TO_SLOT1(TRAILER_INDEX - 1 - index_slot0), sizeof(trailer));
+    if ((index_slot0 != 0) && (e_ret_status == SFU_SUCCESS) && (memcmp(&trailer, NOT_SWAPPED, sizeof(trailer)) == 0))
+    {
+      e_ret_status = SFU_LL_FLASH_Read(&trailer, TRAILER_CPY_TO_SLOT0(TRAILER_INDEX - 1 - index_slot0),
+                                       sizeof(trailer));
+      if ((e_ret_status == SFU_SUCCESS) && (memcmp(&trailer, NOT_SWAPPED, sizeof(trailer)) == 0)
+          && (CompareSlot0Block(CHUNK_0_ADDR(index_slot0, 0),
+                                (index_slot1_read == -1) ? CHUNK_SWAP_ADDR(0) : CHUNK_1_ADDR(index_slot1_read, 0),
+                                (index_slot0 == index_slot0_partial_begin) ? offset_block_partial_begin : 0U,
+                                (index_slot0 == index_slot0_partial_end) ? offset_block_partial_end :
+                                SFU_IMG_SWAP_REGION_SIZE,
+                                (index_slot0 == index_slot0_final_end) ? offset_block_final_end :
+                                SFU_IMG_SWAP_REGION_SIZE, buffer) == SFU_SUCCESS))
+      {
+        e_ret_status = AtomicWrite(TRAILER_CPY_TO_SLOT0((TRAILER_INDEX - 1 - index_slot0)),
+                                   (SFU_LL_FLASH_write_t *) SWAPPED);
+        if (e_ret_status == SFU_SUCCESS)
+        {
+          e_ret_status = AtomicWrite(TRAILER_CPY_TO_SLOT1((TRAILER_INDEX - 1 - index_slot0)),
+                                     (SFU_LL_FLASH_write_t *) SWAPPED);
+        }
+        StatusFWIMG(e_ret_status == SFU_ERROR, SFU_IMG_FLASH_WRITE_FAILED);
+        if (e_ret_status != SFU_SUCCESS)
+        {
+          return e_ret_status;
+        }
+        number_of_unchanged++;
+      }
+    }
+
     /* If CPY_TO_SLOT1(i) is still virgin (value NOT_SWAPPED, and no NMI), then swap the block from slot #0 to
        slot #1 */
     e_ret_status = SFU_LL_FLASH_Read(&trailer, TRAILER_CPY_TO_SLOT1(TRAILER_INDEX - 1 - index_slot0), sizeof(trailer));
@@ -1120,16 +1245,26 @@ static SFU_ErrorStatus SwapFirmwareImages(void)
   index_slot0 = number_of_index_slot0 - 1;
   while (index_slot0 >= index_slot0_empty_begin)
   {
-    e_ret_status = EraseSlotIndex(0, index_slot0);
-    if (e_ret_status !=  SFU_SUCCESS)
+    /* Erase only if the block is not empty yet */
+    if (CompareSlot0Block(CHUNK_0_ADDR(index_slot0, 0), NULL, 0U, 0U, 0U, buffer) != SFU_SUCCESS)
     {
-      return SFU_ERROR;
+      e_ret_status = EraseSlotIndex(0, index_slot0);
+      if (e_ret_status !=  SFU_SUCCESS)
+      {
+        return SFU_ERROR;
+      }
+    }
+    else
+    {
+      e_ret_status = SFU_SUCCESS;
     }
 
     /* Decrement block index */
     index_slot0--;
   }
 
+  TRACE("\r\n\t  %d block(s) left unchanged", number_of_unchanged);
+
   return e_ret_status;
 }
 
@@ -322,6 +322,35 @@ SFU_ErrorStatus SFU_LL_FLASH_Read(void *pDestination, const void *pSource, uint3
   return e_ret_status;
 }
 
+/**
+  * @brief  This function checks that a flash area can be read without double ECC error
+  * @note   Each double word of the area is read once, nothing is copied. It is used before an area is read in place
+  *         by the Secure Engine, whose double ECC errors would otherwise reach NMI_Handler outside of a flash read.
+  * @param  pStart: Start address of the area
+  * @param  Length: Length in bytes of the area
+  * @retval SFU_ErrorStatus SFU_SUCCESS if no double ECC error occurred, SFU_ERROR otherwise.
+  */
+SFU_ErrorStatus SFU_LL_FLASH_Check_DoubleECC(const void *pStart, uint32_t Length)
+{
+  SFU_ErrorStatus e_ret_status = SFU_ERROR;
+  uint32_t addr = (uint32_t)pStart & ~(sizeof(SFU_LL_FLASH_write_t) - 1U);
+  uint32_t addr_end = (uint32_t)pStart + Length;
+
+  DoubleECC_Error_Counter = 0U;
+  DoubleECC_Check = SFU_TRUE;
+  for (; addr < addr_end; addr += sizeof(SFU_LL_FLASH_write_t))
+  {
+    (void)*(__IO uint32_t *)addr;
+  }
+  DoubleECC_Check = SFU_FALSE;
+  if (DoubleECC_Error_Counter == 0U)
+  {
+    e_ret_status = SFU_SUCCESS;
+  }
+  DoubleECC_Error_Counter = 0U;
+  return e_ret_status;
+}
+
 /**
   * @brief  This function clean-up a flash
   * @note   Not designed to clean-up area inside secure engine isolation.
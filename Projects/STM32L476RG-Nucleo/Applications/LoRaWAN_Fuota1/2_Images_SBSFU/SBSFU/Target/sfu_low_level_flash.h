@@ -126,6 +126,7 @@ SFU_ErrorStatus SFU_LL_FLASH_Erase_Size(SFU_FLASH_StatusTypeDef *pxFlashStatus,
 SFU_ErrorStatus SFU_LL_FLASH_Write(SFU_FLASH_StatusTypeDef *pxFlashStatus, void *pDestination, const void *pSource,
                                    uint32_t Length);
 SFU_ErrorStatus SFU_LL_FLASH_Read(void *pDestination, const void *pSource, uint32_t Length);
+SFU_ErrorStatus SFU_LL_FLASH_Check_DoubleECC(const void *pStart, uint32_t Length);
 SFU_ErrorStatus SFU_LL_FLASH_CleanUp(SFU_FLASH_StatusTypeDef *pFlashStatus, void *pStart, uint32_t Length);
 void NMI_Handler(void);
 uint32_t SFU_LL_FLASH_GetPage(uint32_t Addr);
@@ -159,6 +159,7 @@ void NMI_Handler(void);
 SE_ErrorStatus SE_LL_Buffer_in_ram(void *pBuff, uint32_t Length);
 SE_ErrorStatus SE_LL_Buffer_in_SBSFU_ram(const void *pBuff, uint32_t length);
 SE_ErrorStatus SE_LL_Buffer_part_of_SE_ram(const void *pBuff, uint32_t length);
+SE_ErrorStatus SE_LL_Buffer_in_FW_slots(const void *pBuff, uint32_t length);
 /**
   * @}
   */
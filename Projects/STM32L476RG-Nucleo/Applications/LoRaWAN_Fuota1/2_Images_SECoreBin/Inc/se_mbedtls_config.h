@@ -345,7 +345,7 @@
 //#define MBEDTLS_MD5_PROCESS_ALT
 //#define MBEDTLS_RIPEMD160_PROCESS_ALT
 //#define MBEDTLS_SHA1_PROCESS_ALT
-//#define MBEDTLS_SHA256_PROCESS_ALT
+#define MBEDTLS_SHA256_PROCESS_ALT    /* Unrolled block function of Src/se_sha256_alt.c */
 //#define MBEDTLS_SHA512_PROCESS_ALT
 //#define MBEDTLS_DES_SETKEY_ALT
 //#define MBEDTLS_DES_CRYPT_ECB_ALT
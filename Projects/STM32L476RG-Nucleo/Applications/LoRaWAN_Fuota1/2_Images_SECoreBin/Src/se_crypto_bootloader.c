@@ -871,6 +871,43 @@ SE_ErrorStatus SE_CRYPTO_AuthenticateFW_Append(const uint8_t *pInputBuffer, int3
   return e_ret_status;
 }
 
+/**
+  * @brief Secure Engine AuthenticateFW Append function for a FW image area of the Flash.
+  *        The area is hashed in place: no copy and no output buffer.
+  * @note  Only available when the FW tag is a SHA256 digest: the AES GCM tag requires the output of the encryption,
+  *        SE_CRYPTO_AuthenticateFW_Append must be used in this case.
+  * @note  The caller checks the area for double ECC errors first (SFU_LL_FLASH_Check_DoubleECC).
+  * @param pInputBuffer: pointer to the Flash area (checked by the caller).
+  * @param InputSize: Input Size (bytes).
+  * @retval SE_ErrorStatus SE_SUCCESS if successful, SE_ERROR otherwise.
+  */
+SE_ErrorStatus SE_CRYPTO_AuthenticateFW_AppendFlash(const uint8_t *pInputBuffer, int32_t InputSize)
+{
+  SE_ErrorStatus e_ret_status = SE_ERROR;
+#if ( (SECBOOT_CRYPTO_SCHEME == SECBOOT_ECCDSA_WITH_AES128_CBC_SHA256) || (SECBOOT_CRYPTO_SCHEME == SECBOOT_ECCDSA_WITHOUT_ENCRYPT_SHA256) )
+  int32_t ret; /* mbedTLS return code */
+
+  if (InputSize < 0)
+  {
+    return (SE_ERROR);
+  }
+  /* else the cast to size_t is valid */
+
+  ret = mbedtls_sha256_update_ret(&m_SHA256ctx, pInputBuffer, (size_t)InputSize);
+
+  if (0 == ret)
+  {
+    e_ret_status = SE_SUCCESS;
+  }
+#else
+  (void)pInputBuffer;
+  (void)InputSize;
+#endif /* SECBOOT_CRYPTO_SCHEME */
+
+  /* Return status*/
+  return e_ret_status;
+}
+
 /**
   * @brief Secure Engine AuthenticateFW Finish function.
   *        It is a wrapper of the mbedTLS crypto or hash function included in the protected area used during the FW
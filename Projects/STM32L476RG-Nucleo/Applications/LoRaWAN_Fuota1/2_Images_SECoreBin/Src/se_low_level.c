@@ -392,6 +392,38 @@ SE_ErrorStatus SE_LL_Buffer_part_of_SE_ram(const void *pBuff, uint32_t length)
   return e_ret_status;
 }
 
+/**
+  * @brief function checking if a buffer is in a FW image area of the Flash: slot #0 (header excluded), slot #1 or
+  *        swap area.
+  * @param pBuff: pointer to the buffer
+  * @param length: length of buffer in bytes
+  * @retval SE_ErrorStatus SE_SUCCESS if successful, SE_ERROR otherwise.
+  */
+SE_ErrorStatus SE_LL_Buffer_in_FW_slots(const void *pBuff, uint32_t length)
+{
+  SE_ErrorStatus e_ret_status;
+  uint32_t addr_start = (uint32_t)pBuff;
+  uint32_t addr_end = addr_start + length - 1U;
+  if ((length != 0U) && (addr_end >= addr_start) &&
+      (((addr_start >= (SFU_IMG_SLOT_0_REGION_BEGIN_VALUE + SFU_IMG_IMAGE_OFFSET)) &&
+        (addr_end < (SFU_IMG_SLOT_0_REGION_BEGIN_VALUE + SFU_IMG_SLOT_0_REGION_SIZE))) ||
+       ((addr_start >= SFU_IMG_SLOT_1_REGION_BEGIN_VALUE) &&
+        (addr_end < (SFU_IMG_SLOT_1_REGION_BEGIN_VALUE + SFU_IMG_SLOT_1_REGION_SIZE))) ||
+       ((addr_start >= SFU_IMG_SWAP_REGION_BEGIN_VALUE) &&
+        (addr_end < (SFU_IMG_SWAP_REGION_BEGIN_VALUE + SFU_IMG_SWAP_REGION_SIZE)))))
+  {
+    e_ret_status = SE_SUCCESS;
+  }
+  else
+  {
+    e_ret_status = SE_ERROR;
+
+    /* Could be an attack ==> Reset */
+    NVIC_SystemReset();
+  }
+  return e_ret_status;
+}
+
 /**
   * @}
   */
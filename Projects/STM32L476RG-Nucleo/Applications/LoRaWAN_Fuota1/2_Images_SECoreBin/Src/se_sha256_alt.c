@@ -0,0 +1,145 @@
+/*  _        _   _ _ _ _
+   / \   ___| |_(_) (_) |_ _   _
+  / _ \ / __| __| | | | __| | | |
+ / ___ \ (__| |_| | | | |_| |_| |
+/_/   \_\___|\__|_|_|_|\__|\__, |
+                           |___/
+    (C)2020 Actility
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Description: SHA-256 block function of the Secure Engine (MBEDTLS_SHA256_PROCESS_ALT).
+             The 64 rounds are unrolled, the state words are renamed instead of
+             moved from one round to the next and the message schedule is a 16
+             words window indexed with constants, so that the compiler keeps as
+             much of it in registers as the Cortex-M4 allows. The message words
+             are loaded with one unaligned LDR and a REV each.
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#if !defined(MBEDTLS_CONFIG_FILE)
+#include "mbedtls/config.h"
+#else
+#include MBEDTLS_CONFIG_FILE
+#endif
+
+#if defined(MBEDTLS_SHA256_C) && defined(MBEDTLS_SHA256_PROCESS_ALT)
+
+#include <string.h>
+#include "mbedtls/sha256.h"
+
+/* Private macros ------------------------------------------------------------*/
+#if defined(__GNUC__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+/* memcpy of a word is a single LDR, unaligned accesses are allowed on ARMv7-M */
+static inline uint32_t SE_SHA256_LoadBE(const unsigned char *pData)
+{
+  uint32_t w;
+
+  memcpy(&w, pData, sizeof(w));
+  return __builtin_bswap32(w);
+}
+#else
+static inline uint32_t SE_SHA256_LoadBE(const unsigned char *pData)
+{
+  return ((uint32_t)pData[0] << 24) | ((uint32_t)pData[1] << 16) | ((uint32_t)pData[2] << 8) | (uint32_t)pData[3];
+}
+#endif
+
+#define SE_SHA256_ROTR(x, n)      (((x) >> (n)) | ((x) << (32U - (n))))
+#define SE_SHA256_SIGMA0(x)       (SE_SHA256_ROTR((x), 2U) ^ SE_SHA256_ROTR((x), 13U) ^ SE_SHA256_ROTR((x), 22U))
+#define SE_SHA256_SIGMA1(x)       (SE_SHA256_ROTR((x), 6U) ^ SE_SHA256_ROTR((x), 11U) ^ SE_SHA256_ROTR((x), 25U))
+#define SE_SHA256_GAMMA0(x)       (SE_SHA256_ROTR((x), 7U) ^ SE_SHA256_ROTR((x), 18U) ^ ((x) >> 3U))
+#define SE_SHA256_GAMMA1(x)       (SE_SHA256_ROTR((x), 17U) ^ SE_SHA256_ROTR((x), 19U) ^ ((x) >> 10U))
+#define SE_SHA256_CH(x, y, z)     ((z) ^ ((x) & ((y) ^ (z))))
+#define SE_SHA256_MAJ(x, y, z)    (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* Message word i of the first 16 rounds, loaded from the block */
+#define SE_SHA256_W_LOAD(i)       (w[(i)] = SE_SHA256_LoadBE(&data[4U * (i)]))
+
+/* Message word i of the rounds 16 to 63, computed in place of word i - 16 */
+#define SE_SHA256_W_NEXT(i)       (w[(i) & 15U] += SE_SHA256_GAMMA1(w[((i) - 2U) & 15U]) + w[((i) - 7U) & 15U] \
+                                                   + SE_SHA256_GAMMA0(w[((i) - 15U) & 15U]))
+
+/* One round: only d and h change, the caller renames the words for the next one */
+#define SE_SHA256_ROUND(a, b, c, d, e, f, g, h, i, W)                                        \
+  do                                                                                         \
+  {                                                                                          \
+    uint32_t t1 = (h) + SE_SHA256_SIGMA1(e) + SE_SHA256_CH((e), (f), (g)) + K[(i)] + W(i); \
+    (d) += t1;                                                                               \
+    (h) = t1 + SE_SHA256_SIGMA0(a) + SE_SHA256_MAJ((a), (b), (c));                           \
+  } while (0)
+
+/* Eight rounds from round i, after which the words are back in place */
+#define SE_SHA256_ROUNDS8(i, W)                                 \
+  do                                                            \
+  {                                                             \
+    SE_SHA256_ROUND(a, b, c, d, e, f, g, h, (i) + 0U, W);       \
+    SE_SHA256_ROUND(h, a, b, c, d, e, f, g, (i) + 1U, W);       \
+    SE_SHA256_ROUND(g, h, a, b, c, d, e, f, (i) + 2U, W);       \
+    SE_SHA256_ROUND(f, g, h, a, b, c, d, e, (i) + 3U, W);       \
+    SE_SHA256_ROUND(e, f, g, h, a, b, c, d, (i) + 4U, W);       \
+    SE_SHA256_ROUND(d, e, f, g, h, a, b, c, (i) + 5U, W);       \
+    SE_SHA256_ROUND(c, d, e, f, g, h, a, b, (i) + 6U, W);       \
+    SE_SHA256_ROUND(b, c, d, e, f, g, h, a, (i) + 7U, W);       \
+  } while (0)
+
+/* Private variables ---------------------------------------------------------*/
+static const uint32_t K[64] =
+{
+  0x428A2F98U, 0x71374491U, 0xB5C0FBCFU, 0xE9B5DBA5U, 0x3956C25BU, 0x59F111F1U, 0x923F82A4U, 0xAB1C5ED5U,
+  0xD807AA98U, 0x12835B01U, 0x243185BEU, 0x550C7DC3U, 0x72BE5D74U, 0x80DEB1FEU, 0x9BDC06A7U, 0xC19BF174U,
+  0xE49B69C1U, 0xEFBE4786U, 0x0FC19DC6U, 0x240CA1CCU, 0x2DE92C6FU, 0x4A7484AAU, 0x5CB0A9DCU, 0x76F988DAU,
+  0x983E5152U, 0xA831C66DU, 0xB00327C8U, 0xBF597FC7U, 0xC6E00BF3U, 0xD5A79147U, 0x06CA6351U, 0x14292967U,
+  0x27B70A85U, 0x2E1B2138U, 0x4D2C6DFCU, 0x53380D13U, 0x650A7354U, 0x766A0ABBU, 0x81C2C92EU, 0x92722C85U,
+  0xA2BFE8A1U, 0xA81A664BU, 0xC24B8B70U, 0xC76C51A3U, 0xD192E819U, 0xD6990624U, 0xF40E3585U, 0x106AA070U,
+  0x19A4C116U, 0x1E376C08U, 0x2748774CU, 0x34B0BCB5U, 0x391C0CB3U, 0x4ED8AA4AU, 0x5B9CCA4FU, 0x682E6FF3U,
+  0x748F82EEU, 0x78A5636FU, 0x84C87814U, 0x8CC70208U, 0x90BEFFFAU, 0xA4506CEBU, 0xBEF9A3F7U, 0xC67178F2U,
+};
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Processes one 64 bytes block, in place of the mbedTLS block function.
+  * @param  ctx SHA-256 context, its state is updated.
+  * @param  data Block to process, with no alignment constraint.
+  * @retval 0
+  */
+int mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx, const unsigned char data[64])
+{
+  uint32_t w[16];
+  uint32_t a = ctx->state[0];
+  uint32_t b = ctx->state[1];
+  uint32_t c = ctx->state[2];
+  uint32_t d = ctx->state[3];
+  uint32_t e = ctx->state[4];
+  uint32_t f = ctx->state[5];
+  uint32_t g = ctx->state[6];
+  uint32_t h = ctx->state[7];
+
+  SE_SHA256_ROUNDS8(0U, SE_SHA256_W_LOAD);
+  SE_SHA256_ROUNDS8(8U, SE_SHA256_W_LOAD);
+  SE_SHA256_ROUNDS8(16U, SE_SHA256_W_NEXT);
+  SE_SHA256_ROUNDS8(24U, SE_SHA256_W_NEXT);
+  SE_SHA256_ROUNDS8(32U, SE_SHA256_W_NEXT);
+  SE_SHA256_ROUNDS8(40U, SE_SHA256_W_NEXT);
+  SE_SHA256_ROUNDS8(48U, SE_SHA256_W_NEXT);
+  SE_SHA256_ROUNDS8(56U, SE_SHA256_W_NEXT);
+
+  ctx->state[0] += a;
+  ctx->state[1] += b;
+  ctx->state[2] += c;
+  ctx->state[3] += d;
+  ctx->state[4] += e;
+  ctx->state[5] += f;
+  ctx->state[6] += g;
+  ctx->state[7] += h;
+
+  return 0;
+}
+
+#if !defined(MBEDTLS_DEPRECATED_REMOVED)
+void mbedtls_sha256_process(mbedtls_sha256_context *ctx, const unsigned char data[64])
+{
+  (void)mbedtls_internal_sha256_process(ctx, data);
+}
+#endif /* !MBEDTLS_DEPRECATED_REMOVED */
+
+#endif /* MBEDTLS_SHA256_C && MBEDTLS_SHA256_PROCESS_ALT */
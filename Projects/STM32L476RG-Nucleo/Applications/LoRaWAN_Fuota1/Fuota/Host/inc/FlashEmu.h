@@ -0,0 +1,130 @@
+/**
+  ******************************************************************************
+  * @file    FlashEmu.h
+  * @author  MCD Application Team
+  * @brief   Flash emulator backing FlashMemHandlerFct on a Linux host. The internal
+  *          flash is a file mapped at its device address, programmed and erased with
+  *          the STM32L4 rules, with wear and timing accounting.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef FLASHEMU_H
+#define FLASHEMU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  const char *Path;           /*!< Backing file, NULL for a blank flash in RAM */
+  uint32_t EraseTimeUs;       /*!< Modelled page erase time */
+  uint32_t ProgramTimeUs;     /*!< Modelled double word program time */
+  uint8_t RealTime;           /*!< Wait for the modelled time of each operation */
+} FlashEmuConfig_t;
+
+typedef struct
+{
+  uint32_t Erases;            /*!< Pages erased */
+  uint32_t MaxPageErases;     /*!< Highest erase count of a single page */
+  uint32_t DoubleWords;       /*!< Double words programmed one by one */
+  uint32_t BytesRead;         /*!< Bytes read through FlashMemHandlerFct.Read */
+  uint32_t Violations;        /*!< Operations refused by the programming rules */
+  uint64_t TimeUs;            /*!< Modelled time spent erasing and programming */
+} FlashEmuStats_t;
+
+/* Exported constants --------------------------------------------------------*/
+/* Typical STM32L476 timings, datasheet table "Flash memory characteristics" */
+#define FLASH_EMU_ERASE_TIME_US       22000U  /*!< One page */
+#define FLASH_EMU_PROGRAM_TIME_US     82U     /*!< One double word */
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Maps the emulated flash at FLASH_BASE.
+  * @note   A new or short backing file is extended with blank bytes, an
+  *         existing one keeps its content so that a reset can be emulated by
+  *         closing and opening it again. FlashMemHandlerFct.Init opens a
+  *         blank flash in RAM with the typical timings if nothing is mapped.
+  * @param  pConfig: emulator configuration, NULL for the defaults
+  * @retval 0 on success, -1 otherwise.
+  */
+int FlashEmuOpen(const FlashEmuConfig_t *pConfig);
+
+/**
+  * @brief  Flushes the backing file and unmaps the emulated flash.
+  * @param  None
+  * @retval None
+  */
+void FlashEmuClose(void);
+
+/**
+  * @brief  Gets the emulator statistics since the flash was opened or the
+  *         statistics reset.
+  * @param  None
+  * @retval Statistics
+  */
+FlashEmuStats_t FlashEmuGetStats(void);
+
+/**
+  * @brief  Resets the statistics, including the erase count of each page.
+  * @param  None
+  * @retval None
+  */
+void FlashEmuResetStats(void);
+
+/**
+  * @brief  Gets the erase count of a page.
+  * @param  uAddr: any address in the page
+  * @retval Number of erases of the page since the statistics were reset
+  */
+uint32_t FlashEmuGetPageErases(uint32_t uAddr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* FLASHEMU_H */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
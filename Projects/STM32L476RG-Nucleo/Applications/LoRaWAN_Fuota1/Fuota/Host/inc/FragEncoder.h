@@ -0,0 +1,121 @@
+/**
+  ******************************************************************************
+  * @file    FragEncoder.h
+  * @author  MCD Application Team
+  * @brief   Server side encoder of the LoRaWAN fragmented data block
+  *          transport, producing the payload of the fragments.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef FRAGENCODER_H
+#define FRAGENCODER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  const uint8_t *pFile;       /*!< File to transfer, FragNb * FragSize bytes with the padding */
+  uint16_t FragNb;            /*!< Number of uncoded fragments */
+  uint8_t FragSize;           /*!< Fragment size in bytes */
+} FragEncoder_t;
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Initializes an encoder.
+  * @param  pEncoder: encoder
+  * @param  pFile: file to transfer, padding included
+  * @param  FragNb: number of uncoded fragments
+  * @param  FragSize: fragment size in bytes
+  * @retval None
+  */
+void FragEncoderInit(FragEncoder_t *pEncoder, const uint8_t *pFile, uint16_t FragNb, uint8_t FragSize);
+
+/**
+  * @brief  Gets the data of a fragment.
+  * @note   Fragments 1 to FragNb are the file rows, the next ones are coded
+  *         with the parity matrix of the reference FragPrbs23 scheme.
+  * @param  pEncoder: encoder
+  * @param  FragCounter: fragment counter, starting at 1
+  * @param  pData: fragment data, FragSize bytes
+  * @retval None
+  */
+void FragEncoderGetFragment(const FragEncoder_t *pEncoder, uint16_t FragCounter, uint8_t *pData);
+
+/**
+  * @brief  Builds a FragSessionSetupReq command.
+  * @param  FragIndex: fragmentation session index
+  * @param  FragNb: number of uncoded fragments
+  * @param  FragSize: fragment size in bytes
+  * @param  Padding: padding bytes at the end of the last uncoded fragment
+  * @param  pCmd: command buffer, FRAG_ENCODER_SETUP_REQ_SIZE bytes
+  * @retval Command size in bytes
+  */
+uint8_t FragEncoderSessionSetupReq(uint8_t FragIndex, uint16_t FragNb, uint8_t FragSize, uint8_t Padding,
+                                   uint8_t *pCmd);
+
+/**
+  * @brief  Builds a DataFragment command.
+  * @param  pEncoder: encoder
+  * @param  FragIndex: fragmentation session index
+  * @param  FragCounter: fragment counter, starting at 1
+  * @param  pCmd: command buffer, FragSize + FRAG_ENCODER_DATA_FRAGMENT_HDR_SIZE bytes
+  * @retval Command size in bytes
+  */
+uint16_t FragEncoderDataFragment(const FragEncoder_t *pEncoder, uint8_t FragIndex, uint16_t FragCounter,
+                                 uint8_t *pCmd);
+
+/* Exported constants --------------------------------------------------------*/
+#define FRAG_ENCODER_SETUP_REQ_SIZE           11U
+#define FRAG_ENCODER_DATA_FRAGMENT_HDR_SIZE   3U
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* FRAGENCODER_H */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
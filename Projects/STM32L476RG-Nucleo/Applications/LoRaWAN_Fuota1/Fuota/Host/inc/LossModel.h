@@ -0,0 +1,128 @@
+/**
+  ******************************************************************************
+  * @file    LossModel.h
+  * @author  MCD Application Team
+  * @brief   Downlink loss models of the host FUOTA benchmark.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef LOSSMODEL_H
+#define LOSSMODEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  LOSS_MODEL_IID = 0,           /*!< Each frame is lost with the same probability */
+  LOSS_MODEL_GILBERT_ELLIOTT,   /*!< Two states Markov chain, losses come in bursts */
+  LOSS_MODEL_TAIL               /*!< The last uncoded fragments are all lost */
+} LossModelType_t;
+
+typedef struct
+{
+  LossModelType_t Type;
+  double Loss;                  /*!< IID: loss probability, TAIL: lost fraction of the uncoded fragments */
+  double PGoodBad;              /*!< GILBERT_ELLIOTT: transition probability from the good to the bad state */
+  double PBadGood;              /*!< GILBERT_ELLIOTT: transition probability from the bad to the good state */
+  double LossGood;              /*!< GILBERT_ELLIOTT: loss probability in the good state */
+  double LossBad;               /*!< GILBERT_ELLIOTT: loss probability in the bad state */
+  bool IsBad;                   /*!< GILBERT_ELLIOTT: current state */
+} LossModel_t;
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Parses a loss model description.
+  * @note   The descriptions are "iid:P", "ge:PGB:PBG[:LG:LB]" and "tail:F",
+  *         probabilities and fractions are between 0 and 1. The Gilbert-Elliott
+  *         model loses no frame in the good state and every frame in the bad
+  *         state by default.
+  * @param  pDesc: description
+  * @param  pModel: model
+  * @retval 0 on success, -1 if the description is not valid.
+  */
+int LossModelParse(const char *pDesc, LossModel_t *pModel);
+
+/**
+  * @brief  Seeds the random generator shared by all the models.
+  * @param  Seed: seed
+  * @retval None
+  */
+void LossModelSeed(uint32_t Seed);
+
+/**
+  * @brief  Gets a random number from the generator shared by all the models.
+  * @param  None
+  * @retval Random number
+  */
+uint32_t LossModelRandom(void);
+
+/**
+  * @brief  Restarts a model for a new session, a Gilbert-Elliott chain
+  *         starts in its stationary distribution.
+  * @param  pModel: model
+  * @retval None
+  */
+void LossModelReset(LossModel_t *pModel);
+
+/**
+  * @brief  Tells if a frame is lost.
+  * @note   Must be called once per frame sent, in order.
+  * @param  pModel: model
+  * @param  FragCounter: fragment counter of the frame, starting at 1
+  * @param  FragNb: number of uncoded fragments
+  * @retval true if the frame is lost
+  */
+bool LossModelIsLost(LossModel_t *pModel, uint16_t FragCounter, uint16_t FragNb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* LOSSMODEL_H */
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,307 @@
+/**
+  ******************************************************************************
+  * @file    Crc32Check.c
+  * @author  MCD Application Team
+  * @brief   Host check of the CRC32 engines: the bitwise, slice by 4 and slice by 8
+  *          engines and a model of the STM32L4 CRC peripheral as crc32_update_hw sets
+  *          it up must give the same register on random lengths, alignments and
+  *          splits. The throughput of the software engines is reported.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "crc32.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Data offset at most, from an 8 bytes aligned buffer */
+#define CHECK_MAX_OFFSET          7U
+#define CHECK_SPEED_SIZE          (64U * 1024U)
+#define CHECK_SPEED_ROUNDS        2000U
+
+/* CRC peripheral settings used by crc32_update_hw */
+#define PERIPH_POL                0x04C11DB7U
+#define PERIPH_REV_IN_BYTE        0x01U
+#define PERIPH_REV_OUT            0x02U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef uint32_t (*CheckEngine_t)(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+typedef struct
+{
+  const char *pName;
+  CheckEngine_t Update;
+} CheckEngineDesc_t;
+
+/* Bit level model of the CRC peripheral, 32 bits polynomial */
+typedef struct
+{
+  uint32_t Pol;
+  uint32_t Cr;                /*!< PERIPH_REV_IN_BYTE and PERIPH_REV_OUT */
+  uint32_t Crc;               /*!< Register shifted MSB first */
+} Periph_t;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t ModelUpdate(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t Trials = 200000U;
+static uint32_t MaxLength = 600U;
+static uint32_t Seed = 1U;
+
+static const CheckEngineDesc_t Engines[] =
+{
+  { "slice by 4", crc32_update_slice4 },
+  { "slice by 8", crc32_update_slice8 },
+  { "periph model", ModelUpdate },
+  { "crc32_update", crc32_update },
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t Rbit(uint32_t v)
+{
+  uint32_t r = 0U;
+
+  for (uint32_t i = 0U; i < 32U; i++)
+  {
+    r = (r << 1) | ((v >> i) & 1U);
+  }
+  return r;
+}
+
+static uint32_t Rev(uint32_t v)
+{
+  return (v >> 24) | ((v >> 8) & 0x0000FF00U) | ((v << 8) & 0x00FF0000U) | (v << 24);
+}
+
+/**
+  * @brief  Write of Size bytes to the data register: the bits of each byte
+  *         are reversed with PERIPH_REV_IN_BYTE, then shifted in MSB first.
+  */
+static void PeriphWrite(Periph_t *pPeriph, uint32_t Data, uint32_t Size)
+{
+  uint32_t bits = Size * 8U;
+
+  if ((pPeriph->Cr & PERIPH_REV_IN_BYTE) != 0U)
+  {
+    uint32_t rev = 0U;
+
+    for (uint32_t i = 0U; i < Size; i++)
+    {
+      rev |= (Rbit((Data >> (8U * i)) & 0xFFU) >> 24) << (8U * i);
+    }
+    Data = rev;
+  }
+  for (uint32_t i = bits; i > 0U; i--)
+  {
+    uint32_t in = ((pPeriph->Crc >> 31) ^ (Data >> (i - 1U))) & 1U;
+
+    pPeriph->Crc = (pPeriph->Crc << 1) ^ ((in != 0U) ? pPeriph->Pol : 0U);
+  }
+}
+
+static uint32_t PeriphRead(const Periph_t *pPeriph)
+{
+  return ((pPeriph->Cr & PERIPH_REV_OUT) != 0U) ? Rbit(pPeriph->Crc) : pPeriph->Crc;
+}
+
+/**
+  * @brief  crc32_update_hw on the peripheral model: same register setup, same
+  *         word and byte writes.
+  */
+static uint32_t ModelUpdate(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+  Periph_t periph;
+  uint32_t w;
+
+  periph.Pol = PERIPH_POL;
+  periph.Cr = PERIPH_REV_IN_BYTE | PERIPH_REV_OUT;
+  /* CRC->INIT = __RBIT(crc) then CR_RESET */
+  periph.Crc = Rbit(crc);
+  for (; len >= 4U; len -= 4U, buf += 4U)
+  {
+    memcpy(&w, buf, 4U);
+    PeriphWrite(&periph, Rev(w), 4U);
+  }
+  for (; len > 0U; len--)
+  {
+    PeriphWrite(&periph, *buf++, 1U);
+  }
+  return PeriphRead(&periph);
+}
+
+static uint32_t Random(void)
+{
+  Seed = Seed * 1103515245U + 12345U;
+  return Seed >> 1;
+}
+
+static uint64_t NowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+/**
+  * @brief  Throughput of an engine on an aligned buffer, in MB/s.
+  */
+static double Speed(CheckEngine_t Update, const uint8_t *pData)
+{
+  volatile uint32_t sink;
+  uint32_t crc = CRC32_INITIAL_VALUE;
+  uint64_t start = NowNs();
+
+  for (uint32_t i = 0U; i < CHECK_SPEED_ROUNDS; i++)
+  {
+    crc = Update(crc, pData, CHECK_SPEED_SIZE);
+  }
+  sink = crc;
+  (void)sink;
+  return (double)CHECK_SPEED_ROUNDS * CHECK_SPEED_SIZE / ((double)(NowNs() - start) / 1000.0);
+}
+
+static void Usage(const char *pName)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -t Trials       random buffers checked (%" PRIu32 ")\n"
+          "  -l Length       buffer length at most (%" PRIu32 ")\n"
+          "  -S Seed         random seed (%" PRIu32 ")\n",
+          pName, Trials, MaxLength, Seed);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  const uint32_t nbEngines = sizeof(Engines) / sizeof(Engines[0]);
+  uint32_t errors[sizeof(Engines) / sizeof(Engines[0])] = { 0U };
+  uint32_t total = 0U;
+  uint64_t *words;
+  uint8_t *buf;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:l:S:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': Trials = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'l': MaxLength = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'S': Seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+      default:
+        Usage(argv[0]);
+        return 2;
+    }
+  }
+
+  /* 64 bits words for an 8 bytes aligned buffer */
+  words = malloc(((MaxLength > CHECK_SPEED_SIZE) ? MaxLength : CHECK_SPEED_SIZE) + CHECK_MAX_OFFSET + 8U);
+  if (words == NULL)
+  {
+    return 1;
+  }
+  buf = (uint8_t *)words;
+
+  /* Known answer: CRC32 of "123456789" */
+  if (crc32_compute((const uint8_t *)"123456789", 9U) != 0xCBF43926U)
+  {
+    fprintf(stderr, "crc32_compute(\"123456789\") is not 0xCBF43926\n");
+    total++;
+  }
+  if (crc32_self_test() != true)
+  {
+    fprintf(stderr, "crc32_self_test failed\n");
+    total++;
+  }
+
+  for (uint32_t trial = 0U; trial < Trials; trial++)
+  {
+    uint32_t offset = Random() % (CHECK_MAX_OFFSET + 1U);
+    uint32_t len = Random() % (MaxLength + 1U);
+    uint32_t split = (len > 0U) ? Random() % (len + 1U) : 0U;
+    uint32_t init = ((Random() & 1U) != 0U) ? CRC32_INITIAL_VALUE : Random();
+    const uint8_t *data = buf + offset;
+    uint32_t ref;
+
+    for (uint32_t i = 0U; i < len; i++)
+    {
+      buf[offset + i] = (uint8_t)Random();
+    }
+    ref = crc32_update_bitwise(init, data, len);
+    for (uint32_t e = 0U; e < nbEngines; e++)
+    {
+      uint32_t whole = Engines[e].Update(init, data, len);
+      uint32_t carried = Engines[e].Update(Engines[e].Update(init, data, split), data + split, len - split);
+
+      if ((whole != ref) || (carried != ref))
+      {
+        if (errors[e] == 0U)
+        {
+          fprintf(stderr, "%s: length %" PRIu32 " offset %" PRIu32 " split %" PRIu32 ": %08" PRIX32 " %08" PRIX32
+                  " instead of %08" PRIX32 "\n", Engines[e].pName, len, offset, split, whole, carried, ref);
+        }
+        errors[e]++;
+      }
+    }
+  }
+
+  printf("trials        : %" PRIu32 ", lengths up to %" PRIu32 ", offsets up to %u\n", Trials, MaxLength,
+         CHECK_MAX_OFFSET);
+  for (uint32_t e = 0U; e < nbEngines; e++)
+  {
+    printf("%-13s : %" PRIu32 " mismatches with the bitwise engine\n", Engines[e].pName, errors[e]);
+    total += errors[e];
+  }
+
+  memset(buf, 0x5A, CHECK_SPEED_SIZE);
+  printf("speed         : bitwise %.0f MB/s, slice by 4 %.0f MB/s, slice by 8 %.0f MB/s\n",
+         Speed(crc32_update_bitwise, buf), Speed(crc32_update_slice4, buf), Speed(crc32_update_slice8, buf));
+
+  free(words);
+  return (total == 0U) ? 0 : 1;
+}
@@ -0,0 +1,367 @@
+/**
+  ******************************************************************************
+  * @file    FlashEmu.c
+  * @author  MCD Application Team
+  * @brief   Flash emulator backing FlashMemHandlerFct on a Linux host. Replaces
+  *          FlashMemHandler.c in the host build: the internal flash is a file mapped
+  *          at FLASH_BASE so that the code reading it directly keeps working, and
+  *          every erase and program call is checked against the STM32L4 rules.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "FlashMemHandler.h"
+#include "FlashEmu.h"
+
+/* Private define ------------------------------------------------------------*/
+#define FLASH_EMU_NB_PAGES        (FLASH_SIZE / FLASH_PAGE_SIZE)
+
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE       MAP_FIXED
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+static uint8_t *Flash = NULL;
+static int FlashFd = -1;
+static FlashEmuConfig_t Config;
+static FlashEmuStats_t Stats;
+static FlashMemHandler_WriteStats_t WriteStats;
+static uint64_t WriteTimeUs = 0U;
+static uint32_t PageErases[FLASH_EMU_NB_PAGES];
+
+/* Private function prototypes -----------------------------------------------*/
+static bool IsInFlash(uint32_t uAddr, uint32_t uLength);
+static void Spend(uint32_t uTimeUs);
+static void Violation(const char *pOperation, uint32_t uAddr, uint32_t uLength);
+
+static HAL_StatusTypeDef FlashEmu_Init(void);
+static HAL_StatusTypeDef FlashEmu_Erase_Size(void *pStart, uint32_t uLength);
+static HAL_StatusTypeDef FlashEmu_Write(void *pDestination, const void *pSource, uint32_t uLength);
+static HAL_StatusTypeDef FlashEmu_Read(void *pSource, void *pDestination, uint32_t Length);
+
+const struct  FlashMemHandlerFct_s FlashMemHandlerFct =
+{
+  .Init = FlashEmu_Init,
+  .Erase_Size = FlashEmu_Erase_Size,
+  .Write = FlashEmu_Write,
+  .Read = FlashEmu_Read,
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Checks that a range of addresses is in the internal flash
+  */
+static bool IsInFlash(uint32_t uAddr, uint32_t uLength)
+{
+  return (uAddr >= FLASH_BASE) && (uLength <= FLASH_SIZE) && ((uAddr - FLASH_BASE) <= (FLASH_SIZE - uLength));
+}
+
+/**
+  * @brief  Accounts for the modelled time of an operation, and waits for it
+  *         in real time mode
+  */
+static void Spend(uint32_t uTimeUs)
+{
+  Stats.TimeUs += uTimeUs;
+  if (Config.RealTime != 0U)
+  {
+    struct timespec ts = { .tv_sec = uTimeUs / 1000000U, .tv_nsec = (long)(uTimeUs % 1000000U) * 1000L };
+
+    nanosleep(&ts, NULL);
+  }
+}
+
+/**
+  * @brief  Records an operation the flash controller would refuse
+  */
+static void Violation(const char *pOperation, uint32_t uAddr, uint32_t uLength)
+{
+  Stats.Violations++;
+  fprintf(stderr, "[FLASH_EMU] %s refused at 0x%08lx length %lu\n", pOperation,
+          (unsigned long)uAddr, (unsigned long)uLength);
+}
+
+/**
+  * @brief  Opens a blank flash in RAM unless one is mapped already
+  * @param  None
+  * @retval HAL Status.
+  */
+static HAL_StatusTypeDef FlashEmu_Init(void)
+{
+  if (Flash == NULL && FlashEmuOpen(NULL) != 0)
+  {
+    return HAL_ERROR;
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Erases the pages a range of bytes spans.
+  * @param  pStart: Start of the range
+  * @param  uLength: number of bytes.
+  * @retval HAL status.
+  */
+static HAL_StatusTypeDef FlashEmu_Erase_Size(void *pStart, uint32_t uLength)
+{
+  uint32_t uStart = (uint32_t)(uintptr_t)pStart;
+  uint32_t first_page, last_page, page;
+
+  if (Flash == NULL || uLength == 0U || !IsInFlash(uStart, uLength))
+  {
+    Violation("Erase", uStart, uLength);
+    return HAL_ERROR;
+  }
+  first_page = (uStart - FLASH_BASE) / FLASH_PAGE_SIZE;
+  last_page = (uStart + uLength - 1U - FLASH_BASE) / FLASH_PAGE_SIZE;
+  for (page = first_page; page <= last_page; page++)
+  {
+    memset(Flash + page * FLASH_PAGE_SIZE, 0xFF, FLASH_PAGE_SIZE);
+    PageErases[page]++;
+    if (PageErases[page] > Stats.MaxPageErases)
+    {
+      Stats.MaxPageErases = PageErases[page];
+    }
+    Stats.Erases++;
+    Spend(Config.EraseTimeUs);
+  }
+  return HAL_OK;
+}
+
+/**
+  * @brief  Programs a buffer by double word like FlashMemHandler.c does. A
+  *         double word can only be programmed when erased, or cleared to
+  *         zero. After writing data buffer, the flash content is checked.
+  * @param  pDestination: Start address for target location
+  * @param  pSource: pointer on buffer with data to write
+  * @param  uLength: Length of data buffer in byte. It has to be 64-bit aligned.
+  * @retval HAL Status.
+  */
+static HAL_StatusTypeDef FlashEmu_Write(void *pDestination, const void *pSource, uint32_t uLength)
+{
+  uint32_t uDest = (uint32_t)(uintptr_t)pDestination;
+  const uint8_t *pdata = (const uint8_t *)pSource;
+  uint64_t current, value;
+  uint64_t start_time = Stats.TimeUs;
+  uint32_t i = 0U;
+
+  if (Flash == NULL || !IsInFlash(uDest, uLength) || (uDest % 8U) != 0U || (uLength % 8U) != 0U)
+  {
+    Violation("Write", uDest, uLength);
+    return HAL_ERROR;
+  }
+  for (i = 0U; i < uLength; i += 8U)
+  {
+    memcpy(&current, Flash + (uDest + i - FLASH_BASE), 8U);
+    memcpy(&value, pdata + i, 8U);
+    if (current != 0xFFFFFFFFFFFFFFFFULL && value != 0U)
+    {
+      /* PROGERR: the double word is not erased */
+      Violation("Program", uDest + i, 8U);
+      WriteTimeUs += Stats.TimeUs - start_time;
+      return HAL_ERROR;
+    }
+    memcpy(Flash + (uDest + i - FLASH_BASE), &value, 8U);
+    Stats.DoubleWords++;
+    Spend(Config.ProgramTimeUs);
+  }
+  WriteTimeUs += Stats.TimeUs - start_time;
+  /* Check the written buffer at once */
+  if (memcmp(pDestination, pSource, uLength) != 0)
+  {
+    return HAL_ERROR;
+  }
+  WriteStats.Bytes += uLength;
+  return HAL_OK;
+}
+
+/**
+  * @brief  This function reads flash
+  * @param  pSource: Start address for flash location
+  * @param  pDestination: pointer on buffer with data to write
+  * @param  Length: Length in bytes of data buffer
+  * @retval HAL_StatusTypeDef HAL_OK if successful, HAL_ERROR otherwise.
+  */
+static HAL_StatusTypeDef FlashEmu_Read(void *pSource, void *pDestination, uint32_t Length)
+{
+  uint32_t uSource = (uint32_t)(uintptr_t)pSource;
+
+  if (Flash == NULL || !IsInFlash(uSource, Length))
+  {
+    Violation("Read", uSource, Length);
+    return HAL_ERROR;
+  }
+  memcpy(pDestination, pSource, Length);
+  Stats.BytesRead += Length;
+  return HAL_OK;
+}
+
+/* Public functions ---------------------------------------------------------*/
+
+int FlashEmuOpen(const FlashEmuConfig_t *pConfig)
+{
+  static const FlashEmuConfig_t default_config =
+  {
+    .Path = NULL,
+    .EraseTimeUs = FLASH_EMU_ERASE_TIME_US,
+    .ProgramTimeUs = FLASH_EMU_PROGRAM_TIME_US,
+    .RealTime = 0U,
+  };
+  struct stat st;
+  void *p;
+
+  if (Flash != NULL)
+  {
+    FlashEmuClose();
+  }
+  Config = (pConfig != NULL) ? *pConfig : default_config;
+  if (Config.Path != NULL)
+  {
+    FlashFd = open(Config.Path, O_RDWR | O_CREAT, 0644);
+    if (FlashFd < 0 || fstat(FlashFd, &st) != 0)
+    {
+      perror(Config.Path);
+      FlashEmuClose();
+      return -1;
+    }
+    /* Blank bytes past the end of a new or short file */
+    if ((uint64_t)st.st_size < FLASH_SIZE)
+    {
+      static const uint8_t blank[FLASH_PAGE_SIZE] = { [0 ... FLASH_PAGE_SIZE - 1U] = 0xFF };
+      off_t pos = st.st_size;
+
+      while (pos < (off_t)FLASH_SIZE)
+      {
+        size_t n = FLASH_PAGE_SIZE - ((size_t)pos % FLASH_PAGE_SIZE);
+
+        if (pwrite(FlashFd, blank, n, pos) != (ssize_t)n)
+        {
+          perror(Config.Path);
+          FlashEmuClose();
+          return -1;
+        }
+        pos += (off_t)n;
+      }
+    }
+    p = mmap((void *)(uintptr_t)FLASH_BASE, FLASH_SIZE, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_FIXED_NOREPLACE, FlashFd, 0);
+  }
+  else
+  {
+    p = mmap((void *)(uintptr_t)FLASH_BASE, FLASH_SIZE, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    if (p != MAP_FAILED)
+    {
+      memset(p, 0xFF, FLASH_SIZE);
+    }
+  }
+  if (p != (void *)(uintptr_t)FLASH_BASE)
+  {
+    fprintf(stderr, "[FLASH_EMU] cannot map the flash at 0x%08lx\n", (unsigned long)FLASH_BASE);
+    if (p != MAP_FAILED)
+    {
+      munmap(p, FLASH_SIZE);
+    }
+    FlashEmuClose();
+    return -1;
+  }
+  Flash = p;
+  FlashEmuResetStats();
+  return 0;
+}
+
+void FlashEmuClose(void)
+{
+  if (Flash != NULL)
+  {
+    msync(Flash, FLASH_SIZE, MS_SYNC);
+    munmap(Flash, FLASH_SIZE);
+    Flash = NULL;
+  }
+  if (FlashFd >= 0)
+  {
+    close(FlashFd);
+    FlashFd = -1;
+  }
+}
+
+FlashEmuStats_t FlashEmuGetStats(void)
+{
+  return Stats;
+}
+
+void FlashEmuResetStats(void)
+{
+  memset(&Stats, 0, sizeof(Stats));
+  memset(&WriteStats, 0, sizeof(WriteStats));
+  memset(PageErases, 0, sizeof(PageErases));
+  WriteTimeUs = 0U;
+}
+
+uint32_t FlashEmuGetPageErases(uint32_t uAddr)
+{
+  if (!IsInFlash(uAddr, 1U))
+  {
+    return 0U;
+  }
+  return PageErases[(uAddr - FLASH_BASE) / FLASH_PAGE_SIZE];
+}
+
+/**
+  * @brief  Gets the flash write statistics since the emulator was opened,
+  *         with the modelled write time
+  * @param  None
+  * @retval Bytes written and time spent
+  */
+FlashMemHandler_WriteStats_t FlashMemHandler_GetWriteStats(void)
+{
+  WriteStats.TimeMs = (uint32_t)(WriteTimeUs / 1000U);
+  return WriteStats;
+}
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
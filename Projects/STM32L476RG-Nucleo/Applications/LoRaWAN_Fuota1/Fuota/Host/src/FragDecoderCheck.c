@@ -0,0 +1,726 @@
+/**
+  ******************************************************************************
+  * @file    FragDecoderCheck.c
+  * @author  MCD Application Team
+  * @brief   Host check of FragDecoder against the reference decoder it was
+  *          derived from (ref/): both decode the same fragment streams, their
+  *          status must match after each fragment and the rebuilt files must be
+  *          identical. The CPU time of both is reported.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "FragDecoder.h"
+#include "FragEncoder.h"
+#include "LossModel.h"
+
+/* Private define ------------------------------------------------------------*/
+#define CHECK_MAX_LOSS_MODELS     4U
+/* Limits of the reference decoder, FRAG_MAX_NB and FRAG_MAX_REDUNDANCY of its FragDecoder.h */
+#define CHECK_REF_MAX_NB          1000U
+#define CHECK_REF_MAX_LOST        60U
+/* Uncoded fragments lost by the counter check */
+#define CHECK_COUNTERS_LOST       10U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint16_t FragNb;
+  uint8_t FragSize;
+  uint16_t MaxCoded;          /*!< Coded fragments sent at most after the uncoded ones */
+  uint32_t Trials;
+  uint32_t Seed;
+  uint32_t ArenaSize;         /*!< RAM given to the fragmentation decoder */
+  LossModel_t LossModels[CHECK_MAX_LOSS_MODELS];
+  uint32_t NbLossModels;
+} CheckConfig_t;
+
+typedef struct
+{
+  uint8_t *pData;
+  uint32_t Size;
+} CheckStorage_t;
+
+/* Outcome of FragDecoderProcess for one fragment */
+typedef struct
+{
+  int32_t Ret;
+  FragDecoderStatus_t Status;
+} CheckStep_t;
+
+typedef struct
+{
+  uint64_t UncodedNs;         /*!< Time of the session setup and the uncoded fragments */
+  uint64_t CodedNs;           /*!< Time of the coded fragments, but the one completing the session */
+  uint64_t DoneNs;            /*!< Time of the fragment completing the session, reconstruction included */
+  uint64_t IdleNs;            /*!< Time of the work done between two fragments */
+  uint32_t CodedNb;           /*!< Coded fragments timed in CodedNs */
+  uint32_t DoneNb;            /*!< Sessions completed */
+} CheckTime_t;
+
+/* One decoder under check */
+typedef struct
+{
+  void (*Init)(void);
+  int32_t (*Process)(uint16_t FragCounter, uint8_t *pData);
+  int32_t (*Solve)(void);
+  void (*Idle)(void);
+  FragDecoderStatus_t (*GetStatus)(void);
+  CheckStorage_t *pStorage;
+  CheckStep_t *pSteps;
+  CheckTime_t Time;
+} CheckDecoder_t;
+
+/* Private variables ---------------------------------------------------------*/
+static CheckConfig_t Config =
+{
+  .FragNb = 500U,
+  .FragSize = 200U,
+  .MaxCoded = 120U,
+  .Trials = 100U,
+  .Seed = 1U,
+  .ArenaSize = 16384U,
+};
+
+static CheckStorage_t RefStorage;
+static CheckStorage_t Storage;
+/* Storage of the decoder, sized to give up past the same number of lost fragments as the reference */
+static FragDecoderRegion_t Region;
+/* Fragments of a trial as sent, and the counters of the received ones */
+static uint8_t *Fragments;
+static uint16_t *Received;
+static uint32_t ReceivedNb;
+
+/* Baseline FragDecoder of ref/, symbols renamed at build time */
+void ref_FragDecoderInit(uint16_t fragNb, uint8_t fragSize, FragDecoderCallbacks_t *callbacks);
+int32_t ref_FragDecoderProcess(uint16_t fragCounter, uint8_t *rawData);
+FragDecoderStatus_t ref_FragDecoderGetStatus(void);
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t NowNs(void);
+static uint8_t StorageWrite(CheckStorage_t *pStorage, uint32_t addr, uint8_t *data, uint32_t size);
+static uint8_t StorageRead(CheckStorage_t *pStorage, uint32_t addr, uint8_t *data, uint32_t size);
+static uint8_t RefWrite(uint32_t addr, uint8_t *data, uint32_t size);
+static uint8_t RefRead(uint32_t addr, uint8_t *data, uint32_t size);
+static uint8_t Write(uint32_t addr, uint8_t *data, uint32_t size);
+static uint8_t Read(uint32_t addr, uint8_t *data, uint32_t size);
+static void RefInit(void);
+static FragDecoderStatus_t RefGetStatus(void);
+static void Init(void);
+static int32_t Process(uint16_t FragCounter, uint8_t *pData);
+static int32_t Solve(void);
+static void Idle(void);
+static FragDecoderStatus_t GetStatus(void);
+static uint32_t Decode(CheckDecoder_t *pDecoder);
+static int RunTrial(uint32_t uTrial, uint8_t *pFile, CheckDecoder_t *pRef, CheckDecoder_t *pDecoder);
+static int CheckCounters(uint8_t *pFile);
+static int CheckNvmCtx(uint8_t *pFile);
+static double PerCall(uint64_t Ns, uint32_t Nb);
+static void Report(const char *pName, const CheckTime_t *pTime);
+static void Usage(const char *pName);
+
+static FragDecoderCallbacks_t RefCallbacks =
+{
+  .FragDecoderWrite = RefWrite,
+  .FragDecoderRead = RefRead,
+};
+
+static FragDecoderCallbacks_t Callbacks =
+{
+  .FragDecoderWrite = Write,
+  .FragDecoderRead = Read,
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Gets the monotonic time, read without a system call.
+  */
+static uint64_t NowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/**
+  * @brief  RAM storage behind the decoder callbacks.
+  */
+static uint8_t StorageWrite(CheckStorage_t *pStorage, uint32_t addr, uint8_t *data, uint32_t size)
+{
+  if ((addr > pStorage->Size) || (size > (pStorage->Size - addr)))
+  {
+    return (uint8_t) -1;
+  }
+  memcpy(&pStorage->pData[addr], data, size);
+  return 0U;
+}
+
+static uint8_t StorageRead(CheckStorage_t *pStorage, uint32_t addr, uint8_t *data, uint32_t size)
+{
+  if ((addr > pStorage->Size) || (size > (pStorage->Size - addr)))
+  {
+    return (uint8_t) -1;
+  }
+  memcpy(data, &pStorage->pData[addr], size);
+  return 0U;
+}
+
+static uint8_t RefWrite(uint32_t addr, uint8_t *data, uint32_t size)
+{
+  return StorageWrite(&RefStorage, addr, data, size);
+}
+
+static uint8_t RefRead(uint32_t addr, uint8_t *data, uint32_t size)
+{
+  return StorageRead(&RefStorage, addr, data, size);
+}
+
+static uint8_t Write(uint32_t addr, uint8_t *data, uint32_t size)
+{
+  return StorageWrite(&Storage, addr, data, size);
+}
+
+static uint8_t Read(uint32_t addr, uint8_t *data, uint32_t size)
+{
+  return StorageRead(&Storage, addr, data, size);
+}
+
+/**
+  * @brief  Reference decoder entry points.
+  */
+static void RefInit(void)
+{
+  ref_FragDecoderInit(Config.FragNb, Config.FragSize, &RefCallbacks);
+}
+
+static FragDecoderStatus_t RefGetStatus(void)
+{
+  return ref_FragDecoderGetStatus();
+}
+
+/**
+  * @brief  Checked decoder entry points. The missing rows are rebuilt right after the fragment completing the
+  *         system and the parity rows are generated ahead of time between two fragments, as in the main loop of
+  *         the application.
+  */
+static void Init(void)
+{
+  FragDecoderInit(0U, Config.FragNb, Config.FragSize, &Callbacks, &Region);
+}
+
+static int32_t Process(uint16_t FragCounter, uint8_t *pData)
+{
+  return FragDecoderProcess(0U, FragCounter, pData);
+}
+
+static int32_t Solve(void)
+{
+  return FragDecoderSolve(0U);
+}
+
+static void Idle(void)
+{
+  FragDecoderPrefetch();
+}
+
+static FragDecoderStatus_t GetStatus(void)
+{
+  return FragDecoderGetStatus(0U);
+}
+
+/**
+  * @brief  Gives the received fragments of a trial to a decoder until it is done and records its status after
+  *         each one. The uncoded fragments are timed as a whole, each coded one on its own.
+  * @retval Number of fragments processed.
+  */
+static uint32_t Decode(CheckDecoder_t *pDecoder)
+{
+  uint8_t data[FRAG_MAX_SIZE];
+  uint64_t start = NowNs();
+  uint64_t ns;
+  bool isCoded = false;
+  uint32_t i;
+
+  pDecoder->Init();
+  for (i = 0U; i < ReceivedNb; i++)
+  {
+    uint16_t counter = Received[i];
+    int32_t ret;
+
+    /* The decoders work on the fragment in place */
+    memcpy(data, &Fragments[(uint32_t)(counter - 1U) * Config.FragSize], Config.FragSize);
+    if ((counter > Config.FragNb) && !isCoded)
+    {
+      isCoded = true;
+      pDecoder->Time.UncodedNs += NowNs() - start;
+    }
+    if (isCoded)
+    {
+      start = NowNs();
+    }
+    ret = pDecoder->Process(counter, data);
+    if ((ret == FRAG_SESSION_ONGOING) && (pDecoder->Solve != NULL))
+    {
+      ret = pDecoder->Solve();
+    }
+    if (isCoded)
+    {
+      ns = NowNs() - start;
+      if (ret == FRAG_SESSION_ONGOING)
+      {
+        pDecoder->Time.CodedNs += ns;
+        pDecoder->Time.CodedNb++;
+      }
+      else
+      {
+        pDecoder->Time.DoneNs += ns;
+        pDecoder->Time.DoneNb++;
+      }
+    }
+    pDecoder->pSteps[i].Ret = ret;
+    pDecoder->pSteps[i].Status = pDecoder->GetStatus();
+    if (ret != FRAG_SESSION_ONGOING)
+    {
+      i++;
+      break;
+    }
+    if (isCoded && (pDecoder->Idle != NULL))
+    {
+      start = NowNs();
+      pDecoder->Idle();
+      pDecoder->Time.IdleNs += NowNs() - start;
+    }
+  }
+  if (!isCoded)
+  {
+    pDecoder->Time.UncodedNs += NowNs() - start;
+  }
+  return i;
+}
+
+/**
+  * @brief  Feeds the same fragments to both decoders, compares their status after each fragment and the files
+  *         they rebuilt.
+  * @retval 0 when the decoders agree, -1 otherwise.
+  */
+static int RunTrial(uint32_t uTrial, uint8_t *pFile, CheckDecoder_t *pRef, CheckDecoder_t *pDecoder)
+{
+  uint32_t fileSize = (uint32_t)Config.FragNb * Config.FragSize;
+  /* The reference never clears MatrixError once set, only its return status is compared afterwards */
+  bool isRefErrorStuck = (ref_FragDecoderGetStatus().MatrixError != 0U);
+  FragEncoder_t encoder;
+  uint32_t refNb;
+  uint32_t nb;
+
+  LossModelSeed(Config.Seed + uTrial);
+  for (uint32_t i = 0U; i < fileSize; i++)
+  {
+    pFile[i] = (uint8_t)LossModelRandom();
+  }
+  FragEncoderInit(&encoder, pFile, Config.FragNb, Config.FragSize);
+  for (uint32_t i = 0U; i < Config.NbLossModels; i++)
+  {
+    LossModelReset(&Config.LossModels[i]);
+  }
+  ReceivedNb = 0U;
+  for (uint32_t counter = 1U; counter <= ((uint32_t)Config.FragNb + Config.MaxCoded); counter++)
+  {
+    bool isLost = false;
+
+    for (uint32_t i = 0U; i < Config.NbLossModels; i++)
+    {
+      isLost |= LossModelIsLost(&Config.LossModels[i], (uint16_t)counter, Config.FragNb);
+    }
+    FragEncoderGetFragment(&encoder, (uint16_t)counter, &Fragments[(counter - 1U) * Config.FragSize]);
+    if (!isLost)
+    {
+      Received[ReceivedNb++] = (uint16_t)counter;
+    }
+  }
+
+  memset(RefStorage.pData, 0xFF, RefStorage.Size);
+  memset(Storage.pData, 0xFF, Storage.Size);
+  refNb = Decode(pRef);
+  nb = Decode(pDecoder);
+
+  for (uint32_t i = 0U; (i < refNb) || (i < nb); i++)
+  {
+    CheckStep_t *pRefStep = &pRef->pSteps[i];
+    CheckStep_t *pStep = &pDecoder->pSteps[i];
+
+    /* When it gives up, the reference has not counted the last uncoded fragments lost yet */
+    if ((i >= refNb) || (i >= nb) || (pStep->Ret != pRefStep->Ret)
+        || ((pStep->Status.FragNbLost != pRefStep->Status.FragNbLost) && (pStep->Status.MatrixError == 0U))
+        || ((pStep->Status.MatrixError != pRefStep->Status.MatrixError) && !isRefErrorStuck))
+    {
+      fprintf(stderr, "trial %" PRIu32 ", fragment %u: status %" PRId32 " lost %u error %u, "
+              "reference %" PRId32 " lost %u error %u\n", uTrial, Received[i], pStep->Ret,
+              pStep->Status.FragNbLost, pStep->Status.MatrixError, pRefStep->Ret, pRefStep->Status.FragNbLost,
+              pRefStep->Status.MatrixError);
+      return -1;
+    }
+  }
+
+  /* Both decoders lay the file rows out first in their storage */
+  if ((nb > 0U) && (pDecoder->pSteps[nb - 1U].Ret >= FRAG_SESSION_FINISHED)
+      && (pDecoder->pSteps[nb - 1U].Status.MatrixError == 0U))
+  {
+    if (memcmp(Storage.pData, RefStorage.pData, fileSize) != 0)
+    {
+      fprintf(stderr, "trial %" PRIu32 ": rebuilt files differ\n", uTrial);
+      return -1;
+    }
+    if (memcmp(Storage.pData, pFile, fileSize) != 0)
+    {
+      fprintf(stderr, "trial %" PRIu32 ": both rebuilt files differ from the sent one\n", uTrial);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Feeds the decoder the edge counters of a session, it has no reference to compare with: counter 0, which
+  *         must be ignored, and coded fragments all past FragNb + maxLost, which must rebuild the file.
+  * @retval 0 when the decoder behaves, -1 otherwise.
+  */
+static int CheckCounters(uint8_t *pFile)
+{
+  uint32_t fileSize = (uint32_t)Config.FragNb * Config.FragSize;
+  uint8_t data[FRAG_MAX_SIZE];
+  FragDecoderStatus_t status;
+  FragEncoder_t encoder;
+  uint32_t counter;
+  int32_t ret;
+
+  LossModelSeed(Config.Seed);
+  for (uint32_t i = 0U; i < fileSize; i++)
+  {
+    pFile[i] = (uint8_t)LossModelRandom();
+  }
+  FragEncoderInit(&encoder, pFile, Config.FragNb, Config.FragSize);
+  memset(Storage.pData, 0xFF, Storage.Size);
+  Init();
+
+  memset(data, 0xA5, sizeof(data));
+  ret = Process(0U, data);
+  status = GetStatus();
+  if ((ret != FRAG_SESSION_ONGOING) || (status.FragNbRx != 0U) || (status.FragNbLost != 0U)
+      || (Storage.pData[0] != 0xFFU))
+  {
+    fprintf(stderr, "counter 0 first: status %" PRId32 " received %u lost %u\n", ret, status.FragNbRx,
+            status.FragNbLost);
+    return -1;
+  }
+
+  /* The first uncoded fragments are lost, counter 0 comes again in the middle */
+  for (counter = CHECK_COUNTERS_LOST + 1U; counter <= Config.FragNb; counter++)
+  {
+    FragEncoderGetFragment(&encoder, (uint16_t)counter, data);
+    (void)Process((uint16_t)counter, data);
+    (void)Solve();
+    if (counter == (Config.FragNb / 2U))
+    {
+      memset(data, 0xA5, sizeof(data));
+      ret = Process(0U, data);
+      if ((ret != FRAG_SESSION_ONGOING) || (GetStatus().FragNbRx != counter))
+      {
+        fprintf(stderr, "counter 0 in the session: status %" PRId32 "\n", ret);
+        return -1;
+      }
+    }
+  }
+
+  ret = FRAG_SESSION_ONGOING;
+  for (counter = (uint32_t)Config.FragNb + CHECK_REF_MAX_LOST + 1U;
+       (ret == FRAG_SESSION_ONGOING) && (counter <= 0x3FFFU); counter++)
+  {
+    FragEncoderGetFragment(&encoder, (uint16_t)counter, data);
+    ret = Process((uint16_t)counter, data);
+    ret = (ret == FRAG_SESSION_ONGOING) ? Solve() : ret;
+  }
+  status = GetStatus();
+  if ((ret != (int32_t)CHECK_COUNTERS_LOST) || (status.MatrixError != 0U)
+      || (memcmp(Storage.pData, pFile, fileSize) != 0))
+  {
+    fprintf(stderr, "coded fragments past FragNb + maxLost: status %" PRId32 " lost %u error %u\n", ret,
+            status.FragNbLost, status.MatrixError);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Saves the decoder state in the middle of a session, checks that a truncated copy is rejected without
+  *         changing the decoder, then restores the copy and completes the session from it.
+  * @note   Run right after CheckCounters, which leaves the file in pFile.
+  * @retval 0 when the decoder behaves, -1 otherwise.
+  */
+static int CheckNvmCtx(uint8_t *pFile)
+{
+  uint32_t fileSize = (uint32_t)Config.FragNb * Config.FragSize;
+  uint8_t data[FRAG_MAX_SIZE];
+  FragEncoder_t encoder;
+  void *pSaved;
+  uint8_t *pCtx;
+  size_t ctxSize;
+  size_t size;
+  uint32_t counter;
+  int32_t ret;
+
+  FragEncoderInit(&encoder, pFile, Config.FragNb, Config.FragSize);
+  memset(Storage.pData, 0xFF, Storage.Size);
+  Init();
+  for (counter = CHECK_COUNTERS_LOST + 1U; counter <= (Config.FragNb + 1U); counter++)
+  {
+    FragEncoderGetFragment(&encoder, (uint16_t)counter, data);
+    (void)Process((uint16_t)counter, data);
+  }
+  /* The state lives in the arena, Init would overwrite it */
+  pSaved = FragDecoderGetNvmCtx(0U, &ctxSize);
+  pCtx = (pSaved != NULL) ? malloc(ctxSize) : NULL;
+  if (pCtx == NULL)
+  {
+    fprintf(stderr, "nvm context: no state saved\n");
+    return -1;
+  }
+  memcpy(pCtx, pSaved, ctxSize);
+
+  size = ctxSize;
+  if ((FragDecoderCheckNvmCtx(0U, pCtx, &size) == false) || (size != ctxSize))
+  {
+    fprintf(stderr, "nvm context: saved state of %zu bytes rejected\n", ctxSize);
+    free(pCtx);
+    return -1;
+  }
+  /* The decoder is set up again so that a restore which went through would show */
+  Init();
+  size = ctxSize - 1U;
+  if ((FragDecoderCheckNvmCtx(0U, pCtx, &size) == true)
+      || (FragDecoderRestoreNvmCtx(0U, pCtx, &size, &Callbacks) == true) || (GetStatus().FragNbRx != 0U))
+  {
+    fprintf(stderr, "nvm context: truncated state accepted\n");
+    free(pCtx);
+    return -1;
+  }
+
+  size = ctxSize;
+  ret = FRAG_SESSION_ONGOING;
+  if (FragDecoderRestoreNvmCtx(0U, pCtx, &size, &Callbacks) == true)
+  {
+    for (counter = (uint32_t)Config.FragNb + 2U; (ret == FRAG_SESSION_ONGOING) && (counter <= 0x3FFFU); counter++)
+    {
+      FragEncoderGetFragment(&encoder, (uint16_t)counter, data);
+      ret = Process((uint16_t)counter, data);
+      ret = (ret == FRAG_SESSION_ONGOING) ? Solve() : ret;
+    }
+  }
+  free(pCtx);
+  if ((ret != (int32_t)CHECK_COUNTERS_LOST) || (memcmp(Storage.pData, pFile, fileSize) != 0))
+  {
+    fprintf(stderr, "nvm context: restored session ended with status %" PRId32 "\n", ret);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Average of a time over a number of calls, in microseconds.
+  */
+static double PerCall(uint64_t Ns, uint32_t Nb)
+{
+  return (double)Ns / (double)((Nb > 0U) ? Nb : 1U) / 1000.0;
+}
+
+static void Report(const char *pName, const CheckTime_t *pTime)
+{
+  printf("%-9s time: %.2f us per uncoded fragment, %.2f us per coded fragment, %.2f us idle per coded fragment, "
+         "%.1f us per session end\n", pName, PerCall(pTime->UncodedNs, Config.Trials * Config.FragNb),
+         PerCall(pTime->CodedNs, pTime->CodedNb), PerCall(pTime->IdleNs, pTime->CodedNb),
+         PerCall(pTime->DoneNs, pTime->DoneNb));
+}
+
+static void Usage(const char *pName)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n FragNb       uncoded fragments, %u at most (%u)\n"
+          "  -s FragSize     fragment size (%u)\n"
+          "  -r MaxCoded     coded fragments sent at most (%u)\n"
+          "  -l Model        loss model, up to %u: iid:P, ge:PGB:PBG[:LG:LB], tail:F (iid:0.05)\n"
+          "  -a Size         RAM given to the fragmentation decoder (%" PRIu32 ")\n"
+          "  -t Trials       number of sessions (%" PRIu32 ")\n"
+          "  -S Seed         random seed (%" PRIu32 ")\n",
+          pName, CHECK_REF_MAX_NB, Config.FragNb, Config.FragSize, Config.MaxCoded, CHECK_MAX_LOSS_MODELS,
+          Config.ArenaSize, Config.Trials, Config.Seed);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  CheckDecoder_t ref = { .Init = RefInit, .Process = ref_FragDecoderProcess, .Solve = NULL, .Idle = NULL,
+                         .GetStatus = RefGetStatus, .pStorage = &RefStorage };
+  CheckDecoder_t decoder = { .Init = Init, .Process = Process, .Solve = Solve, .Idle = Idle,
+                             .GetStatus = GetStatus, .pStorage = &Storage };
+  uint32_t sentNb;
+  uint32_t errors = 0U;
+  int32_t maxLost;
+  void *arena;
+  uint8_t *file;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:r:l:a:t:S:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': Config.FragNb = (uint16_t)strtoul(optarg, NULL, 0); break;
+      case 's': Config.FragSize = (uint8_t)strtoul(optarg, NULL, 0); break;
+      case 'r': Config.MaxCoded = (uint16_t)strtoul(optarg, NULL, 0); break;
+      case 'a': Config.ArenaSize = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 't': Config.Trials = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'S': Config.Seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'l':
+        if ((Config.NbLossModels == CHECK_MAX_LOSS_MODELS)
+            || (LossModelParse(optarg, &Config.LossModels[Config.NbLossModels]) != 0))
+        {
+          fprintf(stderr, "invalid loss model %s\n", optarg);
+          return 2;
+        }
+        Config.NbLossModels++;
+        break;
+      default:
+        Usage(argv[0]);
+        return 2;
+    }
+  }
+  if ((Config.FragNb == 0U) || (Config.FragNb > CHECK_REF_MAX_NB) || (Config.FragSize == 0U)
+      || (Config.FragSize > FRAG_MAX_SIZE) || (Config.Trials == 0U)
+      || (((uint32_t)Config.FragNb + Config.MaxCoded) > 0x3FFFU))
+  {
+    Usage(argv[0]);
+    return 2;
+  }
+  if (Config.NbLossModels == 0U)
+  {
+    (void)LossModelParse("iid:0.05", &Config.LossModels[0]);
+    Config.NbLossModels = 1U;
+  }
+
+  arena = malloc(Config.ArenaSize);
+  if (arena == NULL)
+  {
+    return 1;
+  }
+  /* Left over RAM content, the decoder must not rely on a cleared arena nor read past its arrays */
+  memset(arena, 0xFF, Config.ArenaSize);
+  FragDecoderSetArena(arena, Config.ArenaSize);
+  Region.Size = FragDecoderGetStorageSize(Config.FragNb, Config.FragSize, CHECK_REF_MAX_LOST);
+  maxLost = FragDecoderGetMaxLost(0U, Config.FragNb, Config.FragSize, &Region);
+  if (maxLost != (int32_t)CHECK_REF_MAX_LOST)
+  {
+    fprintf(stderr, "the decoder must give up past %u lost fragments like the reference, its limit is %" PRId32 "\n",
+            CHECK_REF_MAX_LOST, maxLost);
+    return 2;
+  }
+  sentNb = (uint32_t)Config.FragNb + Config.MaxCoded;
+  RefStorage.Size = (uint32_t)Config.FragNb * Config.FragSize;
+  Storage.Size = Region.Size;
+  RefStorage.pData = malloc(RefStorage.Size);
+  Storage.pData = malloc(Storage.Size);
+  file = malloc(RefStorage.Size);
+  Fragments = malloc(sentNb * Config.FragSize);
+  Received = malloc(sentNb * sizeof(uint16_t));
+  ref.pSteps = malloc(sentNb * sizeof(CheckStep_t));
+  decoder.pSteps = malloc(sentNb * sizeof(CheckStep_t));
+  if ((RefStorage.pData == NULL) || (Storage.pData == NULL) || (file == NULL) || (Fragments == NULL)
+      || (Received == NULL) || (ref.pSteps == NULL) || (decoder.pSteps == NULL))
+  {
+    return 1;
+  }
+
+  if (CheckCounters(file) != 0)
+  {
+    errors++;
+  }
+  if (CheckNvmCtx(file) != 0)
+  {
+    errors++;
+  }
+  for (uint32_t trial = 0U; trial < Config.Trials; trial++)
+  {
+    if (RunTrial(trial, file, &ref, &decoder) != 0)
+    {
+      errors++;
+    }
+  }
+
+  printf("file          : %u fragments of %u bytes, %u coded fragments at most\n", Config.FragNb, Config.FragSize,
+         Config.MaxCoded);
+  printf("trials        : %" PRIu32 ", %" PRIu32 " mismatches with the reference decoder or failed counter and state checks\n",
+         Config.Trials, errors);
+  Report("reference", &ref.Time);
+  Report("decoder", &decoder.Time);
+  printf("speed up      : %.1f per coded fragment, %.1f per session end, %.1f for all the coded fragments\n",
+         PerCall(ref.Time.CodedNs, ref.Time.CodedNb) / PerCall(decoder.Time.CodedNs, decoder.Time.CodedNb),
+         PerCall(ref.Time.DoneNs, ref.Time.DoneNb) / PerCall(decoder.Time.DoneNs, decoder.Time.DoneNb),
+         (double)(ref.Time.CodedNs + ref.Time.DoneNs + ref.Time.IdleNs)
+         / (double)(decoder.Time.CodedNs + decoder.Time.DoneNs + decoder.Time.IdleNs));
+
+  free(decoder.pSteps);
+  free(ref.pSteps);
+  free(Received);
+  free(Fragments);
+  free(file);
+  free(Storage.pData);
+  free(RefStorage.pData);
+  free(arena);
+  return (errors == 0U) ? 0 : 1;
+}
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,179 @@
+/**
+  ******************************************************************************
+  * @file    FragEncoder.c
+  * @author  MCD Application Team
+  * @brief   Server side encoder of the LoRaWAN fragmented data block
+  *          transport, producing the payload of the fragments.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "FragEncoder.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Fragmentation package commands, see LmhpFragmentation.c */
+#define FRAGMENTATION_FRAG_SESSION_SETUP_REQ    0x02U
+#define FRAGMENTATION_DATA_FRAGMENT             0x08U
+
+/* Largest FragNb the fragment counter can carry */
+#define FRAG_ENCODER_MAX_NB                     0x3FFFU
+
+/* Descriptor expected by LmhpFragmentation */
+#define FRAG_ENCODER_DESCRIPTOR                 0x01020304U
+
+/* Private function prototypes -----------------------------------------------*/
+static int32_t FragEncoderPrbs23(int32_t Value);
+static uint8_t FragEncoderIsPowerOfTwo(uint32_t x);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  23 bits pseudo random binary sequence of the parity matrix.
+  * @param  Value: previous value
+  * @retval Next value
+  */
+static int32_t FragEncoderPrbs23(int32_t Value)
+{
+  int32_t b0 = Value & 0x01;
+  int32_t b1 = (Value & 0x20) >> 5;
+
+  return (Value >> 1) + ((b0 ^ b1) << 22);
+}
+
+/**
+  * @brief  Checks if a number is a power of two.
+  * @param  x: number
+  * @retval 1 if x is a power of two, 0 otherwise
+  */
+static uint8_t FragEncoderIsPowerOfTwo(uint32_t x)
+{
+  return ((x != 0U) && ((x & (x - 1U)) == 0U)) ? 1U : 0U;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+void FragEncoderInit(FragEncoder_t *pEncoder, const uint8_t *pFile, uint16_t FragNb, uint8_t FragSize)
+{
+  pEncoder->pFile = pFile;
+  pEncoder->FragNb = FragNb;
+  pEncoder->FragSize = FragSize;
+}
+
+void FragEncoderGetFragment(const FragEncoder_t *pEncoder, uint16_t FragCounter, uint8_t *pData)
+{
+  static uint8_t column[FRAG_ENCODER_MAX_NB + 1U];
+  int32_t m = pEncoder->FragNb;
+  int32_t mTemp = FragEncoderIsPowerOfTwo(pEncoder->FragNb);
+  int32_t n;
+  int32_t x;
+  int32_t r;
+  int32_t nbCoeff;
+
+  if (FragCounter <= pEncoder->FragNb)
+  {
+    memcpy(pData, &pEncoder->pFile[(FragCounter - 1U) * pEncoder->FragSize], pEncoder->FragSize);
+    return;
+  }
+
+  /* Same parity row as FragGetParityMatrixRow on the end device side, a
+   * column drawn twice is set once */
+  n = FragCounter - pEncoder->FragNb;
+  x = 1 + (1001 * n);
+  memset(column, 0, pEncoder->FragNb);
+  for (nbCoeff = 0; nbCoeff < (m >> 1); nbCoeff++)
+  {
+    r = 1 << 16;
+    while (r >= m)
+    {
+      x = FragEncoderPrbs23(x);
+      r = x % (m + mTemp);
+    }
+    column[r] = 1U;
+  }
+
+  memset(pData, 0, pEncoder->FragSize);
+  for (r = 0; r < m; r++)
+  {
+    if (column[r] != 0U)
+    {
+      const uint8_t *row = &pEncoder->pFile[r * pEncoder->FragSize];
+
+      for (uint32_t i = 0; i < pEncoder->FragSize; i++)
+      {
+        pData[i] ^= row[i];
+      }
+    }
+  }
+}
+
+uint8_t FragEncoderSessionSetupReq(uint8_t FragIndex, uint16_t FragNb, uint8_t FragSize, uint8_t Padding,
+                                   uint8_t *pCmd)
+{
+  uint8_t i = 0;
+
+  pCmd[i++] = FRAGMENTATION_FRAG_SESSION_SETUP_REQ;
+  /* FragIndex, McGroupBitMask of multicast group 0 */
+  pCmd[i++] = (uint8_t)(((FragIndex & 0x03U) << 4) | 0x01U);
+  pCmd[i++] = (uint8_t)(FragNb & 0xFFU);
+  pCmd[i++] = (uint8_t)(FragNb >> 8);
+  pCmd[i++] = FragSize;
+  /* FragAlgo 0, BlockAckDelay 0 */
+  pCmd[i++] = 0U;
+  pCmd[i++] = Padding;
+  pCmd[i++] = (uint8_t)(FRAG_ENCODER_DESCRIPTOR & 0xFFU);
+  pCmd[i++] = (uint8_t)((FRAG_ENCODER_DESCRIPTOR >> 8) & 0xFFU);
+  pCmd[i++] = (uint8_t)((FRAG_ENCODER_DESCRIPTOR >> 16) & 0xFFU);
+  pCmd[i++] = (uint8_t)(FRAG_ENCODER_DESCRIPTOR >> 24);
+  return i;
+}
+
+uint16_t FragEncoderDataFragment(const FragEncoder_t *pEncoder, uint8_t FragIndex, uint16_t FragCounter,
+                                 uint8_t *pCmd)
+{
+  uint16_t indexAndN = (uint16_t)(((uint16_t)(FragIndex & 0x03U) << 14) | (FragCounter & 0x3FFFU));
+
+  pCmd[0] = FRAGMENTATION_DATA_FRAGMENT;
+  pCmd[1] = (uint8_t)(indexAndN & 0xFFU);
+  pCmd[2] = (uint8_t)(indexAndN >> 8);
+  FragEncoderGetFragment(pEncoder, FragCounter, &pCmd[FRAG_ENCODER_DATA_FRAGMENT_HDR_SIZE]);
+  return (uint16_t)(pEncoder->FragSize + FRAG_ENCODER_DATA_FRAGMENT_HDR_SIZE);
+}
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
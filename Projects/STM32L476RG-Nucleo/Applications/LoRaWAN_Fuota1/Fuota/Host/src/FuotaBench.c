@@ -0,0 +1,712 @@
+/**
+  ******************************************************************************
+  * @file    FuotaBench.c
+  * @author  MCD Application Team
+  * @brief   Host benchmark of the FUOTA reception: fragments of a file
+  *          are encoded, lost according to loss models and fed to the
+  *          fragmentation package, which decodes them through FragDecoder
+  *          and the storage layer into the emulated flash.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#define _GNU_SOURCE
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "LmhpFragmentation.h"
+#include "storage.h"
+#include "crc32.h"
+#include "FlashMemHandler.h"
+#include "FlashEmu.h"
+#include "FragEncoder.h"
+#include "HostPlatform.h"
+#include "LossModel.h"
+
+/* Private define ------------------------------------------------------------*/
+#define BENCH_MAX_LOSS_MODELS     4U
+#define BENCH_STACK_SIZE          (1024U * 1024U)
+#define BENCH_STACK_PAINT         0xA5U
+#define BENCH_FRAG_INDEX          0U
+#define BENCH_APP_DATA_SIZE       242U
+#define BENCH_MAX_HELD            256U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint16_t FragNb;
+  uint8_t FragSize;
+  uint8_t Padding;
+  uint16_t MaxCoded;          /*!< Coded fragments sent at most after the uncoded ones */
+  uint32_t Trials;
+  uint32_t Seed;
+  uint32_t IdleSteps;         /*!< Main loop iterations between two fragments */
+  bool IsRaw;                 /*!< Binary file without firmware magic */
+  bool IsVerbose;
+  FlashEmuConfig_t Flash;
+  LossModel_t LossModels[BENCH_MAX_LOSS_MODELS];
+  uint32_t NbLossModels;
+  double ReorderProb;         /*!< Probability a received frame is delayed */
+  uint16_t ReorderDelay;      /*!< Frames sent before a delayed frame arrives */
+  double DuplicateProb;       /*!< Probability a received frame arrives again later */
+  uint32_t ArenaSize;         /*!< RAM given to the fragmentation decoder */
+  uint32_t StorageRamSize;    /*!< RAM given to the datafile storage */
+} BenchConfig_t;
+
+typedef struct
+{
+  uint16_t Counter;           /*!< Fragment counter of the held frame */
+  uint32_t Due;               /*!< Delivered once this frame is sent */
+} BenchHeldFrame_t;
+
+typedef struct
+{
+  bool IsDone;                /*!< The fragmentation package called OnDone */
+  bool IsOk;                  /*!< The file was received and checked */
+  bool IsInPlace;             /*!< The file was decoded in place in the download slot */
+  uint16_t Lost;              /*!< Frames lost until the session ended */
+  uint16_t Late;              /*!< Frames delivered after a later one */
+  uint16_t Duplicates;        /*!< Frames delivered twice */
+  uint16_t CodedSent;         /*!< Coded fragments sent until the session ended */
+  uint32_t Fragments;         /*!< Fragments given to the package */
+  uint64_t DecodeNs;          /*!< CPU time of the fragments processing */
+  uint64_t DecodeMaxNs;       /*!< CPU time of the slowest fragment */
+  uint64_t IdleNs;            /*!< CPU time of the main loop work between fragments */
+  uint64_t SolveNs;           /*!< CPU time of the main loop call which rebuilt the missing fragments */
+  uint64_t DoneNs;            /*!< CPU time of the file completion and check */
+  FlashEmuStats_t Flash;
+  FlashMemHandler_WriteStats_t Writes; /*!< FlashMemHandlerFct.Write bytes */
+} BenchTrial_t;
+
+/* Private variables ---------------------------------------------------------*/
+static BenchConfig_t Config =
+{
+  .FragNb = 200U,
+  .FragSize = 200U,
+  .Padding = 0U,
+  .MaxCoded = 60U,
+  .Trials = 100U,
+  .Seed = 1U,
+  .IdleSteps = 1U,
+  .ReorderDelay = 4U,
+  .ArenaSize = 8192U,
+  .StorageRamSize = 4096U,
+  .Flash =
+  {
+    .EraseTimeUs = FLASH_EMU_ERASE_TIME_US,
+    .ProgramTimeUs = FLASH_EMU_PROGRAM_TIME_US,
+  },
+};
+
+static BenchTrial_t *Trials;
+static void *StorageRam;
+static uint8_t *File;
+static uint32_t FileSize;
+static BenchTrial_t *CurrentTrial;
+static uint8_t SetupStatus;
+static uint8_t AppDataBuffer[BENCH_APP_DATA_SIZE];
+static uint8_t *StackBase;
+static uintptr_t StackTop;
+
+static void OnFragDone(int32_t status, uint32_t size);
+
+static LmhpFragmentationParams_t FragmentationParams =
+{
+  .DecoderCallbacks =
+  {
+    .FragDecoderWrite = FragDecoderActilityWrite,
+    .FragDecoderRead = FragDecoderActilityRead,
+  },
+  .OnDone = OnFragDone,
+};
+
+/* Private function prototypes -----------------------------------------------*/
+static uint64_t CpuTimeNs(void);
+static bool IsDrawn(double Prob);
+static void Deliver(LmhPackage_t *pPackage, McpsIndication_t *pIndication, FragEncoder_t *pEncoder,
+                    uint16_t uCounter, BenchTrial_t *pTrial);
+static LmHandlerErrorStatus_t OnSendRequest(LmHandlerAppData_t *appData, LmHandlerMsgTypes_t isTxConfirmed);
+static void MakeFile(uint32_t uTrial);
+static int RunTrial(uint32_t uTrial, BenchTrial_t *pTrial);
+static void *RunTrials(void *pArg);
+static size_t GetPeakStack(void);
+static int CompareU16(const void *a, const void *b);
+static void Report(size_t uPeakStack);
+static void Usage(const char *pName);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Gets the CPU time of the calling thread.
+  */
+static uint64_t CpuTimeNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/**
+  * @brief  Gets the uplink answers of the fragmentation package.
+  */
+/**
+  * @brief  Draws an event of probability Prob.
+  */
+static bool IsDrawn(double Prob)
+{
+  return ((double)LossModelRandom() / 4294967296.0) < Prob;
+}
+
+/**
+  * @brief  Gives a DataFragment to the package and accounts its processing time. The package process runs right
+  *         after, as LmHandlerProcess does once the MAC layer is done, and the call which completes the session is
+  *         accounted as the session end.
+  */
+static void Deliver(LmhPackage_t *pPackage, McpsIndication_t *pIndication, FragEncoder_t *pEncoder,
+                    uint16_t uCounter, BenchTrial_t *pTrial)
+{
+  uint64_t start;
+  uint64_t ns;
+
+  pIndication->BufferSize = (uint8_t)FragEncoderDataFragment(pEncoder, BENCH_FRAG_INDEX, uCounter,
+                                                             pIndication->Buffer);
+  start = CpuTimeNs();
+  pPackage->OnMcpsIndicationProcess(pIndication);
+  ns = CpuTimeNs() - start;
+  /* OnDone is part of the last fragment processing */
+  ns -= pTrial->DoneNs;
+  pTrial->Fragments++;
+  pTrial->DecodeNs += ns;
+  if (ns > pTrial->DecodeMaxNs)
+  {
+    pTrial->DecodeMaxNs = ns;
+  }
+  if (pTrial->IsDone == false)
+  {
+    start = CpuTimeNs();
+    pPackage->Process();
+    ns = CpuTimeNs() - start - pTrial->DoneNs;
+    if (pTrial->IsDone)
+    {
+      pTrial->SolveNs = ns;
+    }
+    else
+    {
+      pTrial->IdleNs += ns;
+    }
+  }
+}
+
+static LmHandlerErrorStatus_t OnSendRequest(LmHandlerAppData_t *appData, LmHandlerMsgTypes_t isTxConfirmed)
+{
+  (void)isTxConfirmed;
+  /* FragSessionSetupAns */
+  if ((appData->BufferSize >= 2U) && (appData->Buffer[0] == 0x02U))
+  {
+    SetupStatus = appData->Buffer[1];
+  }
+  return LORAMAC_HANDLER_SUCCESS;
+}
+
+/**
+  * @brief  Completes the file as OnUpdateAgentFragDone does on the end
+  *         device and checks it against the file sent.
+  * @note   The Smart Delta patch library is only built for the target, a full
+  *         image is moved to the download slot instead.
+  */
+static void OnFragDone(int32_t status, uint32_t size)
+{
+  uint64_t start = CpuTimeNs();
+  BenchTrial_t *trial = CurrentTrial;
+  uint32_t ptr;
+  uint32_t len;
+  uint32_t crc;
+
+  trial->IsDone = true;
+  trial->IsInPlace = storage_datafile_in_place();
+  if ((status == FRAG_SESSION_FAILED)
+      || (size != FileSize)
+      || (storage_datafile_commit(size) != STR_OK)
+      || (storage_crc32(STORAGE_SLOT_SOURCE, 0, size, &crc) != STR_OK)
+      || (crc != crc32_compute(File, size)))
+  {
+    goto done;
+  }
+  /* The datafile is read straight from flash */
+  storage_get_slot_info(trial->IsInPlace ? STORAGE_SLOT_SCRATCH : STORAGE_SLOT_SOURCE, &ptr, &len);
+  if (memcmp((const void *)(uintptr_t)ptr, File, size) != 0)
+  {
+    goto done;
+  }
+  if ((Config.IsRaw == false) && (trial->IsInPlace == false))
+  {
+    storage_get_slot_info(STORAGE_SLOT_SCRATCH, &ptr, &len);
+    if ((move_image(STORAGE_SLOT_SOURCE, STORAGE_SLOT_SCRATCH, size, 1) != STR_OK)
+        || (memcmp((const void *)(uintptr_t)ptr, File, size) != 0))
+    {
+      goto done;
+    }
+  }
+  trial->IsOk = true;
+done:
+  trial->DoneNs = CpuTimeNs() - start;
+}
+
+/**
+  * @brief  Builds the file of a trial, a firmware image unless a raw
+  *         binary file is requested.
+  */
+static void MakeFile(uint32_t uTrial)
+{
+  uint32_t magic = FIRMWARE_MAGIC;
+
+  LossModelSeed(Config.Seed + uTrial);
+  for (uint32_t i = 0U; i < FileSize; i++)
+  {
+    File[i] = (uint8_t)LossModelRandom();
+  }
+  if ((Config.IsRaw == false) && (FileSize >= sizeof(magic)))
+  {
+    memcpy(File, &magic, sizeof(magic));
+  }
+  else if ((Config.IsRaw == true) && (FileSize >= sizeof(magic)) && (memcmp(File, &magic, sizeof(magic)) == 0))
+  {
+    File[0] ^= 0xFFU;
+  }
+  /* Padding of the last uncoded fragment */
+  memset(&File[FileSize], 0, Config.Padding);
+}
+
+/**
+  * @brief  Runs a fragmentation session from its setup to its end.
+  * @retval 0 if the trial could run, -1 otherwise
+  */
+static int RunTrial(uint32_t uTrial, BenchTrial_t *pTrial)
+{
+  static uint8_t frame[FRAG_MAX_SIZE + FRAG_ENCODER_DATA_FRAGMENT_HDR_SIZE];
+  LmhPackage_t *package = LmhpFragmentationPackageFactory();
+  McpsIndication_t indication;
+  FragEncoder_t encoder;
+  BenchHeldFrame_t held[BENCH_MAX_HELD];
+  uint32_t nbHeld = 0U;
+  uint32_t last = (uint32_t)Config.FragNb + Config.MaxCoded;
+  uint64_t start;
+
+  memset(pTrial, 0, sizeof(*pTrial));
+  CurrentTrial = pTrial;
+  MakeFile(uTrial);
+  FragEncoderInit(&encoder, File, Config.FragNb, Config.FragSize);
+  for (uint32_t i = 0U; i < Config.NbLossModels; i++)
+  {
+    LossModelReset(&Config.LossModels[i]);
+  }
+
+  /* Reset of the end device, the flash content is kept in the backing file */
+  if (FlashEmuOpen(&Config.Flash) != 0)
+  {
+    return -1;
+  }
+  FlashEmuResetStats();
+  storage_set_ram(StorageRam, Config.StorageRamSize);
+  if (storage_init() != STR_OK)
+  {
+    fprintf(stderr, "storage_init failed\n");
+    FlashEmuClose();
+    return -1;
+  }
+  package->OnSendRequest = OnSendRequest;
+  package->Init(&FragmentationParams, AppDataBuffer, sizeof(AppDataBuffer));
+
+  /* Unicast FragSessionSetupReq */
+  memset(&indication, 0, sizeof(indication));
+  indication.Port = package->Port;
+  indication.Buffer = frame;
+  indication.BufferSize = FragEncoderSessionSetupReq(BENCH_FRAG_INDEX, Config.FragNb, Config.FragSize,
+                                                     Config.Padding, frame);
+  SetupStatus = 0xFFU;
+  package->OnMcpsIndicationProcess(&indication);
+  if ((SetupStatus & 0x0FU) != 0U)
+  {
+    fprintf(stderr, "FragSessionSetupReq rejected, status 0x%02X\n", SetupStatus);
+    FlashEmuClose();
+    return -1;
+  }
+
+  /* Multicast DataFragment commands */
+  indication.Multicast = 1U;
+  for (uint32_t counter = 1U; (counter <= last) && (pTrial->IsDone == false); counter++)
+  {
+    bool isLost = false;
+
+    if (counter > Config.FragNb)
+    {
+      pTrial->CodedSent++;
+    }
+    /* Every model sees every frame, a Gilbert-Elliott chain moves on even
+     * if another model already lost the frame */
+    for (uint32_t i = 0U; i < Config.NbLossModels; i++)
+    {
+      isLost |= LossModelIsLost(&Config.LossModels[i], (uint16_t)counter, Config.FragNb);
+    }
+    if (isLost)
+    {
+      pTrial->Lost++;
+    }
+    else if ((nbHeld < BENCH_MAX_HELD) && IsDrawn(Config.ReorderProb))
+    {
+      held[nbHeld].Counter = (uint16_t)counter;
+      held[nbHeld].Due = counter + Config.ReorderDelay;
+      nbHeld++;
+      pTrial->Late++;
+    }
+    else
+    {
+      Deliver(package, &indication, &encoder, (uint16_t)counter, pTrial);
+      if ((nbHeld < BENCH_MAX_HELD) && IsDrawn(Config.DuplicateProb))
+      {
+        held[nbHeld].Counter = (uint16_t)counter;
+        held[nbHeld].Due = counter + Config.ReorderDelay;
+        nbHeld++;
+        pTrial->Duplicates++;
+      }
+    }
+
+    /* Frames held back arrive after the current one, the oldest first */
+    for (uint32_t i = 0U; (i < nbHeld) && (pTrial->IsDone == false); )
+    {
+      if ((held[i].Due <= counter) || (counter == last))
+      {
+        uint16_t heldCounter = held[i].Counter;
+
+        memmove(&held[i], &held[i + 1U], (nbHeld - i - 1U) * sizeof(held[0]));
+        nbHeld--;
+        Deliver(package, &indication, &encoder, heldCounter, pTrial);
+      }
+      else
+      {
+        i++;
+      }
+    }
+
+    /* Main loop until the next fragment */
+    start = CpuTimeNs();
+    for (uint32_t step = 0U; step < Config.IdleSteps; step++)
+    {
+      package->Process();
+      if ((storage_erase_slot_step(STORAGE_SLOT_SOURCE) != STR_OK) && (pTrial->IsDone == false))
+      {
+        storage_erase_slot_step(STORAGE_SLOT_SCRATCH);
+      }
+    }
+    pTrial->IdleNs += CpuTimeNs() - start;
+  }
+
+  pTrial->Flash = FlashEmuGetStats();
+  pTrial->Writes = FlashMemHandler_GetWriteStats();
+  FlashEmuClose();
+  if (Config.IsVerbose)
+  {
+    printf("trial %" PRIu32 ": %s%s, lost %u, late %u, duplicated %u, coded sent %u, %" PRIu32 " erases, %" PRIu32 " double words\n",
+           uTrial, pTrial->IsOk ? "ok" : (pTrial->IsDone ? "corrupted" : "incomplete"),
+           pTrial->IsInPlace ? " in place" : "", pTrial->Lost, pTrial->Late, pTrial->Duplicates, pTrial->CodedSent,
+           pTrial->Flash.Erases, pTrial->Flash.DoubleWords);
+  }
+  return 0;
+}
+
+/**
+  * @brief  Runs all trials on the painted stack.
+  */
+static void *RunTrials(void *pArg)
+{
+  volatile uint8_t top;
+
+  StackTop = (uintptr_t)&top;
+  for (uint32_t i = 0U; i < Config.Trials; i++)
+  {
+    if (RunTrial(i, &Trials[i]) != 0)
+    {
+      *(int *)pArg = -1;
+      break;
+    }
+  }
+  return NULL;
+}
+
+/**
+  * @brief  Gets the deepest stack use of the trials from the untouched
+  *         part of the painted stack.
+  */
+static size_t GetPeakStack(void)
+{
+  uint8_t *p = StackBase;
+
+  while ((p < (uint8_t *)StackTop) && (*p == BENCH_STACK_PAINT))
+  {
+    p++;
+  }
+  return (size_t)(StackTop - (uintptr_t)p);
+}
+
+static int CompareU16(const void *a, const void *b)
+{
+  return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+/**
+  * @brief  Prints the results over all trials.
+  */
+static void Report(size_t uPeakStack)
+{
+  static const uint32_t percentiles[] = {50U, 90U, 95U, 99U, 100U};
+  uint16_t *needed = calloc(Config.Trials, sizeof(uint16_t));
+  uint32_t ok = 0U;
+  uint32_t inPlace = 0U;
+  uint64_t fragments = 0U;
+  uint64_t decodeNs = 0U;
+  uint64_t decodeMaxNs = 0U;
+  uint64_t idleNs = 0U;
+  uint64_t solveNs = 0U;
+  uint64_t doneNs = 0U;
+  uint64_t lost = 0U;
+  uint64_t late = 0U;
+  uint64_t duplicates = 0U;
+  uint64_t erases = 0U;
+  uint64_t doubleWords = 0U;
+  uint64_t writeBytes = 0U;
+  uint64_t flashUs = 0U;
+  uint32_t maxPageErases = 0U;
+  uint32_t violations = 0U;
+
+  for (uint32_t i = 0U; i < Config.Trials; i++)
+  {
+    const BenchTrial_t *t = &Trials[i];
+
+    /* A failed trial would have needed more than MaxCoded coded fragments */
+    needed[i] = t->IsOk ? t->CodedSent : UINT16_MAX;
+    ok += t->IsOk ? 1U : 0U;
+    inPlace += t->IsInPlace ? 1U : 0U;
+    lost += t->Lost;
+    late += t->Late;
+    duplicates += t->Duplicates;
+    fragments += t->Fragments;
+    decodeNs += t->DecodeNs;
+    decodeMaxNs = (t->DecodeMaxNs > decodeMaxNs) ? t->DecodeMaxNs : decodeMaxNs;
+    idleNs += t->IdleNs;
+    solveNs += t->SolveNs;
+    doneNs += t->DoneNs;
+    erases += t->Flash.Erases;
+    doubleWords += t->Flash.DoubleWords;
+    writeBytes += t->Writes.Bytes;
+    flashUs += t->Flash.TimeUs;
+    maxPageErases = (t->Flash.MaxPageErases > maxPageErases) ? t->Flash.MaxPageErases : maxPageErases;
+    violations += t->Flash.Violations;
+  }
+  qsort(needed, Config.Trials, sizeof(uint16_t), CompareU16);
+
+  printf("file          : %u fragments of %u bytes, padding %u, %s\n", Config.FragNb, Config.FragSize,
+         Config.Padding, Config.IsRaw ? "binary file" : "firmware image");
+  printf("decoder arena : %" PRIu32 " bytes, %" PRId32 " lost fragments at most\n", Config.ArenaSize,
+         FragDecoderGetMaxLost(0U, Config.FragNb, Config.FragSize, NULL));
+  printf("storage RAM   : %" PRIu32 " bytes, %" PRId32 " lost fragments at most\n", Config.StorageRamSize,
+         storage_datafile_max_lost(Config.FragNb, Config.FragSize));
+  printf("trials        : %" PRIu32 ", %" PRIu32 " received (%.1f%%), %" PRIu32 " decoded in place\n",
+         Config.Trials, ok, 100.0 * ok / Config.Trials, inPlace);
+  printf("lost frames   : %.1f per trial, %.1f late, %.1f duplicated\n", (double)lost / Config.Trials,
+         (double)late / Config.Trials, (double)duplicates / Config.Trials);
+  printf("coded needed  :");
+  for (uint32_t i = 0U; i < (sizeof(percentiles) / sizeof(percentiles[0])); i++)
+  {
+    uint32_t rank = (uint32_t)(((uint64_t)percentiles[i] * Config.Trials + 99U) / 100U);
+    uint16_t n = needed[(rank == 0U) ? 0U : (rank - 1U)];
+
+    if (n == UINT16_MAX)
+    {
+      printf(" p%" PRIu32 " >%u", percentiles[i], Config.MaxCoded);
+    }
+    else
+    {
+      printf(" p%" PRIu32 " %u (%.1f%%)", percentiles[i], n, 100.0 * n / Config.FragNb);
+    }
+  }
+  printf("\n");
+  printf("decode CPU    : %.2f us per fragment, %.2f us max, %.2f ms per session end\n",
+         (fragments != 0U) ? (double)decodeNs / fragments / 1000.0 : 0.0, (double)decodeMaxNs / 1000.0,
+         (double)solveNs / Config.Trials / 1000000.0);
+  printf("idle CPU      : %.2f us per fragment\n",
+         (fragments != 0U) ? (double)idleNs / fragments / 1000.0 : 0.0);
+  printf("completion CPU: %.2f ms per trial\n", (double)doneNs / Config.Trials / 1000000.0);
+  printf("flash         : %.1f erases, %.1f double words, %.1f ms per trial\n",
+         (double)erases / Config.Trials, (double)doubleWords / Config.Trials, (double)flashUs / Config.Trials / 1000.0);
+  printf("flash writes  : %.1f bytes per trial\n", (double)writeBytes / Config.Trials);
+  printf("flash wear    : %" PRIu32 " erases of the most erased page, %" PRIu32 " programming errors\n",
+         maxPageErases, violations);
+  printf("peak stack    : %zu bytes (host build)\n", uPeakStack);
+  free(needed);
+}
+
+static void Usage(const char *pName)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -n FragNb       uncoded fragments (%u)\n"
+          "  -s FragSize     fragment size (%u)\n"
+          "  -p Padding      padding of the last fragment (%u)\n"
+          "  -r MaxCoded     coded fragments sent at most (%u)\n"
+          "  -l Model        loss model, up to %u: iid:P, ge:PGB:PBG[:LG:LB], tail:F\n"
+          "  -o P:D          frames delayed by D frames with probability P\n"
+          "  -u P            frames received again D frames later with probability P\n"
+          "  -a Size         RAM given to the fragmentation decoder (%" PRIu32 ")\n"
+          "  -m Size         RAM given to the datafile storage (%" PRIu32 ")\n"
+          "  -t Trials       number of sessions (%" PRIu32 ")\n"
+          "  -S Seed         random seed (%" PRIu32 ")\n"
+          "  -i Steps        main loop iterations between two fragments (%" PRIu32 ")\n"
+          "  -f File         flash backing file, kept between trials\n"
+          "  -R              wait for the flash operation times\n"
+          "  -d              binary file without firmware magic\n"
+          "  -v              print each trial, -vv the middleware trace\n",
+          pName, Config.FragNb, Config.FragSize, Config.Padding, Config.MaxCoded, BENCH_MAX_LOSS_MODELS,
+          Config.ArenaSize, Config.StorageRamSize, Config.Trials, Config.Seed, Config.IdleSteps);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  pthread_attr_t attr;
+  pthread_t thread;
+  int status = 0;
+  int verbose = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:s:p:r:l:o:u:a:m:t:S:i:f:Rdvh")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': Config.FragNb = (uint16_t)strtoul(optarg, NULL, 0); break;
+      case 's': Config.FragSize = (uint8_t)strtoul(optarg, NULL, 0); break;
+      case 'p': Config.Padding = (uint8_t)strtoul(optarg, NULL, 0); break;
+      case 'r': Config.MaxCoded = (uint16_t)strtoul(optarg, NULL, 0); break;
+      case 'a': Config.ArenaSize = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'm': Config.StorageRamSize = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 't': Config.Trials = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'S': Config.Seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'i': Config.IdleSteps = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'f': Config.Flash.Path = optarg; break;
+      case 'R': Config.Flash.RealTime = 1U; break;
+      case 'd': Config.IsRaw = true; break;
+      case 'v': verbose++; break;
+      case 'o':
+        if ((sscanf(optarg, "%lf:%hu", &Config.ReorderProb, &Config.ReorderDelay) != 2)
+            || (Config.ReorderProb < 0.0) || (Config.ReorderProb > 1.0))
+        {
+          fprintf(stderr, "invalid reordering %s\n", optarg);
+          return 2;
+        }
+        break;
+      case 'u':
+        Config.DuplicateProb = strtod(optarg, NULL);
+        if ((Config.DuplicateProb < 0.0) || (Config.DuplicateProb > 1.0))
+        {
+          fprintf(stderr, "invalid duplication %s\n", optarg);
+          return 2;
+        }
+        break;
+      case 'l':
+        if ((Config.NbLossModels == BENCH_MAX_LOSS_MODELS)
+            || (LossModelParse(optarg, &Config.LossModels[Config.NbLossModels]) != 0))
+        {
+          fprintf(stderr, "invalid loss model %s\n", optarg);
+          return 2;
+        }
+        Config.NbLossModels++;
+        break;
+      default:
+        Usage(argv[0]);
+        return 2;
+    }
+  }
+  if ((Config.FragNb == 0U) || (Config.FragSize == 0U) || (Config.FragSize > FRAG_MAX_SIZE)
+      || (Config.Padding >= Config.FragSize) || (Config.Trials == 0U)
+      || (((uint32_t)Config.FragNb + Config.MaxCoded) > 0x3FFFU))
+  {
+    Usage(argv[0]);
+    return 2;
+  }
+  Config.IsVerbose = (verbose > 0);
+  HostPlatformSetTrace(verbose > 1);
+
+  FileSize = ((uint32_t)Config.FragNb * Config.FragSize) - Config.Padding;
+  File = malloc((size_t)Config.FragNb * Config.FragSize);
+  Trials = calloc(Config.Trials, sizeof(BenchTrial_t));
+  StackBase = malloc(BENCH_STACK_SIZE);
+  FragmentationParams.DecoderArena = malloc(Config.ArenaSize);
+  FragmentationParams.DecoderArenaSize = Config.ArenaSize;
+  StorageRam = malloc(Config.StorageRamSize);
+  if ((File == NULL) || (Trials == NULL) || (StackBase == NULL) || (FragmentationParams.DecoderArena == NULL)
+      || (StorageRam == NULL))
+  {
+    return 1;
+  }
+
+  /* The trials run on a painted stack to find out how deep it was used */
+  memset(StackBase, BENCH_STACK_PAINT, BENCH_STACK_SIZE);
+  pthread_attr_init(&attr);
+  pthread_attr_setstack(&attr, StackBase, BENCH_STACK_SIZE);
+  if (pthread_create(&thread, &attr, RunTrials, &status) != 0)
+  {
+    return 1;
+  }
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attr);
+  if (status != 0)
+  {
+    return 1;
+  }
+
+  Report(GetPeakStack());
+  return 0;
+}
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,117 @@
+/**
+  ******************************************************************************
+  * @file    HostPlatform.c
+  * @author  MCD Application Team
+  * @brief   Services of the end device firmware the host build provides
+  *          instead of the board support: trace output and SBSFU slots.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <stdarg.h>
+#include <stdio.h>
+#include "stm32l4xx.h"
+#include "sfu_app_new_image.h"
+#include "trace.h"
+#include "HostPlatform.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Offset of the image in the SBSFU slots, see sfu_fwimg_regions.h */
+#define SFU_IMG_IMAGE_OFFSET      ((uint32_t)512U)
+
+/* Private variables ---------------------------------------------------------*/
+static bool IsTraceEnabled = false;
+
+/* Private function prototypes -----------------------------------------------*/
+static uint32_t GetAreaInfo(SFU_FwImageFlashTypeDef *pArea, uint32_t uStart, uint32_t uEnd, uint32_t uOffset);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Fills an area descriptor from the linker mapping of a slot.
+  */
+static uint32_t GetAreaInfo(SFU_FwImageFlashTypeDef *pArea, uint32_t uStart, uint32_t uEnd, uint32_t uOffset)
+{
+  if (pArea == NULL)
+  {
+    return HAL_ERROR;
+  }
+  pArea->DownloadAddr = uStart;
+  pArea->MaxSizeInBytes = uEnd - uStart + 1U;
+  pArea->ImageOffsetInBytes = uOffset;
+  pArea->ExecutionAddr = uStart + uOffset;
+  return HAL_OK;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+void HostPlatformSetTrace(bool Enable)
+{
+  IsTraceEnabled = Enable;
+}
+
+int32_t TraceSend(const char *strFormat, ...)
+{
+  va_list vaArgs;
+
+  if (IsTraceEnabled)
+  {
+    va_start(vaArgs, strFormat);
+    vprintf(strFormat, vaArgs);
+    va_end(vaArgs);
+  }
+  return 0;
+}
+
+uint32_t SFU_APP_GetDownloadAreaInfo(SFU_FwImageFlashTypeDef *pArea)
+{
+  return GetAreaInfo(pArea, REGION_SLOT_1_START, REGION_SLOT_1_END, SFU_IMG_IMAGE_OFFSET);
+}
+
+uint32_t SFU_APP_GetActiveAreaInfo(SFU_FwImageFlashTypeDef *pArea)
+{
+  return GetAreaInfo(pArea, REGION_SLOT_0_START, REGION_SLOT_0_END, SFU_IMG_IMAGE_OFFSET);
+}
+
+uint32_t SFU_APP_GetSwapAreaInfo(SFU_FwImageFlashTypeDef *pArea)
+{
+  return GetAreaInfo(pArea, REGION_SWAP_START, REGION_SWAP_END, 0U);
+}
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
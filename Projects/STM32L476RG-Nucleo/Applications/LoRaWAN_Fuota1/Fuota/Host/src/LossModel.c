@@ -0,0 +1,157 @@
+/**
+  ******************************************************************************
+  * @file    LossModel.c
+  * @author  MCD Application Team
+  * @brief   Downlink loss models of the host FUOTA benchmark.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+#include <stdio.h>
+#include <string.h>
+#include "LossModel.h"
+
+/* Private variables ---------------------------------------------------------*/
+static uint64_t RandomState = 0x853C49E6748FEA9BULL;
+
+/* Private function prototypes -----------------------------------------------*/
+static double RandomUniform(void);
+static bool IsProbability(double p);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Gets a random number uniformly distributed in [0, 1).
+  */
+static double RandomUniform(void)
+{
+  return (double)LossModelRandom() / 4294967296.0;
+}
+
+/**
+  * @brief  Checks that a value is a probability.
+  */
+static bool IsProbability(double p)
+{
+  return (p >= 0.0) && (p <= 1.0);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int LossModelParse(const char *pDesc, LossModel_t *pModel)
+{
+  char end;
+  int n;
+
+  memset(pModel, 0, sizeof(*pModel));
+  if (sscanf(pDesc, "iid:%lf%c", &pModel->Loss, &end) == 1)
+  {
+    pModel->Type = LOSS_MODEL_IID;
+    return IsProbability(pModel->Loss) ? 0 : -1;
+  }
+  if (sscanf(pDesc, "tail:%lf%c", &pModel->Loss, &end) == 1)
+  {
+    pModel->Type = LOSS_MODEL_TAIL;
+    return IsProbability(pModel->Loss) ? 0 : -1;
+  }
+  pModel->LossBad = 1.0;
+  n = sscanf(pDesc, "ge:%lf:%lf:%lf:%lf%c", &pModel->PGoodBad, &pModel->PBadGood,
+             &pModel->LossGood, &pModel->LossBad, &end);
+  if ((n == 2) || (n == 4))
+  {
+    pModel->Type = LOSS_MODEL_GILBERT_ELLIOTT;
+    return (IsProbability(pModel->PGoodBad) && IsProbability(pModel->PBadGood)
+            && ((pModel->PGoodBad + pModel->PBadGood) > 0.0)
+            && IsProbability(pModel->LossGood) && IsProbability(pModel->LossBad)) ? 0 : -1;
+  }
+  return -1;
+}
+
+void LossModelSeed(uint32_t Seed)
+{
+  RandomState = ((uint64_t)Seed << 1) | 1U;
+  (void)LossModelRandom();
+}
+
+uint32_t LossModelRandom(void)
+{
+  /* PCG32 XSH RR */
+  uint64_t old = RandomState;
+  uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+  uint32_t rot = (uint32_t)(old >> 59);
+
+  RandomState = (old * 6364136223846793005ULL) + 1442695040888963407ULL;
+  return (xorShifted >> rot) | (xorShifted << ((32U - rot) & 31U));
+}
+
+void LossModelReset(LossModel_t *pModel)
+{
+  if (pModel->Type == LOSS_MODEL_GILBERT_ELLIOTT)
+  {
+    pModel->IsBad = RandomUniform() < (pModel->PGoodBad / (pModel->PGoodBad + pModel->PBadGood));
+  }
+}
+
+bool LossModelIsLost(LossModel_t *pModel, uint16_t FragCounter, uint16_t FragNb)
+{
+  bool isLost = false;
+
+  switch (pModel->Type)
+  {
+    case LOSS_MODEL_IID:
+      isLost = RandomUniform() < pModel->Loss;
+      break;
+    case LOSS_MODEL_GILBERT_ELLIOTT:
+      isLost = RandomUniform() < (pModel->IsBad ? pModel->LossBad : pModel->LossGood);
+      if (RandomUniform() < (pModel->IsBad ? pModel->PBadGood : pModel->PGoodBad))
+      {
+        pModel->IsBad = !pModel->IsBad;
+      }
+      break;
+    case LOSS_MODEL_TAIL:
+      isLost = (FragCounter <= FragNb)
+               && (FragCounter > (uint16_t)((double)FragNb * (1.0 - pModel->Loss) + 0.5));
+      break;
+    default:
+      break;
+  }
+  return isLost;
+}
+
+/************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,276 @@
+/**
+  ******************************************************************************
+  * @file    Sha256Check.c
+  * @author  MCD Application Team
+  * @brief   Host check of the Secure Engine SHA-256 block function: the digests
+  *          computed with it must match the stock mbedTLS ones, built side by
+  *          side with the ref_ prefix, on the FIPS 180-2 vectors and on random
+  *          lengths, alignments and splits. The host throughput of both block
+  *          functions is reported, the target one needs a cycle count on the board.
+  ******************************************************************************
+  * @attention
+  *
+  * <h2><center>&copy; Copyright(c) 2017 STMicroelectronics International N.V.
+  * All rights reserved.</center></h2>
+  *
+  * Redistribution and use in source and binary forms, with or without
+  * modification, are permitted, provided that the following conditions are met:
+  *
+  * 1. Redistribution of source code must retain the above copyright notice,
+  *    this list of conditions and the following disclaimer.
+  * 2. Redistributions in binary form must reproduce the above copyright notice,
+  *    this list of conditions and the following disclaimer in the documentation
+  *    and/or other materials provided with the distribution.
+  * 3. Neither the name of STMicroelectronics nor the names of other
+  *    contributors to this software may be used to endorse or promote products
+  *    derived from this software without specific written permission.
+  * 4. This software, including modifications and/or derivative works of this
+  *    software, must execute solely and exclusively on microcontroller or
+  *    microprocessor devices manufactured by or for STMicroelectronics.
+  * 5. Redistribution and use of this software other than as permitted under
+  *    this license is void and will automatically terminate your rights under
+  *    this license.
+  *
+  * THIS SOFTWARE IS PROVIDED BY STMICROELECTRONICS AND CONTRIBUTORS "AS IS"
+  * AND ANY EXPRESS, IMPLIED OR STATUTORY WARRANTIES, INCLUDING, BUT NOT
+  * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY, FITNESS FOR A
+  * PARTICULAR PURPOSE AND NON-INFRINGEMENT OF THIRD PARTY INTELLECTUAL PROPERTY
+  * RIGHTS ARE DISCLAIMED TO THE FULLEST EXTENT PERMITTED BY LAW. IN NO EVENT
+  * SHALL STMICROELECTRONICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+  * OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+  * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+  * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+  *
+  ******************************************************************************
+  */
+/* Includes ------------------------------------------------------------------*/
+/* Includes ------------------------------------------------------------------*/
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mbedtls/sha256.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Data offset at most, from an 8 bytes aligned buffer */
+#define CHECK_MAX_OFFSET          7U
+#define CHECK_SPEED_SIZE          (64U * 1024U)
+#define CHECK_SPEED_ROUNDS        500U
+
+/* Private typedef -----------------------------------------------------------*/
+typedef int (*CheckHash_t)(const unsigned char *input, size_t ilen, unsigned char output[32], int is224);
+
+typedef struct
+{
+  const char *pMessage;
+  uint32_t Repeat;
+  const char *pDigest;
+} CheckVector_t;
+
+/* Stock mbedTLS SHA-256 of library/sha256.c, symbols renamed at build time */
+int ref_mbedtls_sha256_ret(const unsigned char *input, size_t ilen, unsigned char output[32], int is224);
+int ref_mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx, const unsigned char data[64]);
+
+/* Private variables ---------------------------------------------------------*/
+static uint32_t Trials = 20000U;
+static uint32_t MaxLength = 600U;
+static uint32_t Seed = 1U;
+
+/* FIPS 180-2 appendix B */
+static const CheckVector_t Vectors[] =
+{
+  { "", 1U, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+  { "abc", 1U, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+  { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1U,
+    "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+  { "a", 1000000U, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0" },
+};
+
+/* Private functions ---------------------------------------------------------*/
+
+static uint32_t Random(void)
+{
+  Seed = Seed * 1103515245U + 12345U;
+  return Seed >> 1;
+}
+
+static uint64_t NowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static void ToHex(const uint8_t *pDigest, char *pHex)
+{
+  for (uint32_t i = 0U; i < 32U; i++)
+  {
+    sprintf(&pHex[2U * i], "%02x", pDigest[i]);
+  }
+}
+
+/**
+  * @brief  Digest of a known answer vector, the message repeated through update calls.
+  * @retval 0 when the digest is the expected one, 1 otherwise.
+  */
+static uint32_t CheckVector(const CheckVector_t *pVector)
+{
+  mbedtls_sha256_context ctx;
+  uint8_t digest[32];
+  char hex[65];
+
+  mbedtls_sha256_init(&ctx);
+  (void)mbedtls_sha256_starts_ret(&ctx, 0);
+  for (uint32_t i = 0U; i < pVector->Repeat; i++)
+  {
+    (void)mbedtls_sha256_update_ret(&ctx, (const unsigned char *)pVector->pMessage, strlen(pVector->pMessage));
+  }
+  (void)mbedtls_sha256_finish_ret(&ctx, digest);
+  mbedtls_sha256_free(&ctx);
+  ToHex(digest, hex);
+  if (strcmp(hex, pVector->pDigest) != 0)
+  {
+    fprintf(stderr, "\"%s\" x %" PRIu32 ": %s instead of %s\n", pVector->pMessage, pVector->Repeat, hex,
+            pVector->pDigest);
+    return 1U;
+  }
+  return 0U;
+}
+
+/**
+  * @brief  Throughput of a one shot hash on an aligned buffer, in MB/s.
+  */
+static double Speed(CheckHash_t Hash, const uint8_t *pData)
+{
+  uint8_t digest[32];
+  uint64_t start = NowNs();
+
+  for (uint32_t i = 0U; i < CHECK_SPEED_ROUNDS; i++)
+  {
+    (void)Hash(pData, CHECK_SPEED_SIZE, digest, 0);
+  }
+  return (double)CHECK_SPEED_ROUNDS * CHECK_SPEED_SIZE / ((double)(NowNs() - start) / 1000.0);
+}
+
+static void Usage(const char *pName)
+{
+  fprintf(stderr,
+          "usage: %s [options]\n"
+          "  -t Trials       random buffers checked (%" PRIu32 ")\n"
+          "  -l Length       buffer length at most (%" PRIu32 ")\n"
+          "  -S Seed         random seed (%" PRIu32 ")\n",
+          pName, Trials, MaxLength, Seed);
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  uint32_t vectorErrors = 0U;
+  uint32_t blockErrors = 0U;
+  uint32_t hashErrors = 0U;
+  uint64_t *words;
+  uint8_t *buf;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:l:S:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 't': Trials = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'l': MaxLength = (uint32_t)strtoul(optarg, NULL, 0); break;
+      case 'S': Seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+      default:
+        Usage(argv[0]);
+        return 2;
+    }
+  }
+
+  /* 64 bits words for an 8 bytes aligned buffer, a block past the longest length */
+  words = malloc(((MaxLength > CHECK_SPEED_SIZE) ? MaxLength : CHECK_SPEED_SIZE) + CHECK_MAX_OFFSET + 64U);
+  if (words == NULL)
+  {
+    return 1;
+  }
+  buf = (uint8_t *)words;
+
+  for (uint32_t i = 0U; i < (sizeof(Vectors) / sizeof(Vectors[0])); i++)
+  {
+    vectorErrors += CheckVector(&Vectors[i]);
+  }
+
+  for (uint32_t trial = 0U; trial < Trials; trial++)
+  {
+    uint32_t offset = Random() % (CHECK_MAX_OFFSET + 1U);
+    uint32_t len = Random() % (MaxLength + 1U);
+    uint32_t split = (len > 0U) ? Random() % (len + 1U) : 0U;
+    int is224 = (int)(Random() & 1U);
+    const uint8_t *data = buf + offset;
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_context refCtx;
+    uint8_t digest[32];
+    uint8_t refDigest[32];
+
+    for (uint32_t i = 0U; i < (len + 64U); i++)
+    {
+      buf[offset + i] = (uint8_t)Random();
+    }
+
+    /* Block function alone, from a random state */
+    for (uint32_t i = 0U; i < 8U; i++)
+    {
+      ctx.state[i] = Random() ^ (Random() << 16);
+    }
+    refCtx = ctx;
+    (void)mbedtls_internal_sha256_process(&ctx, data);
+    (void)ref_mbedtls_internal_sha256_process(&refCtx, data);
+    if (memcmp(ctx.state, refCtx.state, sizeof(ctx.state)) != 0)
+    {
+      if (blockErrors == 0U)
+      {
+        fprintf(stderr, "block function: offset %" PRIu32 ": states differ\n", offset);
+      }
+      blockErrors++;
+    }
+
+    /* Whole digest, the message given in two update calls */
+    mbedtls_sha256_init(&ctx);
+    (void)mbedtls_sha256_starts_ret(&ctx, is224);
+    (void)mbedtls_sha256_update_ret(&ctx, data, split);
+    (void)mbedtls_sha256_update_ret(&ctx, data + split, len - split);
+    (void)mbedtls_sha256_finish_ret(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+    (void)ref_mbedtls_sha256_ret(data, len, refDigest, is224);
+    if (memcmp(digest, refDigest, (is224 != 0) ? 28U : 32U) != 0)
+    {
+      if (hashErrors == 0U)
+      {
+        fprintf(stderr, "digest: length %" PRIu32 " offset %" PRIu32 " split %" PRIu32 " differs\n", len, offset,
+                split);
+      }
+      hashErrors++;
+    }
+  }
+
+  printf("vectors       : %" PRIu32 " of %zu FIPS 180-2 digests wrong\n", vectorErrors,
+         sizeof(Vectors) / sizeof(Vectors[0]));
+  printf("trials        : %" PRIu32 ", lengths up to %" PRIu32 ", offsets up to %u\n", Trials, MaxLength,
+         CHECK_MAX_OFFSET);
+  printf("block function: %" PRIu32 " mismatches with the stock mbedTLS one\n", blockErrors);
+  printf("digest        : %" PRIu32 " mismatches with the stock mbedTLS one\n", hashErrors);
+
+  memset(buf, 0x5A, CHECK_SPEED_SIZE);
+  printf("host speed    : stock %.0f MB/s, Secure Engine %.0f MB/s\n", Speed(ref_mbedtls_sha256_ret, buf),
+         Speed(mbedtls_sha256_ret, buf));
+  printf("target speed  : pending, needs a DWT cycle count on the STM32L476 at 80 MHz\n");
+
+  free(words);
+  return ((vectorErrors + blockErrors + hashErrors) == 0U) ? 0 : 1;
+}
@@ -52,6 +52,12 @@
 #include "stm32l4xx.h"
 
 /* Exported types ------------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Bytes;     /*!< Bytes programmed and checked */
+  uint32_t TimeMs;    /*!< Time spent in FlashMemHandlerFct.Write */
+} FlashMemHandler_WriteStats_t;
+
 /* Exported constants --------------------------------------------------------*/
 #define FLASH_IF_MIN_WRITE_LEN (8U)  /* Flash programming by 64 bits */
 /* Exported functions ------------------------------------------------------- */
@@ -97,6 +103,15 @@ struct FlashMemHandlerFct_s
 
 extern const struct  FlashMemHandlerFct_s FlashMemHandlerFct;
 
+/**
+  * @brief  Gets the bytes written by FlashMemHandlerFct.Write and the time
+  *         spent, measured with the DWT cycle counter.
+  * @note   This is the only flash write throughput figure: the host
+  *         benchmark models the flash timing and does not report one.
+  * @retval Write statistics since reset.
+  */
+FlashMemHandler_WriteStats_t FlashMemHandler_GetWriteStats(void);
+
 #endif  /* FLASHMEMHANDLER_H */
 
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
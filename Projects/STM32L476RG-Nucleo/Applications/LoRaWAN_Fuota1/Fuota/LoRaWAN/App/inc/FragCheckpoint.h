@@ -0,0 +1,57 @@
+/*  _        _   _ _ _ _
+   / \   ___| |_(_) (_) |_ _   _
+  / _ \ / __| __| | | | __| | | |
+ / ___ \ (__| |_| | | | |_| |_| |
+/_/   \_\___|\__|_|_|_|\__|\__, |
+                           |___/
+    (C)2020 Actility
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Description: Checkpoint of the fragmentation session to resume it after a reset
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef FRAGCHECKPOINT_H
+#define FRAGCHECKPOINT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+#define FRAG_CHECKPOINT_NVM_ID  8U    /*!< Journal record id, the LoRaMAC contexts use the ids below */
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Saves the fragmentation, decoder, datafile storage and multicast
+  *         session states to the NVM journal.
+  * @param  None
+  * @retval true if the checkpoint is stored.
+  */
+bool FragCheckpointSave(void);
+
+/**
+  * @brief  Drops the checkpoint once the session is over.
+  * @param  None
+  * @retval true if the checkpoint is cleared.
+  */
+bool FragCheckpointClear(void);
+
+/**
+  * @brief  Restores the last checkpoint and resumes the session it describes.
+  * @note   The packages must be registered and the LoRaMAC contexts restored.
+  *         Flash written after the checkpoint is scrubbed, fragments received
+  *         since then are counted as lost.
+  * @param  None
+  * @retval true if a fragmentation session is resumed.
+  */
+bool FragCheckpointRestore(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* FRAGCHECKPOINT_H */
@@ -0,0 +1,95 @@
+/*  _        _   _ _ _ _
+   / \   ___| |_(_) (_) |_ _   _
+  / _ \ / __| __| | | | __| | | |
+ / ___ \ (__| |_| | | | |_| |_| |
+/_/   \_\___|\__|_|_|_|\__|\__, |
+                           |___/
+    (C)2020 Actility
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Description: Append-only journal of the LoRaMAC NVM contexts in internal flash
+*/
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef NVMJOURNAL_H
+#define NVMJOURNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdint.h>
+
+/* Exported types ------------------------------------------------------------*/
+typedef enum
+{
+  NVM_JOURNAL_OK = 0,         /*!< Operation was successful */
+  NVM_JOURNAL_NOT_FOUND,      /*!< No valid record of this id and size */
+  NVM_JOURNAL_ERROR           /*!< Bad parameter, flash error or journal full */
+} NvmJournalStatus_t;
+
+typedef struct
+{
+  const void *pData;          /*!< Block content */
+  uint16_t Size;              /*!< Block size in bytes */
+} NvmJournalBlock_t;
+
+/* Exported constants --------------------------------------------------------*/
+#define NVM_JOURNAL_MAX_ID      16U   /*!< Record ids are 0 .. NVM_JOURNAL_MAX_ID - 1 */
+
+/* Exported functions ------------------------------------------------------- */
+
+/**
+  * @brief  Scans the journal region and indexes the last valid record of each id.
+  * @note   Called on first use by NvmJournalWrite and NvmJournalGet.
+  * @param  None
+  * @retval NVM_JOURNAL_OK
+  */
+NvmJournalStatus_t NvmJournalInit(void);
+
+/**
+  * @brief  Appends a new version of a record.
+  * @note   Nothing is written when the record content did not change. When the
+  *         active bank is full the last records are compacted into the other bank.
+  * @param  Id: record id
+  * @param  pData: record content
+  * @param  Size: record size in bytes
+  * @retval NVM_JOURNAL_OK if the record is stored, NVM_JOURNAL_ERROR otherwise.
+  */
+NvmJournalStatus_t NvmJournalWrite(uint8_t Id, const void *pData, uint16_t Size);
+
+/**
+  * @brief  Appends a new version of a record made of several blocks.
+  * @note   The blocks are stored one after the other as a single record, which
+  *         is only valid once all of them are programmed.
+  * @param  Id: record id
+  * @param  pBlocks: record content blocks
+  * @param  NbBlocks: number of blocks
+  * @retval NVM_JOURNAL_OK if the record is stored, NVM_JOURNAL_ERROR otherwise.
+  */
+NvmJournalStatus_t NvmJournalWriteBlocks(uint8_t Id, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks);
+
+/**
+  * @brief  Gets the last version of a record in place in flash.
+  * @note   The record was checked by the scan, the pointer is valid until the next write.
+  * @param  Id: record id
+  * @param  Size: expected record size in bytes
+  * @param  ppData: address of the record data
+  * @retval NVM_JOURNAL_OK if a record of this size was found, NVM_JOURNAL_NOT_FOUND otherwise.
+  */
+NvmJournalStatus_t NvmJournalGet(uint8_t Id, uint16_t Size, const void **ppData);
+
+/**
+  * @brief  Gets the last version of a record of any size in place in flash.
+  * @param  Id: record id
+  * @param  ppData: address of the record data
+  * @param  pSize: record size in bytes
+  * @retval NVM_JOURNAL_OK if a record was found, NVM_JOURNAL_NOT_FOUND otherwise.
+  */
+NvmJournalStatus_t NvmJournalFind(uint8_t Id, const void **ppData, uint16_t *pSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* NVMJOURNAL_H */
@@ -79,6 +79,8 @@
   */
 static __IO uint32_t DoubleECC_Error_Counter = 0U;
 static __IO bool DoubleECC_Check;
+static FlashMemHandler_WriteStats_t WriteStats;
+static uint64_t WriteCycles = 0U;
 
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
@@ -191,6 +193,10 @@ static HAL_StatusTypeDef FlashMemHandler_Init(void)
 {
   HAL_StatusTypeDef ret = HAL_ERROR;
 
+  /* Cycle counter used to time the writes */
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
   /* Unlock the Program memory */
   if (HAL_FLASH_Unlock() == HAL_OK)
   {
@@ -321,7 +327,10 @@ static HAL_StatusTypeDef FlashMemHandler_Erase_Size(void *pStart, uint32_t uLeng
 
 /**
   * @brief  This function writes a data buffer in flash (data are 64-bit aligned).
-  * @note   After writing data buffer, the flash content is checked.
+  * @note   The flash is unlocked once for the whole buffer, programmed by
+  *         double word. Fast programming is not used: it needs a mass erased
+  *         bank (RM0351 3.3.7) while the slots are erased by pages. After
+  *         writing data buffer, the flash content is checked at once.
   * @param  pDestination: Start address for target location
   * @param  pSource: pointer on buffer with data to write
   * @param  uLength: Length of data buffer in byte. It has to be 64-bit aligned.
@@ -333,53 +342,65 @@ static HAL_StatusTypeDef FlashMemHandler_Write(void *pDestination, const void *p
   uint32_t i = 0U;
   uint32_t pdata = (uint32_t)pSource;
 
-  /* Initialize Flash */
-  e_ret_status = FlashMemHandler_Init();
+  uint32_t uDest = (uint32_t)pDestination;
+  uint32_t start_cycles = DWT->CYCCNT;
 
-  if (e_ret_status == HAL_OK)
+  /* Unlock the Flash once for the whole buffer *******************************/
+  if (HAL_FLASH_Unlock() != HAL_OK)
   {
-    /* Unlock the Flash to enable the flash control register access *************/
-    if (HAL_FLASH_Unlock() != HAL_OK)
-    {
-      PRINTF("ERROR ==> Unlock not possible\r\n");
-      return HAL_ERROR;
-    }
-    else
+    PRINTF("ERROR ==> Unlock not possible\r\n");
+    return HAL_ERROR;
+  }
+  /* Clear all FLASH flags */
+  __HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+  e_ret_status = HAL_OK;
+
+  /* DataLength must be a multiple of 64 bit */
+  for (i = 0U; i < uLength; i += 8U)
+  {
+    /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
+    be done by word */
+    if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, uDest + i,  *((uint64_t *)(pdata + i))) != HAL_OK)
     {
-      /* DataLength must be a multiple of 64 bit */
-      for (i = 0U; i < uLength; i += 8U)
-      {
-        /* Device voltage range supposed to be [2.7V to 3.6V], the operation will
-        be done by word */
-        if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, (uint32_t)pDestination,  *((uint64_t *)(pdata + i))) == HAL_OK)
-        {
-          /* Check the written value */
-          if (*(uint64_t *)pDestination != *(uint64_t *)(pdata + i))
-          {
-            /* Flash content doesn't match SRAM content */
-            e_ret_status = HAL_ERROR;
-            PRINTF("ERROR ==> Memory check failure\r\n");
-            break;
-          }
-          /* Increment FLASH Destination address */
-          pDestination = (void *)((uint32_t)pDestination + 8U);
-        }
-        else
-        {
-          /* Error occurred while writing data in Flash memory */
-          e_ret_status = HAL_ERROR;
-          PRINTF("ERROR ==> Memory write failure\r\n");
-          break;
-        }
-      }
-      /* Lock the Flash to disable the flash control register access (recommended
-      to protect the FLASH memory against possible unwanted operation) *********/
-      HAL_FLASH_Lock();
+      e_ret_status = HAL_ERROR;
+      break;
     }
   }
+  /* Lock the Flash to disable the flash control register access (recommended
+  to protect the FLASH memory against possible unwanted operation) *********/
+  HAL_FLASH_Lock();
+
+  if (e_ret_status != HAL_OK)
+  {
+    /* Error occurred while writing data in Flash memory */
+    PRINTF("ERROR ==> Memory write failure\r\n");
+  }
+  /* Check the written buffer at once */
+  else if (memcmp(pDestination, pSource, uLength) != 0)
+  {
+    /* Flash content doesn't match SRAM content */
+    e_ret_status = HAL_ERROR;
+    PRINTF("ERROR ==> Memory check failure\r\n");
+  }
+  else
+  {
+    WriteStats.Bytes += uLength;
+  }
+  WriteCycles += DWT->CYCCNT - start_cycles;
   return e_ret_status;
 }
 
+/**
+  * @brief  Gets the flash write statistics since FlashMemHandler init
+  * @param  None
+  * @retval Bytes written and time spent
+  */
+FlashMemHandler_WriteStats_t FlashMemHandler_GetWriteStats(void)
+{
+  WriteStats.TimeMs = (uint32_t)(WriteCycles / (SystemCoreClock / 1000U));
+  return WriteStats;
+}
+
 /**
   * @brief  This function reads flash
   * @param  pDestination: pointer on buffer with data to write
@@ -0,0 +1,166 @@
+/*  _        _   _ _ _ _
+   / \   ___| |_(_) (_) |_ _   _
+  / _ \ / __| __| | | | __| | | |
+ / ___ \ (__| |_| | | | |_| |_| |
+/_/   \_\___|\__|_|_|_|\__|\__, |
+                           |___/
+    (C)2020 Actility
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Description: Checkpoint of the fragmentation session to resume it after a reset.
+             The fragmentation, decoder, datafile storage and multicast session
+             states are saved together as a single NVM journal record, so that
+             they always match each other. The storage state is restored first
+             as the decoder reads its rows back through it.
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include <string.h>
+#include "FragCheckpoint.h"
+#include "NvmJournal.h"
+#include "FragDecoder.h"
+#include "LmhpFragmentation.h"
+#include "LmhpRemoteMcastSetup.h"
+#include "storage.h"
+
+/*
+ * Resuming relies on the decoder writing each row once while fragments are
+ * received and rewriting rows only in the final solve, so that the rows
+ * written after a checkpoint are the ones it does not list
+ */
+#if ( ACTILITY_LIBRARY == 1 ) && ( INTEROP_TEST_MODE == 0 ) && \
+    ( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 ) && ( FRAG_DECODER_DEFERRED_SOLVE == 1 )
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint16_t FragmentationSize;       /*!< Size of the fragmentation sessions state */
+  uint16_t DecoderSize;             /*!< Size of the decoder states, one per decoder session */
+  uint16_t StorageSize;             /*!< Size of the datafile storage state */
+  uint16_t McastSize;               /*!< Size of the multicast sessions state */
+} FragCheckpointHeader_t;
+
+/* Private define ------------------------------------------------------------*/
+#define FRAG_CHECKPOINT_NB_BLOCKS (4U + FRAG_DECODER_MAX_SESSIONS)
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Saves the session states to the NVM journal.
+  * @param  None
+  * @retval true if the checkpoint is stored.
+  */
+bool FragCheckpointSave(void)
+{
+  FragCheckpointHeader_t header;
+  NvmJournalBlock_t blocks[FRAG_CHECKPOINT_NB_BLOCKS];
+  NvmJournalBlock_t *block = blocks;
+  size_t size;
+  uint32_t storageSize;
+
+  block->pData = &header;
+  block->Size = sizeof(header);
+  block++;
+  block->pData = LmhpFragmentationGetNvmCtx(&size);
+  block->Size = (uint16_t)size;
+  header.FragmentationSize = block->Size;
+  block++;
+  header.DecoderSize = 0U;
+  for (uint8_t i = 0U; i < FRAG_DECODER_MAX_SESSIONS; i++)
+  {
+    block->pData = FragDecoderGetNvmCtx(i, &size);
+    block->Size = (uint16_t)size;
+    header.DecoderSize += block->Size;
+    block++;
+  }
+  block->pData = storage_datafile_get_ctx(&storageSize);
+  block->Size = (uint16_t)storageSize;
+  header.StorageSize = block->Size;
+  block++;
+  block->pData = LmhpRemoteMcastSetupGetNvmCtx(&size);
+  block->Size = (uint16_t)size;
+  header.McastSize = block->Size;
+
+  return NvmJournalWriteBlocks(FRAG_CHECKPOINT_NVM_ID, blocks, FRAG_CHECKPOINT_NB_BLOCKS) == NVM_JOURNAL_OK;
+}
+
+/**
+  * @brief  Drops the checkpoint, an empty record never matches a header.
+  * @param  None
+  * @retval true if the checkpoint is cleared.
+  */
+bool FragCheckpointClear(void)
+{
+  const void *pData;
+  uint16_t size;
+
+  if ((NvmJournalFind(FRAG_CHECKPOINT_NVM_ID, &pData, &size) != NVM_JOURNAL_OK) || (size == 0U))
+  {
+    return true;
+  }
+
+  return NvmJournalWrite(FRAG_CHECKPOINT_NVM_ID, NULL, 0U) == NVM_JOURNAL_OK;
+}
+
+/**
+  * @brief  Restores the last checkpoint, storage first as the decoder reads
+  *         back its rows through it.
+  * @param  None
+  * @retval true if a fragmentation session is resumed.
+  */
+bool FragCheckpointRestore(void)
+{
+  FragCheckpointHeader_t header;
+  const uint8_t *pData;
+  uint16_t size;
+
+  if ((NvmJournalFind(FRAG_CHECKPOINT_NVM_ID, (const void **)&pData, &size) != NVM_JOURNAL_OK) ||
+      (size < sizeof(header)))
+  {
+    return false;
+  }
+  memcpy(&header, pData, sizeof(header));
+  if (size != (sizeof(header) + (uint32_t)header.FragmentationSize + header.DecoderSize +
+               header.StorageSize + header.McastSize))
+  {
+    return false;
+  }
+  pData += sizeof(header);
+
+  const uint8_t *pFragmentation = pData;
+  const uint8_t *pDecoder = pFragmentation + header.FragmentationSize;
+  const uint8_t *pStorage = pDecoder + header.DecoderSize;
+  const uint8_t *pMcast = pStorage + header.StorageSize;
+
+  if (storage_datafile_restore_ctx(pStorage, header.StorageSize) != STR_OK)
+  {
+    return false;
+  }
+  if (LmhpFragmentationRestoreNvmCtx((void *)pFragmentation, header.FragmentationSize,
+                                     (void *)pDecoder, header.DecoderSize) == false)
+  {
+    return false;
+  }
+  /* Fragments may also come by unicast, the session goes on until the server opens a new class C window */
+  (void)LmhpRemoteMcastSetupRestoreNvmCtx((void *)pMcast, header.McastSize);
+
+  return true;
+}
+
+#else
+
+bool FragCheckpointSave(void)
+{
+  return false;
+}
+
+bool FragCheckpointClear(void)
+{
+  return true;
+}
+
+bool FragCheckpointRestore(void)
+{
+  return false;
+}
+
+#endif
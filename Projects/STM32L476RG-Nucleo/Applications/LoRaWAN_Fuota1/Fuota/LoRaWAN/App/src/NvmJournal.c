@@ -0,0 +1,537 @@
+/*  _        _   _ _ _ _
+   / \   ___| |_(_) (_) |_ _   _
+  / _ \ / __| __| | | | __| | | |
+ / ___ \ (__| |_| | | | |_| |_| |
+/_/   \_\___|\__|_|_|_|\__|\__, |
+                           |___/
+    (C)2020 Actility
+License: Revised BSD License, see LICENSE.TXT file include in the project
+Description: Append-only journal of the LoRaMAC NVM contexts in internal flash.
+             The NVM region is split in two banks. Records are appended to the
+             active bank; when it is full the last version of each record is
+             copied into the other bank, whose header is programmed last so
+             that an interrupted compaction leaves the previous bank in use.
+*/
+
+/* Includes ------------------------------------------------------------------*/
+#include <stdbool.h>
+#include <string.h>
+#include "NvmJournal.h"
+#include "FlashMemHandler.h"
+#include "crc32.h"
+
+#if defined (__ICCARM__) || defined(__GNUC__)
+#include "mapping_export.h"         /* to access to the definition of REGION_NVM_START*/
+#elif defined(__CC_ARM)
+#include "mapping_fwimg.h"
+#endif
+
+/* Private typedef -----------------------------------------------------------*/
+typedef struct
+{
+  uint32_t Magic;                   /*!< NVM_JOURNAL_MAGIC once the bank is complete */
+  uint32_t Sequence;                /*!< Incremented at each compaction, highest valid bank wins */
+} NvmJournalBankHeader_t;
+
+typedef struct
+{
+  uint8_t  Id;                      /*!< Record id */
+  uint8_t  IdInv;                   /*!< Bitwise inverse of Id */
+  uint16_t Size;                    /*!< Record size in bytes, without padding */
+  uint32_t Crc;                     /*!< CRC32 of Id, IdInv, Size and the record data */
+} NvmJournalRecordHeader_t;
+
+/* Private define ------------------------------------------------------------*/
+#define NVM_JOURNAL_MAGIC         0x4C4E564DU   /*!< "MVNL" */
+#define NVM_JOURNAL_BANK_SIZE     ((REGION_NVM_END - REGION_NVM_START + 1U) / 2U)
+#define NVM_JOURNAL_CHUNK_SIZE    64U           /*!< Staging buffer for programming and reading back */
+#define NVM_JOURNAL_NO_BANK       0U
+
+/* Private macro -------------------------------------------------------------*/
+#define ALIGN8(x)                 (((x) + 7U) & ~7U)
+#define RECORD_LENGTH(size)       (sizeof(NvmJournalRecordHeader_t) + ALIGN8((uint32_t)(size)))
+
+/* Private variables ---------------------------------------------------------*/
+static bool Initialized = false;
+static uint32_t ActiveBank = NVM_JOURNAL_NO_BANK;   /*!< Address of the bank in use */
+static uint32_t Sequence = 0U;                      /*!< Sequence of the bank in use */
+static uint32_t WriteOffset = 0U;                   /*!< Offset of the next record in the bank in use */
+static uint32_t RecordOffset[NVM_JOURNAL_MAX_ID];   /*!< Offset of the last valid record of each id, 0 if none */
+static uint64_t ChunkBuffer[NVM_JOURNAL_CHUNK_SIZE / sizeof(uint64_t)];
+
+/* Private function prototypes -----------------------------------------------*/
+static bool ReadHeader(uint32_t uAddr, NvmJournalRecordHeader_t *pHeader);
+static bool RecordIsValid(uint32_t uAddr, const NvmJournalRecordHeader_t *pHeader);
+static bool RecordMatches(uint32_t uAddr, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks, uint16_t Size);
+static uint32_t ScanBank(uint32_t uBank, uint32_t *pOffsets);
+static HAL_StatusTypeDef ProgramBlocks(uint32_t uAddr, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks);
+static HAL_StatusTypeDef ProgramBytes(uint32_t uAddr, const void *pSource, uint32_t uLength);
+static HAL_StatusTypeDef ProgramRecord(uint32_t uAddr, uint8_t Id, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks, uint16_t Size);
+static NvmJournalStatus_t Compact(uint8_t Id, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks, uint16_t Size);
+
+/* Private functions ---------------------------------------------------------*/
+
+/**
+  * @brief  Reads a record header, failing on an ECC error or a bad id check
+  * @param  uAddr: Address of the record
+  * @param  pHeader: Record header read
+  * @retval true if the header is consistent
+  */
+static bool ReadHeader(uint32_t uAddr, NvmJournalRecordHeader_t *pHeader)
+{
+  if (FlashMemHandlerFct.Read((void *)uAddr, pHeader, sizeof(NvmJournalRecordHeader_t)) != HAL_OK)
+  {
+    return false;
+  }
+  return ((pHeader->Id ^ pHeader->IdInv) == 0xFFU);
+}
+
+/**
+  * @brief  Checks the CRC of a record
+  * @param  uAddr: Address of the record
+  * @param  pHeader: Record header
+  * @retval true if the record data are complete
+  */
+static bool RecordIsValid(uint32_t uAddr, const NvmJournalRecordHeader_t *pHeader)
+{
+  uint32_t crc = crc32_update(CRC32_INITIAL_VALUE, (const uint8_t *)pHeader, 4U);
+  uint32_t offset = 0U;
+
+  while (offset < pHeader->Size)
+  {
+    uint32_t length = pHeader->Size - offset;
+
+    if (length > NVM_JOURNAL_CHUNK_SIZE)
+    {
+      length = NVM_JOURNAL_CHUNK_SIZE;
+    }
+    if (FlashMemHandlerFct.Read((void *)(uAddr + sizeof(NvmJournalRecordHeader_t) + offset), ChunkBuffer, length) != HAL_OK)
+    {
+      return false;
+    }
+    crc = crc32_update(crc, (const uint8_t *)ChunkBuffer, length);
+    offset += length;
+  }
+
+  return (CRC32_FINAL(crc) == pHeader->Crc);
+}
+
+/**
+  * @brief  Compares the data of a valid record with a list of blocks
+  * @param  uAddr: Address of the record
+  * @param  pBlocks: Blocks to compare
+  * @param  NbBlocks: Number of blocks
+  * @param  Size: Total size of the blocks in bytes
+  * @retval true if the record holds the same data
+  */
+static bool RecordMatches(uint32_t uAddr, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks, uint16_t Size)
+{
+  NvmJournalRecordHeader_t header;
+  uint32_t addr = uAddr + sizeof(NvmJournalRecordHeader_t);
+  uint32_t i;
+
+  if ((ReadHeader(uAddr, &header) == false) || (header.Size != Size))
+  {
+    return false;
+  }
+  for (i = 0U; i < NbBlocks; i++)
+  {
+    uint32_t offset = 0U;
+
+    while (offset < pBlocks[i].Size)
+    {
+      uint32_t length = pBlocks[i].Size - offset;
+
+      if (length > NVM_JOURNAL_CHUNK_SIZE)
+      {
+        length = NVM_JOURNAL_CHUNK_SIZE;
+      }
+      if ((FlashMemHandlerFct.Read((void *)addr, ChunkBuffer, length) != HAL_OK)
+          || (memcmp(ChunkBuffer, (const uint8_t *)pBlocks[i].pData + offset, length) != 0))
+      {
+        return false;
+      }
+      offset += length;
+      addr += length;
+    }
+  }
+
+  return true;
+}
+
+/**
+  * @brief  Indexes the last valid record of each id in a bank
+  * @note   A record with a broken header ends the scan and the bank is then
+  *         reported full, so that the next write compacts it.
+  * @param  uBank: Address of the bank
+  * @param  pOffsets: Offset of the last valid record of each id, 0 if none
+  * @retval Offset of the first free byte of the bank
+  */
+static uint32_t ScanBank(uint32_t uBank, uint32_t *pOffsets)
+{
+  static const uint8_t erased[sizeof(NvmJournalRecordHeader_t)] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+  NvmJournalRecordHeader_t header;
+  uint32_t offset = sizeof(NvmJournalBankHeader_t);
+
+  memset(pOffsets, 0, NVM_JOURNAL_MAX_ID * sizeof(uint32_t));
+
+  while ((offset + sizeof(NvmJournalRecordHeader_t)) <= NVM_JOURNAL_BANK_SIZE)
+  {
+    if (ReadHeader(uBank + offset, &header) == false)
+    {
+      if (memcmp(&header, erased, sizeof(header)) == 0)
+      {
+        return offset;
+      }
+      return NVM_JOURNAL_BANK_SIZE;
+    }
+    if ((offset + RECORD_LENGTH(header.Size)) > NVM_JOURNAL_BANK_SIZE)
+    {
+      return NVM_JOURNAL_BANK_SIZE;
+    }
+    /* A record interrupted by a reset fails its CRC and is skipped */
+    if ((header.Id < NVM_JOURNAL_MAX_ID) && (RecordIsValid(uBank + offset, &header) == true))
+    {
+      pOffsets[header.Id] = offset;
+    }
+    offset += RECORD_LENGTH(header.Size);
+  }
+
+  return NVM_JOURNAL_BANK_SIZE;
+}
+
+/**
+  * @brief  Programs blocks one after the other, the last double word padded with 0xFF
+  * @param  uAddr: Destination address, 64-bit aligned
+  * @param  pBlocks: Data to program, in RAM or in flash
+  * @param  NbBlocks: Number of blocks
+  * @retval HAL Status.
+  */
+static HAL_StatusTypeDef ProgramBlocks(uint32_t uAddr, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks)
+{
+  uint32_t fill = 0U;
+  uint32_t i;
+
+  for (i = 0U; i < NbBlocks; i++)
+  {
+    uint32_t offset = 0U;
+
+    while (offset < pBlocks[i].Size)
+    {
+      uint32_t length = pBlocks[i].Size - offset;
+
+      if (length > (NVM_JOURNAL_CHUNK_SIZE - fill))
+      {
+        length = NVM_JOURNAL_CHUNK_SIZE - fill;
+      }
+      memcpy((uint8_t *)ChunkBuffer + fill, (const uint8_t *)pBlocks[i].pData + offset, length);
+      offset += length;
+      fill += length;
+      if (fill == NVM_JOURNAL_CHUNK_SIZE)
+      {
+        if (FlashMemHandlerFct.Write((void *)uAddr, ChunkBuffer, NVM_JOURNAL_CHUNK_SIZE) != HAL_OK)
+        {
+          return HAL_ERROR;
+        }
+        uAddr += NVM_JOURNAL_CHUNK_SIZE;
+        fill = 0U;
+      }
+    }
+  }
+
+  if (fill != 0U)
+  {
+    memset((uint8_t *)ChunkBuffer + fill, 0xFF, NVM_JOURNAL_CHUNK_SIZE - fill);
+    if (FlashMemHandlerFct.Write((void *)uAddr, ChunkBuffer, ALIGN8(fill)) != HAL_OK)
+    {
+      return HAL_ERROR;
+    }
+  }
+
+  return HAL_OK;
+}
+
+/**
+  * @brief  Programs a buffer of any length, the last double word padded with 0xFF
+  * @param  uAddr: Destination address, 64-bit aligned
+  * @param  pSource: Data to program, in RAM or in flash
+  * @param  uLength: Length in bytes, less than a bank
+  * @retval HAL Status.
+  */
+static HAL_StatusTypeDef ProgramBytes(uint32_t uAddr, const void *pSource, uint32_t uLength)
+{
+  NvmJournalBlock_t block;
+
+  block.pData = pSource;
+  block.Size = (uint16_t)uLength;
+
+  return ProgramBlocks(uAddr, &block, 1U);
+}
+
+/**
+  * @brief  Programs a record, header first
+  * @param  uAddr: Address of the record
+  * @param  Id: Record id
+  * @param  pBlocks: Record data blocks
+  * @param  NbBlocks: Number of blocks
+  * @param  Size: Record size in bytes
+  * @retval HAL Status.
+  */
+static HAL_StatusTypeDef ProgramRecord(uint32_t uAddr, uint8_t Id, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks, uint16_t Size)
+{
+  NvmJournalRecordHeader_t header;
+  uint32_t crc;
+  uint32_t i;
+
+  header.Id = Id;
+  header.IdInv = (uint8_t)~Id;
+  header.Size = Size;
+  crc = crc32_update(CRC32_INITIAL_VALUE, (const uint8_t *)&header, 4U);
+  for (i = 0U; i < NbBlocks; i++)
+  {
+    crc = crc32_update(crc, (const uint8_t *)pBlocks[i].pData, pBlocks[i].Size);
+  }
+  header.Crc = CRC32_FINAL(crc);
+
+  if (ProgramBytes(uAddr, &header, sizeof(header)) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  return ProgramBlocks(uAddr + sizeof(header), pBlocks, NbBlocks);
+}
+
+/**
+  * @brief  Copies the last version of each record and the new record into the other bank
+  * @param  Id: Id of the new record
+  * @param  pBlocks: Data blocks of the new record
+  * @param  NbBlocks: Number of blocks
+  * @param  Size: Size of the new record in bytes
+  * @retval NVM_JOURNAL_OK if the new bank is in use.
+  */
+static NvmJournalStatus_t Compact(uint8_t Id, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks, uint16_t Size)
+{
+  uint32_t bank = (ActiveBank == REGION_NVM_START) ? (REGION_NVM_START + NVM_JOURNAL_BANK_SIZE) : REGION_NVM_START;
+  uint32_t offsets[NVM_JOURNAL_MAX_ID] = { 0U };
+  uint32_t offset = sizeof(NvmJournalBankHeader_t);
+  NvmJournalBankHeader_t bank_header;
+  uint32_t i;
+
+  if (FlashMemHandlerFct.Erase_Size((void *)bank, NVM_JOURNAL_BANK_SIZE) != HAL_OK)
+  {
+    return NVM_JOURNAL_ERROR;
+  }
+
+  for (i = 0U; i < NVM_JOURNAL_MAX_ID; i++)
+  {
+    if ((i != Id) && (RecordOffset[i] != 0U))
+    {
+      NvmJournalRecordHeader_t header;
+      uint32_t length;
+
+      if (ReadHeader(ActiveBank + RecordOffset[i], &header) == false)
+      {
+        continue;
+      }
+      length = RECORD_LENGTH(header.Size);
+      if ((offset + length) > NVM_JOURNAL_BANK_SIZE)
+      {
+        return NVM_JOURNAL_ERROR;
+      }
+      if (ProgramBytes(bank + offset, (const void *)(ActiveBank + RecordOffset[i]), length) != HAL_OK)
+      {
+        return NVM_JOURNAL_ERROR;
+      }
+      offsets[i] = offset;
+      offset += length;
+    }
+  }
+
+  if (((offset + RECORD_LENGTH(Size)) > NVM_JOURNAL_BANK_SIZE)
+      || (ProgramRecord(bank + offset, Id, pBlocks, NbBlocks, Size) != HAL_OK))
+  {
+    return NVM_JOURNAL_ERROR;
+  }
+  offsets[Id] = offset;
+  offset += RECORD_LENGTH(Size);
+
+  /* The bank becomes valid only once its header is programmed */
+  bank_header.Magic = NVM_JOURNAL_MAGIC;
+  bank_header.Sequence = Sequence + 1U;
+  if (ProgramBytes(bank, &bank_header, sizeof(bank_header)) != HAL_OK)
+  {
+    return NVM_JOURNAL_ERROR;
+  }
+
+  ActiveBank = bank;
+  Sequence = bank_header.Sequence;
+  WriteOffset = offset;
+  memcpy(RecordOffset, offsets, sizeof(RecordOffset));
+
+  return NVM_JOURNAL_OK;
+}
+
+/* Exported functions --------------------------------------------------------*/
+
+/**
+  * @brief  Scans the journal region and indexes the last valid record of each id.
+  * @param  None
+  * @retval NVM_JOURNAL_OK
+  */
+NvmJournalStatus_t NvmJournalInit(void)
+{
+  NvmJournalBankHeader_t bank_header;
+  uint32_t bank;
+
+  ActiveBank = NVM_JOURNAL_NO_BANK;
+  Sequence = 0U;
+  WriteOffset = NVM_JOURNAL_BANK_SIZE;
+  memset(RecordOffset, 0, sizeof(RecordOffset));
+
+  for (bank = REGION_NVM_START; bank < (REGION_NVM_START + (2U * NVM_JOURNAL_BANK_SIZE)); bank += NVM_JOURNAL_BANK_SIZE)
+  {
+    if ((FlashMemHandlerFct.Read((void *)bank, &bank_header, sizeof(bank_header)) == HAL_OK)
+        && (bank_header.Magic == NVM_JOURNAL_MAGIC)
+        && ((ActiveBank == NVM_JOURNAL_NO_BANK) || ((int32_t)(bank_header.Sequence - Sequence) > 0)))
+    {
+      ActiveBank = bank;
+      Sequence = bank_header.Sequence;
+    }
+  }
+
+  if (ActiveBank != NVM_JOURNAL_NO_BANK)
+  {
+    WriteOffset = ScanBank(ActiveBank, RecordOffset);
+  }
+  Initialized = true;
+
+  return NVM_JOURNAL_OK;
+}
+
+/**
+  * @brief  Appends a new version of a record.
+  * @param  Id: record id
+  * @param  pData: record content
+  * @param  Size: record size in bytes
+  * @retval NVM_JOURNAL_OK if the record is stored, NVM_JOURNAL_ERROR otherwise.
+  */
+NvmJournalStatus_t NvmJournalWrite(uint8_t Id, const void *pData, uint16_t Size)
+{
+  NvmJournalBlock_t block;
+
+  block.pData = pData;
+  block.Size = Size;
+
+  return NvmJournalWriteBlocks(Id, &block, 1U);
+}
+
+/**
+  * @brief  Appends a new version of a record made of several blocks.
+  * @param  Id: record id
+  * @param  pBlocks: record content blocks
+  * @param  NbBlocks: number of blocks
+  * @retval NVM_JOURNAL_OK if the record is stored, NVM_JOURNAL_ERROR otherwise.
+  */
+NvmJournalStatus_t NvmJournalWriteBlocks(uint8_t Id, const NvmJournalBlock_t *pBlocks, uint32_t NbBlocks)
+{
+  uint32_t size = 0U;
+  uint32_t i;
+
+  if ((Id >= NVM_JOURNAL_MAX_ID) || ((pBlocks == NULL) && (NbBlocks != 0U)))
+  {
+    return NVM_JOURNAL_ERROR;
+  }
+  for (i = 0U; i < NbBlocks; i++)
+  {
+    if ((pBlocks[i].pData == NULL) && (pBlocks[i].Size != 0U))
+    {
+      return NVM_JOURNAL_ERROR;
+    }
+    size += pBlocks[i].Size;
+  }
+  if (size > UINT16_MAX)
+  {
+    return NVM_JOURNAL_ERROR;
+  }
+  if (Initialized == false)
+  {
+    NvmJournalInit();
+  }
+
+  if ((RecordOffset[Id] != 0U) && (RecordMatches(ActiveBank + RecordOffset[Id], pBlocks, NbBlocks, (uint16_t)size) == true))
+  {
+    return NVM_JOURNAL_OK;
+  }
+
+  if ((ActiveBank == NVM_JOURNAL_NO_BANK) || ((WriteOffset + RECORD_LENGTH(size)) > NVM_JOURNAL_BANK_SIZE))
+  {
+    return Compact(Id, pBlocks, NbBlocks, (uint16_t)size);
+  }
+
+  if (ProgramRecord(ActiveBank + WriteOffset, Id, pBlocks, NbBlocks, (uint16_t)size) != HAL_OK)
+  {
+    /* Compact on next write rather than append after a partial record */
+    WriteOffset = NVM_JOURNAL_BANK_SIZE;
+    return NVM_JOURNAL_ERROR;
+  }
+  RecordOffset[Id] = WriteOffset;
+  WriteOffset += RECORD_LENGTH(size);
+
+  return NVM_JOURNAL_OK;
+}
+
+/**
+  * @brief  Gets the last version of a record in place in flash.
+  * @param  Id: record id
+  * @param  Size: expected record size in bytes
+  * @param  ppData: address of the record data
+  * @retval NVM_JOURNAL_OK if a record of this size was found, NVM_JOURNAL_NOT_FOUND otherwise.
+  */
+NvmJournalStatus_t NvmJournalGet(uint8_t Id, uint16_t Size, const void **ppData)
+{
+  NvmJournalStatus_t status;
+  uint16_t size;
+
+  status = NvmJournalFind(Id, ppData, &size);
+  if ((status == NVM_JOURNAL_OK) && (size != Size))
+  {
+    return NVM_JOURNAL_NOT_FOUND;
+  }
+
+  return status;
+}
+
+/**
+  * @brief  Gets the last version of a record of any size in place in flash.
+  * @param  Id: record id
+  * @param  ppData: address of the record data
+  * @param  pSize: record size in bytes
+  * @retval NVM_JOURNAL_OK if a record was found, NVM_JOURNAL_NOT_FOUND otherwise.
+  */
+NvmJournalStatus_t NvmJournalFind(uint8_t Id, const void **ppData, uint16_t *pSize)
+{
+  NvmJournalRecordHeader_t header;
+  uint32_t addr;
+
+  if ((Id >= NVM_JOURNAL_MAX_ID) || (ppData == NULL) || (pSize == NULL))
+  {
+    return NVM_JOURNAL_ERROR;
+  }
+  if (Initialized == false)
+  {
+    NvmJournalInit();
+  }
+  if (RecordOffset[Id] == 0U)
+  {
+    return NVM_JOURNAL_NOT_FOUND;
+  }
+
+  addr = ActiveBank + RecordOffset[Id];
+  if (ReadHeader(addr, &header) == false)
+  {
+    return NVM_JOURNAL_NOT_FOUND;
+  }
+  *ppData = (const void *)(addr + sizeof(header));
+  *pSize = header.Size;
+
+  return NVM_JOURNAL_OK;
+}
@@ -41,6 +41,8 @@
 
 #include "sfu_app_new_image.h"
 #include "storage.h"
+#include "crc32.h"
+#include "FragCheckpoint.h"
 #if	( ACTILITY_SMART_DELTA == 1 )
 #include "patch.h"
 #include "verify_signature.h"
@@ -140,10 +142,6 @@
  */
 #define LORAWAN_DUTYCYCLE_ON                        true
 
-/*
- * Firmware file magic to distinguish from binary
- */
-#define FIRMWARE_MAGIC								0x4D554653
 /*!
  * User application buffer
  */
@@ -204,6 +202,7 @@ static void OnFragDone(int32_t status, uint8_t *file, uint32_t size);
 
 #if ( ACTILITY_LIBRARY == 1 )
 static void OnUpdateAgentFragDone(int32_t status, uint32_t size);
+static void OnFragSessionChange(void);
 static void NewImageValidate ( void *params ); 
 #endif // ACTILITY_LIBRARY
 static void UplinkProcess(void);
@@ -263,15 +262,11 @@ static LmhpComplianceParams_t LmhpComplianceParams =
 /*!
  * Defines the maximum size for the buffer receiving the fragmentation result.
  *
- * \remark By default FragDecoder.h defines:
- *         \ref FRAG_MAX_NB   313
- *         \ref FRAG_MAX_SIZE 216
+ * \remark By default:
+ *         \ref UNFRAGMENTED_FRAG_NB 1000
+ *         \ref FRAG_MAX_SIZE        230
  *
- *         In interop test mode will be
- *         \ref FRAG_MAX_NB   21
- *         \ref FRAG_MAX_SIZE 50
- *
- *         FileSize = FRAG_MAX_NB * FRAG_MAX_SIZE
+ *         FileSize = UNFRAGMENTED_FRAG_NB * FRAG_MAX_SIZE
  *
  *         If bigger file size is to be received or is fragmented differently
  *         one must update those parameters.
@@ -287,7 +282,33 @@ static LmhpComplianceParams_t LmhpComplianceParams =
  *
  */
 
-#define UNFRAGMENTED_DATA_SIZE                     ( FRAG_MAX_NB * FRAG_MAX_SIZE )
+#define UNFRAGMENTED_FRAG_NB                       1000
+#define UNFRAGMENTED_DATA_SIZE                     ( UNFRAGMENTED_FRAG_NB * FRAG_MAX_SIZE )
+
+/*!
+ * Defines the size of the RAM the fragmentation decoder is laid out in.
+ *
+ * \remark The arrays sized on the number of fragments take
+ *         ~( FRAG_PARITY_ROW_CACHE_NB + 0.3 ) byte per fragment, the lost
+ *         fragments system ~( Lost * Lost / 8 + 6 * Lost ) bytes. The lost fragments the session can be decoded with are also
+ *         bounded by the storage, see storage_datafile_max_lost.
+ */
+#define FRAG_DECODER_ARENA_SIZE                    8192
+
+static uint32_t FragDecoderArena[FRAG_DECODER_ARENA_SIZE / sizeof(uint32_t)];
+
+/*!
+ * Defines the size of the RAM the datafile storage tracks its slots in.
+ *
+ * \remark The ready pages of the slots take 1 bit per flash page, the
+ *         written fragment slots of the SWAP slot 1 bit per row of the
+ *         fragment size, ~800 bytes for 48 bytes fragments. The rest holds
+ *         the double words shared by two fragments, 32 bytes per lost
+ *         fragment, see storage_datafile_max_lost.
+ */
+#define STORAGE_RAM_SIZE                           4096
+
+static uint32_t StorageRam[STORAGE_RAM_SIZE / sizeof(uint32_t)];
 
 
 #if ( INTEROP_TEST_MODE == 1 )
@@ -323,6 +344,8 @@ uint32_t storage_GetSourceAreaInfo(SFU_FwImageFlashTypeDef *pArea) {
 
 static LmhpFragmentationParams_t FragmentationParams =
 {
+  .DecoderArena = FragDecoderArena,
+  .DecoderArenaSize = sizeof(FragDecoderArena),
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
   .DecoderCallbacks =
   {
@@ -341,6 +364,8 @@ static LmhpFragmentationParams_t FragmentationParams =
 
 static LmhpFragmentationParams_t FragmentationParams =
 {
+  .DecoderArena = FragDecoderArena,
+  .DecoderArenaSize = sizeof(FragDecoderArena),
 #if( FRAG_DECODER_FILE_HANDLING_NEW_API == 1 )
   .DecoderCallbacks =
   {
@@ -352,7 +377,8 @@ static LmhpFragmentationParams_t FragmentationParams =
   .BufferSize = UNFRAGMENTED_DATA_SIZE,
 #endif
   .OnProgress = OnFragProgress,           // should be OnUpdateAgentFragProgress to use Actility lib handling progress
-  .OnDone = OnUpdateAgentFragDone         // the only API hook with Actility lib right now
+  .OnDone = OnUpdateAgentFragDone,        // the only API hook with Actility lib right now
+  .OnSessionChange = OnFragSessionChange
 };
 
 static LmhpFWManagementParams_t FWManagementParams =
@@ -391,6 +417,26 @@ static volatile bool IsMcSessionStarted = false;
  */
 static volatile bool IsFileTransferDone = false;
 
+/*
+ * Indicates that the LoRaMAC contexts were restored from the NVM journal
+ */
+static volatile bool IsNvmContextRestored = false;
+
+/*
+ * Indicates that fragments of a file are being received
+ */
+static volatile bool IsFragTransferOngoing = false;
+
+/*
+ * Number of received fragments between two checkpoints of the session
+ */
+#define FRAG_CHECKPOINT_PERIOD 32U
+
+/*
+ * Indicates that the fragmentation session state has to be checkpointed
+ */
+static volatile bool IsFragCheckpointPending = false;
+
 /*
  *  Received file computed CRC32
  */
@@ -463,8 +509,20 @@ int main(void)
 
   PRINTF("\n\rTAG to VALIDATE new FW upgrade %d\n\r", __APP_VERSION_RC);
 
+  /* The CRC32 engine checks every image and journal record, a wrong setup must not go unnoticed */
+  if (crc32_self_test() != true)
+  {
+    PRINTF("CRC32 engine self test failed\r\n");
+    Error_Handler();
+  }
 
-  storage_init();
+  storage_set_ram(StorageRam, sizeof(StorageRam));
+  /* A wrong slot layout or a storage RAM too small for its state would only show once fragments are stored */
+  if (storage_init() != STR_OK)
+  {
+    PRINTF("Storage init failed\r\n");
+    Error_Handler();
+  }
 
 #if	( ACTILITY_SMART_DELTA == 1 )
   patch_init();
@@ -474,8 +532,22 @@ int main(void)
 
   IsFileTransferDone = false;
 
-  /* first join request*/
-  LmHandlerJoin();
+  /* first join request, unless the session was restored from the NVM journal */
+  if ((IsNvmContextRestored == true) && (LmHandlerJoinStatus() == LORAMAC_HANDLER_SET))
+  {
+    PRINTF("\r\n.......  SESSION RESTORED  .......\r\n");
+    LmHandlerRequestClass(LORAWAN_DEFAULT_CLASS);
+    /* resume the file download, the class C window waits for a new session request */
+    if (FragCheckpointRestore() == true)
+    {
+      PRINTF("\r\n.......  FRAG SESSION RESUMED  .......\r\n");
+      IsFragTransferOngoing = true;
+    }
+  }
+  else
+  {
+    LmHandlerJoin();
+  }
 
   /* first Tx frame transmission*/
   LoraStartTx() ;
@@ -488,12 +560,34 @@ int main(void)
     /*Processes the LoRaMac events*/
     LmHandlerProcess();
 
+    if (IsFragCheckpointPending == true)
+    {
+      IsFragCheckpointPending = false;
+      FragCheckpointSave();
+    }
+
+    bool isSourceErasePending = false;
+#if ( ACTILITY_LIBRARY == 1 ) && ( INTEROP_TEST_MODE == 0 )
+    /* Erase the slot fragments are stored to right after the session setup,
+     * one page at a time, and don't sleep until it is done */
+    if (storage_erase_slot_step(STORAGE_SLOT_SOURCE) == STR_OK)
+    {
+      isSourceErasePending = true;
+    }
+    /* Erase the slot the image is unpacked to while fragments are received,
+     * one page at a time, so that it is ready once the file is complete */
+    else if (IsFragTransferOngoing == true)
+    {
+      storage_erase_slot_step(STORAGE_SLOT_SCRATCH);
+    }
+#endif
+
     /*If a flag is set at this point, mcu must not enter low power and must loop*/
     DISABLE_IRQ();
 
     /* if an interrupt has occurred after DISABLE_IRQ, it is kept pending
      * and cortex will not enter low power anyway  */
-    if ((IsMacProcessPending != 1) && (IsTxFramePending != 1))
+    if ((IsMacProcessPending != 1) && (IsTxFramePending != 1) && (isSourceErasePending != true))
     {
 #ifndef LOW_POWER_DISABLE
       LPM_EnterLowPower();
@@ -681,6 +775,13 @@ static void OnFragProgress(uint16_t fragCounter, uint16_t fragNb, uint8_t fragSi
   LED_Off(LED_BLUE) ;
 #endif
 
+  IsFragTransferOngoing = true;
+
+  if ((fragCounter % FRAG_CHECKPOINT_PERIOD) == 0U)
+  {
+    IsFragCheckpointPending = true;
+  }
+
   PRINTF("\r\n....... FRAG_DECODER in Progress .......\r\n");
   PRINTF("RECEIVED    : %5d / %5d Fragments\r\n", fragCounter, fragNb);
   PRINTF("              %5d / %5d Bytes\r\n", fragCounter * fragSize, fragNb * fragSize);
@@ -743,20 +844,54 @@ static void OnFragDone(int32_t status, uint8_t *file, uint32_t size)
 static void OnUpdateAgentFragDone(int32_t status, uint32_t size) 
 {
 	uint8_t *datafile;
+	bool isClassCReleased = false;
+	bool isFileRxCrcValid = false;
+
+  /* the decoder is done with the slots, a reset from now on restarts the download */
+  IsFragCheckpointPending = false;
+  FragCheckpointClear();
+
+  if( status == FRAG_SESSION_FAILED ) {
+	  /* Too many lost fragments or a failed storage write: the file is incomplete */
+	  PRINTF("Fragmentation session failed, file not rebuilt\r\n");
+	  goto cleanup;
+  }
 
 #if ( INTEROP_TEST_MODE == 1 )
   datafile = UnfragmentedData;
 #else
   uint32_t ptr, len, crc;
-  storage_get_slot_info(STORAGE_SLOT_SOURCE, &ptr, &len);
+  FileRxCrc = 0;
+  if( storage_datafile_commit(size) != STR_OK ) {
+	  PRINTF("Failed to complete datafile in scratch slot\r\n");
+	  goto cleanup;
+  }
+  /* A full image may have been decoded in place, straight to Slot1 */
+  storage_get_slot_info(storage_datafile_in_place() ? STORAGE_SLOT_SCRATCH : STORAGE_SLOT_SOURCE, &ptr, &len);
   datafile = (uint8_t *)ptr;
 #endif	/* INTEROP_TEST_MODE == 1 */
   FileRxCrc = 0;
   if( storage_crc32(STORAGE_SLOT_SOURCE, 0, size, &crc) != STR_OK ) {
 	  PRINTF("Failed to calc CRC32 in source slot\r\n");
+  } else {
+	  FileRxCrc = crc;
+	  isFileRxCrcValid = true;
   }
-  FileRxCrc = crc;
   PRINTF("File size: %u CRC32: %x\r\n", size, FileRxCrc);
+  /* The file is rebuilt, the redundancy still to come is not needed: back to
+   * Class A before the image is processed, unless another fragmentation
+   * session still listens in this Class C window */
+  if( LmhpFragmentationIsSessionOngoing() == false ) {
+	  LmhpRemoteMcastSetupStopSession();
+  }
+  isClassCReleased = true;
+#if ( INTEROP_TEST_MODE == 0 )
+  PRINTF("Page erases: %lu\r\n", storage_get_page_erase_count());
+  FlashMemHandler_WriteStats_t writeStats = FlashMemHandler_GetWriteStats();
+  PRINTF("Flash writes: %lu bytes in %lu ms (%lu bytes/ms)\r\n",
+		  writeStats.Bytes, writeStats.TimeMs,
+		  writeStats.TimeMs != 0 ? writeStats.Bytes / writeStats.TimeMs : 0);
+#endif	/* INTEROP_TEST_MODE == 0 */
   if( *(uint32_t *)datafile != FIRMWARE_MAGIC)
   {
 	  PRINTF("Binary file received, no firmware magic found\r\n");
@@ -800,7 +935,10 @@ static void OnUpdateAgentFragDone(int32_t status, uint32_t size)
 	    PRINTF("\r\n...... Transfer full image from RAM to Flash Failed  ......\r\n");
 	}
 #else
-    if( move_image(STORAGE_SLOT_SOURCE, STORAGE_SLOT_SCRATCH, size, 1) == STR_OK ) {
+    if( storage_datafile_in_place() ) {
+    	PRINTF("\r\n...... Full image decoded in place in Slot1 ......\r\n");
+    	FWManagementParams.ImageValidate( &FWManagementParams );
+    } else if( move_image(STORAGE_SLOT_SOURCE, STORAGE_SLOT_SCRATCH, size, 1) == STR_OK ) {
     	PRINTF("\r\n...... Transfer full image from Swap to Slot1 success ......\r\n");
     	FWManagementParams.ImageValidate( &FWManagementParams );
     } else {
@@ -816,9 +954,24 @@ static void OnUpdateAgentFragDone(int32_t status, uint32_t size)
    */
 cleanup:
 
-  LmHandlerRequestClass( CLASS_A );
-  IsMcSessionStarted = false;
-  IsFileTransferDone = true;
+  IsFragTransferOngoing = false;
+  /* The file could not be rebuilt: back to Class A as well, the session
+   * timer would only keep the radio listening for nothing */
+  if( ( isClassCReleased == false ) && ( LmhpFragmentationIsSessionOngoing() == false ) ) {
+	  LmhpRemoteMcastSetupStopSession();
+  }
+  /* No FragDataBlockAuthReq without the CRC of the file rebuilt */
+  if( isFileRxCrcValid == true ) {
+	  IsFileTransferDone = true;
+	  /* Send the FragDataBlockAuthReq without waiting for the Tx timer */
+	  IsTxFramePending = 1;
+  }
+}
+
+static void OnFragSessionChange(void)
+{
+  /* keep the checkpoint in line with the sessions set up or deleted */
+  IsFragCheckpointPending = true;
 }
 
 static void NewImageValidate ( void *params ) {
@@ -862,7 +1015,32 @@ static void UplinkProcess(void)
       return;
     }
 
-    if (IsMcSessionStarted == false)    /* we are in Class A*/
+    if (IsFileTransferDone == true)    /* the file is complete, the device may be back in Class A already */
+    {
+      AppDataBuffer[0] = 0x05; // FragDataBlockAuthReq
+      AppDataBuffer[1] = FileRxCrc & 0x000000FF;
+      AppDataBuffer[2] = (FileRxCrc >> 8) & 0x000000FF;
+      AppDataBuffer[3] = (FileRxCrc >> 16) & 0x000000FF;
+      AppDataBuffer[4] = (FileRxCrc >> 24) & 0x000000FF;
+
+      /* Send FragAuthReq */
+      LmHandlerAppData_t appData =
+      {
+        .Buffer = AppDataBuffer,
+        .BufferSize = 5,
+        .Port = 201
+      };
+      status = LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
+      if (status == LORAMAC_HANDLER_SUCCESS)
+      {
+        /* The fragmented transport layer V1.0 doesn't specify any behavior*/
+        /* we keep the interop test behavior - CRC32 is returned to the server*/
+        PRINTF(" CRC send \n\r");
+        /* otherwise it is sent again on the next Tx timer event */
+        IsFileTransferDone = false;
+      }
+    }
+    else if (IsMcSessionStarted == false)    /* we are in Class A*/
     {
       if (IsClockSynched == false)    /* we request AppTimeReq to allow FUOTA */
       {
@@ -884,34 +1062,7 @@ static void UplinkProcess(void)
     }
     else  /* Now we are in Class C or in Class B -- FUOTA feature could be activated */
     {
-      if (IsFileTransferDone == false)
-      {
-        /* do nothing up to the transfer done or sent a data user */
-      }
-      else
-      {
-        AppDataBuffer[0] = 0x05; // FragDataBlockAuthReq
-        AppDataBuffer[1] = FileRxCrc & 0x000000FF;
-        AppDataBuffer[2] = (FileRxCrc >> 8) & 0x000000FF;
-        AppDataBuffer[3] = (FileRxCrc >> 16) & 0x000000FF;
-        AppDataBuffer[4] = (FileRxCrc >> 24) & 0x000000FF;
-
-        /* Send FragAuthReq */
-        LmHandlerAppData_t appData =
-        {
-          .Buffer = AppDataBuffer,
-          .BufferSize = 5,
-          .Port = 201
-        };
-        status = LmHandlerSend(&appData, LORAMAC_HANDLER_UNCONFIRMED_MSG);
-      }
-      IsFileTransferDone = false;
-      if (status == LORAMAC_HANDLER_SUCCESS)
-      {
-        /* The fragmented transport layer V1.0 doesn't specify any behavior*/
-        /* we keep the interop test behavior - CRC32 is returned to the server*/
-        PRINTF(" CRC send \n\r");
-      }
+      /* do nothing up to the transfer done or sent a data user */
     }
     /* send application frame - could be put in conditional compilation*/
     /*  Send(NULL);  comment the sending to avoid interference during multicast*/
@@ -921,27 +1072,12 @@ static void UplinkProcess(void)
 #if (ACTILITY_LIBRARY == 0)
 static uint32_t Crc32(uint8_t *buffer, uint16_t length)
 {
-  // The CRC calculation follows CCITT - 0x04C11DB7
-  const uint32_t reversedPolynom = 0xEDB88320;
-
-  // CRC initial value
-  uint32_t crc = 0xFFFFFFFF;
-
   if (buffer == NULL)
   {
     return 0;
   }
 
-  for (uint16_t i = 0; i < length; ++i)
-  {
-    crc ^= (uint32_t)buffer[i];
-    for (uint16_t i = 0; i < 8; i++)
-    {
-      crc = (crc >> 1) ^ (reversedPolynom & ~((crc & 0x01) - 1));
-    }
-  }
-
-  return ~crc;
+  return crc32_compute(buffer, length);
 }
 #endif /* ACTILITY_LIBRARY == 0 */
 
@@ -1014,7 +1150,15 @@ static uint8_t FragDecoderRead(uint32_t addr, uint8_t *data, uint32_t size)
 
 static void OnNvmContextChange(LmHandlerNvmContextStates_t state)
 {
-  PRINTF("OnNvmContextChange\r\n");
+  if (state == LORAMAC_HANDLER_NVM_RESTORE)
+  {
+    IsNvmContextRestored = true;
+    PRINTF("OnNvmContextChange: restored\r\n");
+  }
+  else
+  {
+    PRINTF("OnNvmContextChange: stored\r\n");
+  }
 }
 static void OnNetworkParametersChange(CommissioningParams_t *params)
 {
@@ -102,6 +102,14 @@ extern uint32_t __ICFEDIT_region_SWAP_start__;
 #define REGION_SWAP_START ((uint32_t)& __ICFEDIT_region_SWAP_start__)
 extern uint32_t __ICFEDIT_region_SWAP_end__;
 #define REGION_SWAP_END ((uint32_t)& __ICFEDIT_region_SWAP_end__)
+extern uint32_t __ICFEDIT_region_BACKUP_start__;
+#define REGION_BACKUP_START ((uint32_t)& __ICFEDIT_region_BACKUP_start__)
+extern uint32_t __ICFEDIT_region_BACKUP_end__;
+#define REGION_BACKUP_END ((uint32_t)& __ICFEDIT_region_BACKUP_end__)
+extern uint32_t __ICFEDIT_region_NVM_start__;
+#define REGION_NVM_START ((uint32_t)& __ICFEDIT_region_NVM_start__)
+extern uint32_t __ICFEDIT_region_NVM_end__;
+#define REGION_NVM_END ((uint32_t)& __ICFEDIT_region_NVM_end__)
 #endif
 
 /**